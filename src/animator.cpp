@@ -1,72 +1,261 @@
+#include <algorithm>
+
 #include "animator.h"
 #include "convert.h"
+#include "library.h"
+#include "mapped.h"
+#include "packing.h"
+#include "posecache.h"
+#include "retarget.h"
+#include "stream.h"
 
-Animation::Animation(aiAnimation* data, BoneMap& ref)
+Clip::Clip(aiAnimation* data)
 {
     name = std::string(data->mName.C_Str());
     duration = data->mDuration;
     ticksPerSecond = data->mTicksPerSecond;
-    boneTransforms.resize(ref.size());
-
     for (unsigned i = 0; i < data->mNumChannels; i++) {
         aiNodeAnim* n = data->mChannels[i];
-        std::string name = std::string(n->mNodeName.C_Str());
-        nodeAnimations.insert({ name, Keyframes(n) });
-    }
-}
-
-void Animation::computeBoneTransform(
-    BoneMap& bones, Node& node,
-    glm::mat4 parentTransform,
-    double time, bool playing
-)
-{
-    glm::mat4 transform = node.transform;
-    if (nodeAnimations.count(node.name) && playing)
-        transform = nodeAnimations[node.name].getInterpolatedTransform(time);
-
-    // If we have a bone, set its transformation matrix,
-    // else set the transform of the mesh directly
-    glm::mat4 globalTransform = parentTransform * transform;
-    if (bones.count(node.name)) {
-        Bone& bone = bones[node.name];
-        boneTransforms[bone.id] = globalTransform * bone.inverseBindMatrix;
-    } else {
-        for (int i = 0; i < node.meshCount; i++) {
-            meshTransforms.push_back(globalTransform);
+        channelNodes.push_back(std::string(n->mNodeName.C_Str()));
+        channels.push_back(Keyframes(n));
+    }
+
+    for (unsigned i = 0; i < data->mNumMorphMeshChannels; i++) {
+        aiMeshMorphAnim* m = data->mMorphMeshChannels[i];
+        morphNodes.push_back(std::string(m->mName.C_Str()));
+        morphChannels.push_back(MorphKeyframes(m));
+    }
+}
+
+Animation::Animation(
+    std::shared_ptr<const Clip> clip, const std::vector<Node>& nodes,
+    std::shared_ptr<const RetargetMap> retarget
+) : clip(clip), retarget(retarget) {
+    // Resolve the channels to node indexes once
+    auto resolve = [](const std::vector<std::string>& names,
+                      const std::vector<std::string>& nodeNames, std::vector<int>& result) {
+        result.assign(nodeNames.size(), -1);
+        for (size_t i = 0; i < names.size(); i++) {
+            for (size_t j = 0; j < nodeNames.size(); j++) {
+                if (nodeNames[j] == names[i]) {
+                    result[j] = i;
+                    break;
+                }
+            }
         }
+    };
+
+    if (!retarget) {
+        std::vector<std::string> nodeNames;
+        for (const Node& node : nodes)
+            nodeNames.push_back(node.name);
+        resolve(clip->channelNodes, nodeNames, nodeChannels);
+        resolve(clip->morphNodes, nodeNames, nodeMorphChannels);
+        return;
     }
 
-    for (Node& child : node.children) {
-        computeBoneTransform(bones, child, globalTransform, time, playing);
+    // Resolve against the source rig, then go through the map. The morph
+    // targets belong to the source's meshes, so they aren't carried over
+    std::vector<int> sourceChannels;
+    resolve(clip->channelNodes, retarget->sourceNames, sourceChannels);
+    nodeChannels.assign(nodes.size(), -1);
+    for (size_t i = 0; i < nodes.size() && i < retarget->sources.size(); i++) {
+        int source = retarget->sources[i];
+        if (source != -1)
+            nodeChannels[i] = sourceChannels[source];
     }
+    nodeMorphChannels.assign(nodes.size(), -1);
 }
 
-void Animator::load(const aiScene* scene)
+// Keep the translation and scale of a local transform, with another rotation
+static glm::mat4 withRotation(const glm::mat4& transform, const glm::quat& rotation)
+{
+    glm::mat4 result = glm::mat4_cast(rotation);
+    for (int c = 0; c < 3; c++)
+        result[c] *= glm::length(glm::vec3(transform[c]));
+    result[3] = transform[3];
+    return result;
+}
+
+void Animator::computePose(const Animation& animation, double time, bool animate, Pose& result)
+{
+    const std::vector<Keyframes>* channels = &animation.clip->channels;
+
+    // Stop holding the chunks of the streamed clip this animator played before
+    if (heldClip && heldClip != animation.clip)
+        releaseHeldClip();
+
+    // A streamed clip samples its resident chunk. Until the chunk under the
+    // playhead is decoded the last one is held, so this never waits on I/O
+    if (animation.clip->stream) {
+        std::shared_ptr<const ClipChunk> chunk = animation.clip->stream->chunk(time, this);
+        if (chunk || heldClip != animation.clip) {
+            heldChunk = chunk;
+            heldClip = animation.clip;
+        }
+        if (heldChunk) {
+            time = std::clamp(time, heldChunk->start, heldChunk->end);
+            channels = &heldChunk->channels;
+        } else {
+            animate = false; // Nothing decoded yet
+        }
+    }
+
+    std::vector<glm::mat4>& globalTransforms = result.nodeTransforms;
+    globalTransforms.resize(nodes.size());
+    result.boneTransforms.resize(bones.size());
+    result.palette.resize(bones.size());
+    result.meshTransforms.clear();
+    size_t meshIndex = 0;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        Node& node = nodes[i];
+        glm::mat4 transform = node.transform;
+        int channel = animation.nodeChannels[i];
+        if (animate && channel != -1 && animation.retarget)
+            transform = animation.retarget->apply(i, (*channels)[channel], time);
+        else if (animate && channel != -1)
+            transform = (*channels)[channel].getInterpolatedTransform(time);
+        if (i < nodeOverrides.size() && nodeOverrides[i] != -1)
+            transform = withRotation(transform, overrides.rotations[nodeOverrides[i]]);
+
+        // If we have a bone, set its transformation matrix,
+        // else set the transform of the mesh directly
+        glm::mat4 globalTransform = node.parent == -1
+            ? transform
+            : globalTransforms[node.parent] * transform;
+        globalTransforms[i] = globalTransform;
+
+        if (node.boneId != -1) {
+            result.boneTransforms[node.boneId] = globalTransform * inverseBindMatrices[node.boneId];
+            result.palette[node.boneId] = toPaletteBone(result.boneTransforms[node.boneId]);
+            continue;
+        }
+
+        // The weight vectors are reused from frame to frame
+        if (result.morphWeights.size() < meshIndex + node.meshCount)
+            result.morphWeights.resize(meshIndex + node.meshCount);
+        int morph = animation.nodeMorphChannels[i];
+        for (int j = 0; j < node.meshCount; j++, meshIndex++) {
+            result.meshTransforms.push_back(globalTransform);
+            if (animate && morph != -1)
+                animation.clip->morphChannels[morph].getInterpolatedWeights(
+                    time, result.morphWeights[meshIndex]);
+            else
+                result.morphWeights[meshIndex].clear();
+        }
+    }
+}
+
+Animator::~Animator()
+{
+    releaseHeldClip();
+}
+
+void Animator::releaseHeldClip()
+{
+    if (heldClip && heldClip->stream)
+        heldClip->stream->release(this);
+    heldClip.reset();
+    heldChunk.reset();
+}
+
+void Animator::reset()
 {
     playing = false;
     currentAnimation = 0;
-    rootNode = readNodeData(scene, scene->mRootNode);
+    lastRun = -1;
+    libraryVersion = 0;
+    animations.clear();
+    shared.reset();
+
+    inverseBindMatrices.resize(bones.size());
+    for (auto& [boneName, bone] : bones)
+        inverseBindMatrices[bone.id] = bone.inverseBindMatrix;
+
+    // Everything a pose depends on besides its clip and time, so that
+    // copies of a model share poses but rigs that differ slightly don't
+    std::string all;
+    for (Node& node : nodes) {
+        all += node.name + "/" + std::to_string(node.parent) + "/" +
+               std::to_string(node.meshCount) + "/" + std::to_string(node.boneId) + "\n";
+        all.append((const char*)&node.transform, sizeof(node.transform));
+    }
+    all.append((const char*)inverseBindMatrices.data(),
+               inverseBindMatrices.size() * sizeof(glm::mat4));
+    rigSignature = hashBytes((const unsigned char*)all.data(), all.size());
+}
+
+void Animator::load(const aiScene* scene)
+{
+    nodes.clear();
+    bones.clear();
+    clips.clear();
+    readNodeData(scene, scene->mRootNode, -1);
+
+    // The bones are only all known once every node has been read
+    for (Node& node : nodes) {
+        node.boneId = bones.count(node.name) ? bones[node.name].id : -1;
+    }
+
+    for (unsigned i = 0; i < scene->mNumAnimations; i++)
+        clips.push_back(std::make_shared<const Clip>(scene->mAnimations[i]));
+    reset();
+}
+
+void Animator::load(std::vector<Node> nodes, BoneMap bones, std::vector<Clip> clips)
+{
+    this->nodes = std::move(nodes);
+    this->bones = std::move(bones);
+    this->clips.clear();
+    for (Clip& clip : clips)
+        this->clips.push_back(std::make_shared<const Clip>(std::move(clip)));
+    reset();
+}
+
+void Animator::share(AnimationLibrary& library)
+{
+    size_t version = library.version();
+    if (version == libraryVersion)
+        return;
+    libraryVersion = version;
 
-    for (unsigned i = 0; i < scene->mNumAnimations; i++) {
-        aiAnimation* a = scene->mAnimations[i];
-        animations.push_back(Animation(a, bones));
+    // The model's own clips keep their indexes, the other
+    // compatible ones come after them
+    clips = library.add(nodes, clips);
+    std::vector<std::shared_ptr<const Clip>> playable = clips;
+    for (std::shared_ptr<const Clip>& clip : library.clipsFor(nodes)) {
+        if (std::find(playable.begin(), playable.end(), clip) == playable.end())
+            playable.push_back(clip);
     }
+
+    animations.clear();
+    for (std::shared_ptr<const Clip>& clip : playable)
+        animations.push_back(Animation(clip, nodes));
+
+    // Then the clips of other rigs, through the maps the library built
+    for (AnimationLibrary::RetargetedClip& r : library.retargetedClipsFor(nodes))
+        animations.push_back(Animation(r.clip, nodes, r.map));
 }
 
-int Animator::getBoneId(std::string name) { return bones[name].id; }
+int Animator::getBoneId(std::string name)
+{
+    // Doesn't insert, so it's safe to call from several threads
+    auto it = bones.find(name);
+    return it == bones.end() ? -1 : it->second.id;
+}
 
 std::vector<std::string> Animator::animationNames()
 {
     std::vector<std::string> result;
     for (Animation& animation : animations) {
-        result.push_back(animation.name);
+        result.push_back(animation.clip->name);
     }
     return result;
 }
 
 // Read the necessary bone and node data
-Node Animator::readNodeData(const aiScene* scene, aiNode* data)
+void Animator::readNodeData(const aiScene* scene, aiNode* data, int parent)
 {
     // Read bones that have not already been read
     for (unsigned i = 0; i < data->mNumMeshes; i++) {
@@ -87,35 +276,150 @@ Node Animator::readNodeData(const aiScene* scene, aiNode* data)
     Node node;
     node.meshCount = data->mNumMeshes;
     node.name = data->mName.C_Str();
+    node.parent = parent;
+    node.boneId = -1;
     node.transform = assimpToGlmMatrix(data->mTransformation);
+
+    int index = nodes.size();
+    nodes.push_back(node);
     for (unsigned int i = 0; i < data->mNumChildren; i++) {
-        Node n = readNodeData(scene, data->mChildren[i]);
-        node.children.push_back(n);
+        readNodeData(scene, data->mChildren[i], index);
     }
-    return node;
 }
 
-Animation* Animator::run(double seconds)
+const Pose* Animator::run(double seconds, PoseCache* cache)
 {
     if (animations.size() == 0 || currentAnimation >= animations.size())
         return nullptr;
 
-    Animation* a = &animations[currentAnimation];
-    double time = fmod(seconds * a->ticksPerSecond, a->duration);
+    const Animation& a = animations[currentAnimation];
+    double time = fmod(seconds * a.clip->ticksPerSecond, a.clip->duration);
+    lastRun = currentAnimation;
+
+    // Streamed clips depend on which of their chunks this model holds
+    if (cache == nullptr || a.clip->stream || !overrides.nodes.empty()) {
+        shared.reset();
+        computePose(a, time, playing, pose);
+        return &pose;
+    }
 
-    if (!a->meshTransforms.empty())
-        a->meshTransforms.clear();
+    // Snap to the cache's step so that times a hair apart share a pose
+    double stepTicks = cache->step * a.clip->ticksPerSecond;
+    long long step = stepTicks > 0.0 ? llround(time / stepTicks) : 0;
+    if (stepTicks > 0.0) {
+        // Rounding up can reach the end, which is the same pose as the start
+        long long steps = std::max(1ll, llround(a.clip->duration / stepTicks));
+        step %= steps;
+        time = fmod(step * stepTicks, a.clip->duration);
+    }
 
-    a->computeBoneTransform(bones, rootNode, glm::mat4(1.0), time, playing);
-    return a;
+    // Paused clips hold the rest pose whatever the time
+    PoseKey key = { rigSignature, a.clip.get(), playing ? step : -1 };
+    shared = cache->get(key, [&](Pose& result) {
+        computePose(a, time, playing, result);
+    });
+    return shared.get();
 }
 
-int Animator::getNumBoneTransforms()
+Pose* Animator::sample(size_t index, double seconds)
+{
+    if (index >= animations.size())
+        return nullptr;
+
+    // Streamed clips only have the chunks around the playhead resident
+    const Animation& a = animations[index];
+    if (a.clip->stream)
+        return nullptr;
+
+    computePose(a, std::clamp(seconds * a.clip->ticksPerSecond, 0.0, a.clip->duration), true, pose);
+    shared.reset();
+    lastRun = index;
+    return &pose;
+}
+
+double Animator::clipSeconds(size_t index)
+{
+    if (index >= animations.size())
+        return 0.0;
+    const Clip& clip = *animations[index].clip;
+    return clip.ticksPerSecond > 0.0 ? clip.duration / clip.ticksPerSecond : 0.0;
+}
+
+const Pose* Animator::current()
+{
+    if (lastRun == -1 || lastRun >= int(animations.size()))
+        return nullptr;
+    return shared ? shared.get() : &pose;
+}
+
+void Animator::setOverrides(const PoseOverrides& overrides)
+{
+    this->overrides = overrides;
+    nodeOverrides.assign(nodes.size(), -1);
+    for (size_t i = 0; i < overrides.nodes.size(); i++) {
+        if (overrides.nodes[i] >= 0 && overrides.nodes[i] < int(nodes.size()))
+            nodeOverrides[overrides.nodes[i]] = i;
+    }
+}
+
+const std::vector<glm::mat4>& Animator::getGlobalTransforms()
+{
+    static const std::vector<glm::mat4> none;
+    const Pose* p = current();
+    return p ? p->nodeTransforms : none;
+}
+
+std::shared_ptr<const Pose> Animator::snapshot()
+{
+    if (current() == nullptr)
+        return nullptr;
+    // A pose from the cache is never written again, so it needs no copy
+    return shared ? shared : std::make_shared<const Pose>(pose);
+}
+
+// Blend the matrices component by component. Poses a tick apart are close
+// enough for that to match decomposing them, like the baked crowd rows
+void interpolatePoses(const Pose& from, const Pose& to, float factor, Pose& result)
 {
-    unsigned int max = 0;
-    for (Animation& a : animations) {
-        if (a.boneTransforms.size() > max)
-            max = a.boneTransforms.size();
+    // The poses of a model only differ in size when it's reloaded
+    if (from.boneTransforms.size() != to.boneTransforms.size() ||
+        from.meshTransforms.size() != to.meshTransforms.size()) {
+        result = to;
+        return;
+    }
+
+    result.boneTransforms.resize(to.boneTransforms.size());
+    result.palette.resize(to.boneTransforms.size());
+    for (size_t i = 0; i < to.boneTransforms.size(); i++) {
+        result.boneTransforms[i] =
+            from.boneTransforms[i] + (to.boneTransforms[i] - from.boneTransforms[i]) * factor;
+        result.palette[i] = toPaletteBone(result.boneTransforms[i]);
+    }
+
+    result.meshTransforms.resize(to.meshTransforms.size());
+    for (size_t i = 0; i < to.meshTransforms.size(); i++)
+        result.meshTransforms[i] =
+            from.meshTransforms[i] + (to.meshTransforms[i] - from.meshTransforms[i]) * factor;
+
+    // Only drawn, so the node transforms the IK solver reads aren't blended
+    result.nodeTransforms.clear();
+
+    // Clips without morph channels leave the weights empty
+    result.morphWeights.resize(to.morphWeights.size());
+    for (size_t i = 0; i < to.morphWeights.size(); i++) {
+        const std::vector<float>& b = to.morphWeights[i];
+        if (i >= from.morphWeights.size() || from.morphWeights[i].size() != b.size()) {
+            result.morphWeights[i] = b;
+            continue;
+        }
+        const std::vector<float>& a = from.morphWeights[i];
+        result.morphWeights[i].resize(b.size());
+        for (size_t j = 0; j < b.size(); j++)
+            result.morphWeights[i][j] = a[j] + (b[j] - a[j]) * factor;
     }
-    return max;
+}
+
+int Animator::getNumBoneTransforms()
+{
+    return bones.size();
 }
@@ -1,58 +1,163 @@
 #pragma once
 
+#include <memory>
+
 #include <assimp/scene.h>
 
 #include "keyframes.h"
 #include "vertex.h"
 
+struct AnimationTables;
+struct ClipChunk;
+class ClipStream;
+struct CookedHeader;
+class CookReader;
+class CookWriter;
+class PoseCache;
+class RetargetMap;
+
+// The node hierarchy is stored flattened, depth first,
+// so that parents always come before their children
 struct Node
 {
     std::string name;
+    int parent; // -1 for the root
     int meshCount;
+    int boneId; // -1 when the node isn't a bone
     glm::mat4 transform;
-    std::vector<Node> children;
 };
 
 using BoneMap = std::unordered_map<std::string, Bone>;
 
-class Animation
+// An animation's keyframes. They don't depend on the model that plays
+// them, so models with the same rig share them through the AnimationLibrary
+struct Clip
 {
-public:
-    Animation(aiAnimation* data, BoneMap& bones);
-    void computeBoneTransform(
-        BoneMap& bones, Node& node,
-        glm::mat4 parentTransform,
-        double time, bool playing
-    );
+    Clip() {}
+    Clip(aiAnimation* data);
 
     std::string name;
     double ticksPerSecond, duration;
+    std::vector<Keyframes> channels; // Empty when they're streamed
+    std::vector<std::string> channelNodes; // Name of the node each channel moves
+    std::shared_ptr<ClipStream> stream; // Set for long clips
+
+    // Morph target weights, applied to every mesh of the node they name
+    std::vector<MorphKeyframes> morphChannels;
+    std::vector<std::string> morphNodes;
+};
+
+// A clip bound to the nodes of a model. A clip authored for another
+// rig is bound through a retarget map, see retarget.h
+class Animation
+{
+public:
+    Animation(std::shared_ptr<const Clip> clip, const std::vector<Node>& nodes,
+              std::shared_ptr<const RetargetMap> retarget = nullptr);
+
+    std::shared_ptr<const Clip> clip;
+    std::shared_ptr<const RetargetMap> retarget;
+    std::vector<int> nodeChannels; // Index of each node's channel, or -1
+    std::vector<int> nodeMorphChannels;
+};
+
+// The transforms the animation computed for the model's current frame
+struct Pose
+{
     std::vector<glm::mat4> boneTransforms;
+    std::vector<PaletteBone> palette; // The bone transforms, as uploaded
     std::vector<glm::mat4> meshTransforms;
-private:
-    BoneMap* bonesRef;
-    std::unordered_map<std::string, Keyframes> nodeAnimations;
+    // Of every node in model space, so that models sharing the pose have them
+    std::vector<glm::mat4> nodeTransforms;
+    // Per mesh like the mesh transforms, empty when no channel drives them
+    std::vector<std::vector<float>> morphWeights;
 };
 
+// Local rotations that replace the animation's on some nodes, written by
+// the IK solver. The nodes keep their animated translation and scale
+struct PoseOverrides
+{
+    std::vector<int> nodes;
+    std::vector<glm::quat> rotations;
+};
+
+// Blend two poses of the same model, for drawing between animation ticks
+void interpolatePoses(const Pose& from, const Pose& to, float factor, Pose& result);
+
+class AnimationLibrary;
+
 class Animator
 {
 public:
+    ~Animator();
+
     void load(const aiScene* scene);
-    int getBoneId(std::string name);
+    void load(std::vector<Node> nodes, BoneMap bones, std::vector<Clip> clips);
+
+    // Swap the model's clips for the library's copies, and play every clip
+    // of the library that fits the model's rig. Called again when the
+    // library changes
+    void share(AnimationLibrary& library);
+    const std::vector<Node>& getNodes() { return nodes; }
+    const std::vector<std::shared_ptr<const Clip>>& getClips() { return clips; }
+
+    int getBoneId(std::string name); // -1 if there's no such bone
     std::vector<std::string> animationNames();
 
-    // Compute the bone transforms for the current transform given the
-    // time in seconds and return a pointer to the current animation.
-    Animation* run(double seconds);
+    // Compute the bone transforms for the current animation given the
+    // time in seconds and return a pointer to the pose. With a cache,
+    // the pose is shared with the models that asked for the same one
+    const Pose* run(double seconds, PoseCache* cache = nullptr);
+
+    // The pose that was last computed by run, or nullptr
+    const Pose* current();
+    // The current pose, kept as it is after the next run
+    std::shared_ptr<const Pose> snapshot();
+
+    // Compute the pose of any animation at a time in seconds, whether or not
+    // it's playing, for baking. Returns nullptr for streamed clips
+    Pose* sample(size_t index, double seconds);
+    double clipSeconds(size_t index); // Length of an animation in seconds
 
     int getNumBoneTransforms();
 
+    // Applied from the next run on, until they're replaced. A model with
+    // overrides has a pose of its own, so it doesn't use the pose cache
+    void setOverrides(const PoseOverrides& overrides);
+    // Of every node in the current pose, in model space. Empty without one
+    const std::vector<glm::mat4>& getGlobalTransforms();
+
+    // Flatten the rig and every animation's keyframes for the GPU, see sampler.h
+    void flatten(int numMeshes, AnimationTables& tables);
+
+    // Write or read the nodes, bones and clips of a cooked model
+    void cook(CookWriter& writer, CookedHeader& header);
+    void loadCooked(const CookReader& reader);
+
     bool playing;
     size_t currentAnimation;
 private:
-    Node readNodeData(const aiScene* scene, aiNode* data);
+    int lastRun = -1;
+    void readNodeData(const aiScene* scene, aiNode* data, int parent);
+    void reset();
+    void computePose(const Animation& animation, double time, bool animate, Pose& result);
+    void releaseHeldClip();
 
-    Node rootNode;
+    std::vector<Node> nodes;
     BoneMap bones;
-    std::vector<Animation> animations;
+    std::vector<glm::mat4> inverseBindMatrices; // Indexed by bone id
+
+    std::vector<std::shared_ptr<const Clip>> clips; // The model file's own
+    std::vector<Animation> animations; // Every clip the model can play
+    size_t libraryVersion = 0;
+
+    Pose pose;
+    std::shared_ptr<const Pose> shared; // From the pose cache, replaces pose when set
+    uint64_t rigSignature = 0;
+    PoseOverrides overrides;
+    std::vector<int> nodeOverrides; // Index in the overrides of each node, or -1
+
+    // The streamed chunk last sampled, held while the next one decodes
+    std::shared_ptr<const ClipChunk> heldChunk;
+    std::shared_ptr<const Clip> heldClip;
 };
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+struct BoundingBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    BoundingBox()
+    {
+        min = glm::vec3(std::numeric_limits<float>::max());
+        max = glm::vec3(std::numeric_limits<float>::lowest());
+    }
+
+    // Update the min and max extremes of the bounding box
+    void update(glm::vec3 v)
+    {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(v[i], min[i]);
+            max[i] = std::max(v[i], max[i]);
+        }
+    }
+
+    void update(const BoundingBox& b)
+    {
+        if (!b.valid()) return;
+        update(b.min);
+        update(b.max);
+    }
+
+    bool valid() const { return min.x <= max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+
+    // Get the axis aligned box that encloses this box after a transformation
+    BoundingBox transform(const glm::mat4& m) const
+    {
+        BoundingBox result;
+        if (!valid()) return result;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner = glm::vec3(
+                i & 1 ? max.x : min.x,
+                i & 2 ? max.y : min.y,
+                i & 4 ? max.z : min.z
+            );
+            result.update(glm::vec3(m * glm::vec4(corner, 1.0)));
+        }
+        return result;
+    }
+};
+
+// Slab test. Returns the distance along the ray to the
+// box (0 when the origin is inside) or -1 if it misses
+inline float intersectBox(const Ray& ray, const BoundingBox& box)
+{
+    float near = 0.0;
+    float far = std::numeric_limits<float>::max();
+
+    for (int i = 0; i < 3; i++) {
+        float inverse = 1.0f / ray.direction[i];
+        float t0 = (box.min[i] - ray.origin[i]) * inverse;
+        float t1 = (box.max[i] - ray.origin[i]) * inverse;
+        if (inverse < 0.0) std::swap(t0, t1);
+
+        near = std::max(near, t0);
+        far = std::min(far, t1);
+        if (far < near) return -1;
+    }
+
+    return near;
+}
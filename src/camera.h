@@ -3,6 +3,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bounds.h"
+
 struct MVPTransforms
 {
     glm::mat4 view;
@@ -13,6 +15,10 @@ struct MVPTransforms
 class Camera
 {
 public:
+    static constexpr double fov = 0.785398; // 45 degres in radians
+    static constexpr double zNear = 0.1;
+    static constexpr double zFar = 100.0;
+
     void init(glm::vec3 _target, float _distance, double width, double height)
     {
         target = _target;
@@ -31,8 +37,7 @@ public:
         glm::vec3 up = glm::vec3(0, 1, 0);
         values.view = glm::lookAt(position, target, up);
 
-        double fov = 0.785398; // 45 degres in radians
-        values.projection = glm::perspective(fov, w / h, 0.1, 100.0);
+        values.projection = getProjection();
 
         values.viewPosition = position;
         return values;
@@ -40,8 +45,7 @@ public:
 
     glm::mat4 getProjection()
     {
-        double fov = 0.785398; // 45 degres in radians
-        return glm::perspective(fov, w / h, 0.1, 100.0);
+        return glm::perspective(fov, w / h, zNear, zFar);
     }
 
     glm::mat4 getViewWithoutTranslation()
@@ -51,6 +55,32 @@ public:
         return glm::mat4(glm::mat3(view));
     }
 
+    // Get the world space ray going through a point on the
+    // viewport, given in normalized device coordinates
+    Ray getRay(glm::vec2 ndc)
+    {
+        MVPTransforms t = getMVPTransforms();
+        glm::mat4 inverse = glm::inverse(t.projection * t.view);
+
+        glm::vec4 near = inverse * glm::vec4(ndc, -1.0, 1.0);
+        glm::vec4 far = inverse * glm::vec4(ndc, 1.0, 1.0);
+        near /= near.w;
+        far /= far.w;
+
+        return { glm::vec3(near), glm::normalize(glm::vec3(far - near)) };
+    }
+
+    // Height in pixels the bounding sphere of the box covers on the screen
+    float getScreenSize(const BoundingBox& box)
+    {
+        float radius = glm::length(box.max - box.min) * 0.5;
+        float d = glm::distance(position, box.center());
+        if (d <= radius)
+            return std::numeric_limits<float>::max(); // Inside of it
+
+        return radius / (d * tan(fov / 2.0)) * h;
+    }
+
     // Zoom in (direction = 1) and out (direction = -1)
     void zoom(int direction)
     {
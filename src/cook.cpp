@@ -0,0 +1,148 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "animator.h"
+#include "cook.h"
+#include "keyframes.h"
+#include "log.h"
+
+void CookWriter::save(std::string path)
+{
+    // Written to the side and renamed, so a half written file never gets loaded
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary);
+    file.write((const char*)bytes.data(), bytes.size());
+    file.close();
+    std::error_code error;
+    if (!file.good())
+        log(WARN, "Couldn't write " + temporary);
+    else
+        std::filesystem::rename(temporary, path, error);
+    if (error)
+        log(WARN, "Couldn't write " + path + ": " + error.message());
+}
+
+std::vector<CookedMorphChannel> writeMorphChannels(
+    CookWriter& writer, const std::vector<MorphKeyframes>& channels,
+    const std::vector<std::string>& nodes)
+{
+    std::vector<CookedMorphChannel> cooked;
+    for (size_t i = 0; i < channels.size(); i++) {
+        CookedMorphChannel c = {};
+        c.node = writer.write(nodes[i]);
+        c.numTargets = channels[i].getNumTargets();
+        c.times = writer.write(channels[i].getTimes());
+        c.weights = writer.write(channels[i].getWeights());
+        cooked.push_back(c);
+    }
+    return cooked;
+}
+
+void readMorphChannels(
+    const CookReader& reader, CookedRange range,
+    std::vector<MorphKeyframes>& channels, std::vector<std::string>& nodes)
+{
+    const CookedMorphChannel* cooked = reader.get<CookedMorphChannel>(range);
+    for (size_t i = 0; i < range.count; i++) {
+        const CookedMorphChannel& c = cooked[i];
+        if (c.weights.count != c.times.count * c.numTargets)
+            throw std::string("Cooked morph channel has an invalid size");
+        nodes.push_back(reader.string(c.node));
+        channels.push_back(MorphKeyframes(
+            c.numTargets, reader.array<double>(c.times), reader.array<float>(c.weights)));
+    }
+}
+
+void Animator::cook(CookWriter& writer, CookedHeader& header)
+{
+    std::vector<CookedNode> cookedNodes;
+    for (Node& node : nodes) {
+        CookedNode n = {};
+        n.name = writer.write(node.name);
+        n.parent = node.parent;
+        n.meshCount = node.meshCount;
+        n.boneId = node.boneId;
+        n.transform = node.transform;
+        cookedNodes.push_back(n);
+    }
+    header.nodes = writer.write(cookedNodes);
+
+    std::vector<CookedBone> cookedBones;
+    for (auto& [boneName, bone] : bones) {
+        CookedBone b = {};
+        b.name = writer.write(boneName);
+        b.id = bone.id;
+        b.inverseBindMatrix = bone.inverseBindMatrix;
+        cookedBones.push_back(b);
+    }
+    header.bones = writer.write(cookedBones);
+
+    // Only the file's own clips, the shared ones are cooked with their own files
+    std::vector<CookedAnimation> cookedAnimations;
+    for (std::shared_ptr<const Clip>& clip : clips) {
+        std::vector<CookedChannel> channels;
+        for (size_t i = 0; i < clip->channels.size(); i++) {
+            const Keyframes& k = clip->channels[i];
+            channels.push_back({
+                writer.write(clip->channelNodes[i]),
+                writer.write(k.getPositions()),
+                writer.write(k.getScalings()),
+                writer.write(k.getRotations())
+            });
+        }
+
+        CookedAnimation a = {};
+        a.name = writer.write(clip->name);
+        a.ticksPerSecond = clip->ticksPerSecond;
+        a.duration = clip->duration;
+        a.channels = writer.write(channels);
+        a.morphChannels = writer.write(
+            writeMorphChannels(writer, clip->morphChannels, clip->morphNodes));
+        cookedAnimations.push_back(a);
+    }
+    header.animations = writer.write(cookedAnimations);
+}
+
+void Animator::loadCooked(const CookReader& reader)
+{
+    const CookedHeader& header = reader.header();
+    nodes.clear();
+    const CookedNode* cookedNodes = reader.get<CookedNode>(header.nodes);
+    for (size_t i = 0; i < header.nodes.count; i++) {
+        const CookedNode& n = cookedNodes[i];
+        nodes.push_back({
+            reader.string(n.name), n.parent, n.meshCount, n.boneId, n.transform
+        });
+    }
+
+    bones.clear();
+    const CookedBone* cookedBones = reader.get<CookedBone>(header.bones);
+    for (size_t i = 0; i < header.bones.count; i++) {
+        const CookedBone& b = cookedBones[i];
+        bones[reader.string(b.name)] = { b.id, b.inverseBindMatrix };
+    }
+
+    clips.clear();
+    const CookedAnimation* cookedAnimations = reader.get<CookedAnimation>(header.animations);
+    for (size_t i = 0; i < header.animations.count; i++) {
+        const CookedAnimation& a = cookedAnimations[i];
+        auto clip = std::make_shared<Clip>();
+        clip->name = reader.string(a.name);
+        clip->ticksPerSecond = a.ticksPerSecond;
+        clip->duration = a.duration;
+
+        const CookedChannel* channels = reader.get<CookedChannel>(a.channels);
+        for (size_t j = 0; j < a.channels.count; j++) {
+            clip->channelNodes.push_back(reader.string(channels[j].node));
+            clip->channels.push_back(Keyframes(
+                reader.array<Keyframes::VectorKey>(channels[j].positions),
+                reader.array<Keyframes::VectorKey>(channels[j].scalings),
+                reader.array<Keyframes::QuatKey>(channels[j].rotations)
+            ));
+        }
+        readMorphChannels(reader, a.morphChannels, clip->morphChannels, clip->morphNodes);
+        clips.push_back(clip);
+    }
+    reset();
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "mapped.h"
+
+// Cooked models are written next to the source file after its first import,
+// and memory mapped on the following launches instead of going through
+// Assimp. Every section is an array of trivially copyable records,
+// referenced from the header and the other records by file offsets
+
+const uint32_t cookedVersion = 5;
+
+// An array in the file
+struct CookedRange
+{
+    uint64_t offset; // In bytes, from the start of the file
+    uint64_t count; // In elements
+};
+
+struct CookedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t packedVertices; // Layout of the vertex streams
+    uint32_t padding;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime; // Modification time, the file is only hashed when it changed
+
+    CookedRange nodes; // CookedNode
+    CookedRange bones; // CookedBone
+    CookedRange animations; // CookedAnimation
+    CookedRange meshes; // CookedMesh
+};
+
+struct CookedNode
+{
+    CookedRange name;
+    int32_t parent, meshCount, boneId, padding;
+    glm::mat4 transform;
+};
+
+struct CookedBone
+{
+    CookedRange name;
+    int32_t id, padding;
+    glm::mat4 inverseBindMatrix;
+};
+
+struct CookedAnimation
+{
+    CookedRange name;
+    double ticksPerSecond, duration;
+    CookedRange channels; // CookedChannel
+    CookedRange morphChannels; // CookedMorphChannel
+};
+
+struct CookedChannel
+{
+    CookedRange node; // Name of the node it moves
+    CookedRange positions, scalings, rotations;
+};
+
+struct CookedMorphChannel
+{
+    CookedRange node;
+    int32_t numTargets, padding;
+    CookedRange times; // double
+    CookedRange weights; // float, numTargets per key
+};
+
+struct CookedTexture
+{
+    CookedRange sampler, path;
+    CookedRange embedded; // Bytes, empty when it's a file
+    int32_t width, height; // See TextureRef
+};
+
+struct CookedMesh
+{
+    BoundingBox box;
+    int32_t indexType;
+    CookedRange textures; // CookedTexture
+    CookedRange skinVertices; // SkinVertex, kept on the CPU for picking
+    CookedRange indexes; // Full detail, for picking
+    CookedRange lods; // MeshLod
+    CookedRange boneBounds; // BoneBounds
+    CookedRange gpuData; // Bytes, see Mesh::gpuData
+    uint64_t skinSize, shadingSize, indexesSize;
+    CookedRange morphOffsets; // uint32_t
+    CookedRange morphDeltas; // MorphDelta
+    CookedRange morphWeights; // float
+};
+
+// Long animation clips are written in their own streamed file next to the
+// animation file they came from, cut in chunks of time that are decoded
+// while they play, see ClipStream
+
+const uint32_t streamedVersion = 3;
+
+struct StreamedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int64_t sourceTime; // Modification time, like CookedHeader's
+
+    CookedRange nodes; // CookedNode, for the skeleton signature
+    CookedRange clips; // StreamedClip
+};
+
+struct StreamedClip
+{
+    CookedRange name;
+    double ticksPerSecond, duration;
+    double chunkDuration; // In ticks
+    CookedRange channelNodes; // CookedRange, the name of each channel's node
+    CookedRange chunks; // CookedRange of a CookedChannel per channel
+    CookedRange morphChannels; // CookedMorphChannel, they're small enough to not be chunked
+};
+
+class CookWriter;
+class CookReader;
+class MorphKeyframes;
+
+std::vector<CookedMorphChannel> writeMorphChannels(
+    CookWriter& writer, const std::vector<MorphKeyframes>& channels,
+    const std::vector<std::string>& nodes);
+void readMorphChannels(
+    const CookReader& reader, CookedRange range,
+    std::vector<MorphKeyframes>& channels, std::vector<std::string>& nodes);
+
+class CookWriter
+{
+public:
+    CookWriter() { bytes.resize(sizeof(CookedHeader)); }
+
+    template <typename T>
+    CookedRange write(const T* data, size_t count)
+    {
+        // Keep every array aligned for any of the record types
+        bytes.resize((bytes.size() + 15) & ~size_t(15));
+        CookedRange range = { bytes.size(), count };
+        const unsigned char* p = (const unsigned char*)data;
+        bytes.insert(bytes.end(), p, p + count * sizeof(T));
+        return range;
+    }
+
+    template <typename T>
+    CookedRange write(const std::vector<T>& v) { return write(v.data(), v.size()); }
+    CookedRange write(const std::string& s) { return write(s.data(), s.size()); }
+
+    // Write the bytes to the path, through a temporary file
+    void save(std::string path);
+
+    std::vector<unsigned char> bytes;
+};
+
+class CookReader
+{
+public:
+    CookReader(std::shared_ptr<MappedFile> file) : file(file) {}
+
+    const CookedHeader& header() const { return *get<CookedHeader>({ 0, 1 }); }
+
+    template <typename T>
+    const T* get(CookedRange range) const
+    {
+        if (range.offset > file->size() ||
+            range.count * sizeof(T) > file->size() - range.offset)
+            throw std::string("Cooked model is truncated");
+        return (const T*)(file->data() + range.offset);
+    }
+
+    template <typename T>
+    std::vector<T> array(CookedRange range) const
+    {
+        const T* p = get<T>(range);
+        return std::vector<T>(p, p + range.count);
+    }
+
+    std::string string(CookedRange range) const
+    {
+        return std::string(get<char>(range), range.count);
+    }
+
+    // Share the ownership of the mapping with a pointer into it
+    std::shared_ptr<const unsigned char> share(CookedRange range) const
+    {
+        return std::shared_ptr<const unsigned char>(file, get<unsigned char>(range));
+    }
+
+    std::shared_ptr<MappedFile> file;
+};
@@ -0,0 +1,131 @@
+#include <cmath>
+#include <random>
+
+#include <glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "crowd.h"
+#include "log.h"
+
+// Texture unit of the baked poses, after the material's samplers
+const int bakedPosesUnit = 8;
+
+void Crowd::init(Model& model, float framesPerSecond)
+{
+    int maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+    BakedAnimations animations;
+    model.bakeAnimations(framesPerSecond, maxSize, animations);
+    clips = animations.clips;
+    baked = true;
+    if (clips.empty()) {
+        log(WARN, model.getName() + " has no clips to bake");
+        return;
+    }
+    log(DEBUG, "Baked " + std::to_string(clips.size()) + " clips of " + model.getName() +
+               " into " + std::to_string(animations.width) + "x" +
+               std::to_string(animations.rows) + " texels");
+
+    // Linear filtering between the rows blends consecutive frames
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, animations.width, animations.rows,
+                 0, GL_RGBA, GL_FLOAT, animations.texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &instancesBuffer);
+
+    try {
+        AnimationTables tables;
+        model.flattenAnimations(tables);
+        sampler.init(tables);
+        ticksPerSecond = tables.ticksPerSecond;
+        numSlots = tables.numSlots;
+        glGenBuffers(1, &posesBuffer);
+        sampled = true;
+    } catch (std::string msg) {
+        log(WARN, model.getName() + ": " + msg);
+    }
+}
+
+void Crowd::cleanup()
+{
+    if (texture != 0)
+        glDeleteTextures(1, &texture);
+    if (instancesBuffer != 0)
+        glDeleteBuffers(1, &instancesBuffer);
+    if (posesBuffer != 0)
+        glDeleteBuffers(1, &posesBuffer);
+    texture = instancesBuffer = posesBuffer = 0;
+    sampler.cleanup();
+    baked = sampled = false;
+    clips.clear();
+    instances.clear();
+}
+
+void Crowd::populate(Model& model, int count)
+{
+    instances.clear();
+    if (clips.empty()) return;
+
+    BoundingBox bounds = model.getWorldBounds();
+    glm::vec3 size = bounds.valid() ? bounds.max - bounds.min : glm::vec3(1.0);
+    float spacing = 1.5 * std::max(size.x, size.z);
+    int side = ceil(sqrt(count));
+
+    std::mt19937 random(count);
+    std::uniform_int_distribution<int> pickClip(0, clips.size() - 1);
+    std::uniform_real_distribution<float> unit(0.0, 1.0);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 offset = glm::vec3(
+            (i % side - (side - 1) * 0.5) * spacing, 0.0, -(i / side + 1) * spacing);
+        BakedClip& clip = clips[pickClip(random)];
+        instances.push_back({
+            .transform = glm::translate(glm::mat4(1.0), offset) * model.getTransform(),
+            .firstRow = clip.firstRow,
+            .frames = clip.frames,
+            .seconds = clip.seconds,
+            .timeOffset = unit(random) * clip.seconds,
+            .animation = clip.animation,
+            .ticksPerSecond = sampled ? ticksPerSecond[clip.animation] : 0.0f,
+            .padding = { 0.0, 0.0 }
+        });
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instancesBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(CrowdInstance),
+                 instances.data(), GL_STATIC_DRAW);
+    if (sampled) {
+        // Only ever written and read on the GPU
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, posesBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     instances.size() * numSlots * 3 * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Crowd::sample(Shader& program)
+{
+    if (!sampled || instances.empty()) return;
+    sampler.run(program, instancesBuffer, instances.size(), posesBuffer, time);
+}
+
+void Crowd::draw(Shader& shader, Model& model)
+{
+    if (instances.empty()) return;
+
+    glActiveTexture(GL_TEXTURE0 + bakedPosesUnit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    shader.set<int>("bakedPoses", bakedPosesUnit);
+    shader.set<float>("time", time);
+    shader.set<int>("numSlots", numSlots);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, instancesBuffer);
+    if (sampled)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, posesBuffer);
+    model.drawInstanced(shader, instances.size());
+}
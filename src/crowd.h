@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "sampler.h"
+
+// A clip in the baked texture. Its rows are frame 0 up to and including
+// frame frames, the last pose, so interpolating never reads past the clip
+struct BakedClip
+{
+    int firstRow;
+    int frames;
+    float seconds;
+    int animation; // Index in the model's animations
+};
+
+// The poses of a model's clips sampled at a fixed rate. Each row is a
+// frame, holding every bone transform then every mesh transform as
+// 3 RGBA texels, the first 3 rows of their matrices
+struct BakedAnimations
+{
+    int width = 0, rows = 0; // In texels
+    std::vector<float> texels;
+    std::vector<BakedClip> clips;
+};
+
+// Mirrors CrowdInstance in crowd/instances.glsl
+struct CrowdInstance
+{
+    glm::mat4 transform;
+    int firstRow;
+    int frames;
+    float seconds;
+    float timeOffset;
+    int animation;
+    float ticksPerSecond;
+    float padding[2];
+};
+
+// Many copies of a model, each playing one of its clips from the baked
+// texture. The vertex program samples the poses, so once the crowd's
+// been populated the characters cost nothing on the CPU. The poses can
+// also be sampled from the keyframes by the animation pass instead,
+// which is exact but costs a compute dispatch per frame
+class Crowd
+{
+public:
+    // Bake the model's clips at framesPerSecond into a float texture,
+    // and upload their keyframes for the animation pass when it can run
+    void init(Model& model, float framesPerSecond);
+    void cleanup();
+
+    // Place count characters in rows behind the model, playing
+    // random clips from random times. Always the same for a count
+    void populate(Model& model, int count);
+    void animate(double timeInSeconds) { time = timeInSeconds; }
+    // Pose every character with the animation pass, for the programs
+    // built with SAMPLED_POSES
+    void sample(Shader& program);
+    // Draw every character with one instanced draw per mesh
+    void draw(Shader& shader, Model& model);
+
+    bool initialized() { return baked; }
+    int size() { return instances.size(); }
+    int clipCount() { return clips.size(); }
+    bool canSample() { return sampled; }
+private:
+    bool baked = false;
+    std::vector<BakedClip> clips;
+    std::vector<CrowdInstance> instances;
+    unsigned int texture = 0, instancesBuffer = 0;
+    double time = 0.0;
+
+    AnimationSampler sampler;
+    bool sampled = false; // Whether the sampler could be set up
+    std::vector<float> ticksPerSecond; // Per animation
+    int numSlots = 0;
+    unsigned int posesBuffer = 0;
+};
@@ -1,5 +1,7 @@
 #include "movenet.h"
 #define GLAD_GL_IMPLEMENTATION 1
+#include <glad.h>
+#undef GLAD_GL_IMPLEMENTATION // The implementation isn't include guarded
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 #include "engine.h"
@@ -10,8 +12,36 @@ struct Light
     alignas(16) glm::vec3 color;
     alignas(16) glm::vec3 position;
     float c, l, q;
+    float radius;
 };
 
+// Mirrors the LightClusters buffer in clusters.glsl
+struct ClusterHeader
+{
+    glm::mat4 inverseProjection;
+    glm::vec4 viewportRect;
+    float zNear, zFar;
+    unsigned int indexCount;
+    unsigned int padding;
+};
+
+const glm::uvec3 clusterGrid = glm::uvec3(16, 9, 24);
+const int numClusters = clusterGrid.x * clusterGrid.y * clusterGrid.z;
+const int averageLightsPerCluster = 128;
+
+const double animationTicksPerSecond = 60.0;
+const double ikBudgetMilliseconds = 0.5;
+const float crowdFramesPerSecond = 30.0;
+const int maxCrowdSize = 1 << 20;
+
+// Distance at which the light's contribution drops under 5/256
+float lightRadius(Light& light)
+{
+    float brightest = std::max({ light.color.r, light.color.g, light.color.b });
+    float k = light.c - brightest * 256.0 / 5.0;
+    return (-light.l + sqrt(light.l * light.l - 4 * light.q * k)) / (2 * light.q);
+}
+
 void Engine::init(int width, int height, int frameWidth, int frameHeight)
 {
     glEnable(GL_DEPTH_TEST);
@@ -33,27 +63,119 @@ void Engine::init(int width, int height, int frameWidth, int frameHeight)
     webcamFrame = Texture(frameSize.x, frameSize.y);
     webcamFrame.init();
 
-    shader.load(GL_VERTEX_SHADER, "../src/shaders/default/vertex.glsl");
-    shader.load(GL_FRAGMENT_SHADER, "../src/shaders/default/fragment.glsl");
-    shader.assemble();
-    shader.use();
+    shaders.load("../src/shaders/default/vertex.glsl", "../src/shaders/default/fragment.glsl", true);
+
+    clusterShader.load(GL_COMPUTE_SHADER, "../src/shaders/lighting/compute.glsl");
+    clusterShader.assemble();
+    clusteredLighting = true;
+    stageLights = 0;
+
+    gbufferShaders.load("../src/shaders/default/vertex.glsl", "../src/shaders/deferred/gbuffer.glsl", true);
+    deferredLightingShader.load(GL_COMPUTE_SHADER, "../src/shaders/deferred/compute.glsl");
+    deferredLightingShader.assemble();
+    compositeShader.load(GL_VERTEX_SHADER, "../src/shaders/deferred/vertex.glsl");
+    compositeShader.load(GL_FRAGMENT_SHADER, "../src/shaders/deferred/fragment.glsl");
+    compositeShader.assemble();
+    gbuffer.init(viewport.x, viewport.y);
+    glGenVertexArrays(1, &emptyVao);
+    deferredShading = false;
+
+    depthShaders.load("../src/shaders/depth/vertex.glsl", "../src/shaders/depth/fragment.glsl", true);
+    depthPrepass = false;
+    idShaders.load("../src/shaders/depth/vertex.glsl", "../src/shaders/depth/id.glsl", true);
+
+    skinningShader.load(GL_COMPUTE_SHADER, "../src/shaders/skinning/compute.glsl");
+    skinningShader.assemble();
+    // The preskinned programs don't skin, so they have nothing to specialize
+    preskinnedShaders.load("../src/shaders/preskinned/vertex.glsl", "../src/shaders/default/fragment.glsl", false);
+    preskinnedGbufferShaders.load("../src/shaders/preskinned/vertex.glsl", "../src/shaders/deferred/gbuffer.glsl", false);
+    preskinnedDepthShaders.load("../src/shaders/preskinned/depth.glsl", "../src/shaders/depth/fragment.glsl", false);
+    preskinnedIdShaders.load("../src/shaders/preskinned/depth.glsl", "../src/shaders/depth/id.glsl", false);
+    computeSkinning = false;
+
+    crowdShader.load(GL_VERTEX_SHADER, "../src/shaders/crowd/vertex.glsl");
+    crowdShader.load(GL_FRAGMENT_SHADER, "../src/shaders/default/fragment.glsl");
+    crowdShader.assemble();
+    crowdGbufferShader.load(GL_VERTEX_SHADER, "../src/shaders/crowd/vertex.glsl");
+    crowdGbufferShader.load(GL_FRAGMENT_SHADER, "../src/shaders/deferred/gbuffer.glsl");
+    crowdGbufferShader.assemble();
+    animationShader.load(GL_COMPUTE_SHADER, "../src/shaders/animation/compute.glsl");
+    animationShader.assemble();
+    crowdSampledShader.define("SAMPLED_POSES", "1");
+    crowdSampledShader.load(GL_VERTEX_SHADER, "../src/shaders/crowd/vertex.glsl");
+    crowdSampledShader.load(GL_FRAGMENT_SHADER, "../src/shaders/default/fragment.glsl");
+    crowdSampledShader.assemble();
+    crowdSampledGbufferShader.define("SAMPLED_POSES", "1");
+    crowdSampledGbufferShader.load(GL_VERTEX_SHADER, "../src/shaders/crowd/vertex.glsl");
+    crowdSampledGbufferShader.load(GL_FRAGMENT_SHADER, "../src/shaders/deferred/gbuffer.glsl");
+    crowdSampledGbufferShader.assemble();
+    gpuCrowdSampling = false;
+    crowdSize = 0;
+    crowdBenchmark = false;
+
+    frameTimer.init();
+    prepassTimer.init();
+    mainPassTimer.init();
+    skinningTimer.init();
+    crowdTimer.init();
+    samplingTimer.init();
 
     initLights();
-    shader.createBuffer("mvp", 2, sizeof(MVPTransforms));
+    buffers.createBuffer("mvp", 2, sizeof(MVPTransforms));
+    buffers.createBuffer("clusters", 3,
+        sizeof(ClusterHeader) + numClusters * sizeof(glm::uvec2));
+    buffers.createBuffer("lightIndices", 4,
+        numClusters * averageLightsPerCluster * sizeof(unsigned int));
 
     pool.init(3);
     loadModel("player", "../assets/characters/Knight.fbx", "../assets/characters/");
     selectedModel = -1;
+    cpuPicking = false;
+    meshLods = true;
+    lodPixelError = 1.0;
+    poseCaching = true;
+    fixedStepAnimation = true;
+    webcamIk = true;
+    stopAnimation = false;
+    previousTick = latestTick = 0.0;
+    tickMilliseconds = 0.0;
 }
 
 void Engine::cleanup()
 {
+    stopAnimationThread();
     for (Model& model : models)
         model.cleanup();
     textureLoader.cleanup();
     webcamFrame.cleanup();
     idOverlay.cleanup();
-    shader.cleanup();
+    buffers.cleanup();
+    shaders.cleanup();
+    clusterShader.cleanup();
+    gbufferShaders.cleanup();
+    deferredLightingShader.cleanup();
+    compositeShader.cleanup();
+    gbuffer.cleanup();
+    glDeleteVertexArrays(1, &emptyVao);
+    depthShaders.cleanup();
+    idShaders.cleanup();
+    skinningShader.cleanup();
+    preskinnedShaders.cleanup();
+    preskinnedGbufferShaders.cleanup();
+    preskinnedDepthShaders.cleanup();
+    preskinnedIdShaders.cleanup();
+    crowd.cleanup();
+    crowdShader.cleanup();
+    crowdGbufferShader.cleanup();
+    crowdTimer.cleanup();
+    animationShader.cleanup();
+    crowdSampledShader.cleanup();
+    crowdSampledGbufferShader.cleanup();
+    samplingTimer.cleanup();
+    frameTimer.cleanup();
+    prepassTimer.cleanup();
+    mainPassTimer.cleanup();
+    skinningTimer.cleanup();
     skybox.cleanup();
     pool.terminate();
 }
@@ -82,6 +204,12 @@ void Engine::handleClick(int mouseX, int mouseY)
     int y = viewport.y - mouseY;
     if (x < 0 || y < 0) return; // Invalid coordinates
 
+    if (cpuPicking) {
+        glm::vec2 ndc = glm::vec2(x / viewport.x, y / viewport.y) * 2.0f - 1.0f;
+        selectedModel = picker.pick(models, camera.getRay(ndc), true);
+        return;
+    }
+
     float pixel[4] = {100, 100, 100, 100};
     idOverlay.readPixel(x, y, pixel);
     if (pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0) {
@@ -107,12 +235,15 @@ void Engine::handleWebcamFrame(void* framePixels)
     webcamFrame.write(0, 0, copy);
 
     pool.dispatch([copy, this](){
-        keypoints = movenet.runInference(copy, frameSize);
-        for (Keypoint kp : keypoints) {
+        std::vector<Keypoint> detected = movenet.runInference(copy, frameSize);
+        for (Keypoint kp : detected) {
             if (kp.detected())
                 std::cout << "KEYPOINT: " << kp.x << " " << kp.y << "\n";
         }
         free(copy);
+
+        std::lock_guard<std::mutex> lock(keypointsMutex);
+        keypoints = detected;
     });
 }
 
@@ -120,35 +251,113 @@ void Engine::loadModel(std::string name, std::string path, std::string base)
 {
     pool.dispatch([&, name, path, base] {
         try {
-            Model model(&textureLoader, name, path, base);
-            models.push_back(model);
+            Model model(&textureLoader, &animationLibrary, name, path, base);
+            std::lock_guard<std::mutex> lock(loadedMutex);
+            loadedModels.push_back(model);
         } catch (std::string msg) {
             log(ERROR, msg);
         }
     });
 }
 
+// Pushing back can move the models, so the render thread does it
+// between frames, when the animation thread isn't ticking
+void Engine::addLoadedModels()
+{
+    std::lock_guard<std::mutex> lock(loadedMutex);
+    if (loadedModels.empty())
+        return;
+    std::lock_guard<std::mutex> animation(animationMutex);
+    models.insert(models.end(), loadedModels.begin(), loadedModels.end());
+    loadedModels.clear();
+}
+
+void Engine::loadAnimations(std::string path)
+{
+    // The models pick the new clips up on their next update
+    pool.dispatch([&, path] {
+        try {
+            animationLibrary.import(path, &pool);
+        } catch (std::string msg) {
+            log(WARN, path + ": " + msg);
+        }
+    });
+}
+
+void Engine::aliasBone(std::string source, std::string target)
+{
+    animationLibrary.addBoneAlias(source, target);
+}
+
 void Engine::initLights()
 {
-    glm::vec3 positions[] = {
-        glm::vec3( 0.0, 1.0, -3.0),
-        glm::vec3( 0.0, 1.0,  3.0),
-        glm::vec3(-3.0, 1.0,  0.0),
-    };
+    std::vector<Light> lights;
 
-    Light lights[3];
-    for (int i = 0; i < 3; i++) {
-        lights[i] = {
-            .color = glm::vec3(0.8),
-            .position = positions[i],
-            .c = 1.0,
-            .l = 0.08,
-            .q = 0.032
+    if (stageLights == 0) {
+        glm::vec3 positions[] = {
+            glm::vec3( 0.0, 1.0, -3.0),
+            glm::vec3( 0.0, 1.0,  3.0),
+            glm::vec3(-3.0, 1.0,  0.0),
         };
+
+        for (int i = 0; i < 3; i++) {
+            lights.push_back({
+                .color = glm::vec3(0.8),
+                .position = positions[i],
+                .c = 1.0,
+                .l = 0.08,
+                .q = 0.032,
+                .radius = 0
+            });
+        }
+    } else {
+        // Dance floor: a grid of small colored lights just above the floor
+        int side = ceil(sqrt(stageLights));
+        float spacing = 40.0 / side;
+        for (int i = 0; i < stageLights; i++) {
+            float hue = float(i) / stageLights * 6.2831;
+            glm::vec3 color = 0.5f + 0.5f * glm::vec3(
+                cos(hue), cos(hue + 2.0944), cos(hue + 4.1888));
+            glm::vec3 position = glm::vec3(
+                (i % side) * spacing - 20.0, -4.5, (i / side) * spacing - 20.0);
+
+            lights.push_back({
+                .color = color,
+                .position = position,
+                .c = 1.0,
+                .l = 0.7,
+                .q = 1.8,
+                .radius = 0
+            });
+        }
+    }
+
+    for (Light& light : lights) {
+        light.radius = lightRadius(light);
     }
 
-    shader.createBuffer("lights", 0, sizeof(lights));
-    shader.writeBuffer("lights", &lights, 0, sizeof(lights));
+    int size = lights.size() * sizeof(Light);
+    if (buffers.haveBuffer("lights"))
+        buffers.deleteBuffer("lights");
+    buffers.createBuffer("lights", 0, size);
+    buffers.writeBuffer("lights", lights.data(), 0, size);
+}
+
+void Engine::binLights()
+{
+    ClusterHeader header = {
+        .inverseProjection = glm::inverse(camera.getProjection()),
+        .viewportRect = glm::vec4(sidePanelWidth, 0, viewport.x, viewport.y),
+        .zNear = float(Camera::zNear),
+        .zFar = float(Camera::zFar),
+        .indexCount = 0,
+        .padding = 0
+    };
+    buffers.writeBuffer("clusters", &header, 0, sizeof(ClusterHeader));
+
+    clusterShader.use();
+    glDispatchCompute(clusterGrid.x, clusterGrid.y, clusterGrid.z);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void Engine::drawGUI()
@@ -163,10 +372,54 @@ void Engine::drawModelInfo()
 {
     ImGui::Begin("Model info", nullptr, ImGuiWindowFlags_NoDecoration);
     ImGui::Text("%s", (std::to_string(fps) + " FPS").c_str());
+    ImGui::Text("GPU frame time: %.2f ms", frameTimer.elapsed());
+    ImGui::Text("Depth pre-pass: %.2f ms", depthPrepass ? prepassTimer.elapsed() : 0.0);
+    ImGui::Text("Shading pass: %.2f ms", mainPassTimer.elapsed());
+    ImGui::Text("Compute skinning: %.2f ms", computeSkinning ? skinningTimer.elapsed() : 0.0);
+    ImGui::Text("Crowd: %.2f ms", crowd.size() > 0 ? crowdTimer.elapsed() : 0.0);
+    ImGui::Text("Crowd sampling: %.2f ms",
+                crowd.size() > 0 && gpuCrowdSampling ? samplingTimer.elapsed() : 0.0);
+    int triangles = 0;
+    for (Model& model : models)
+        triangles += model.triangleCount();
+    ImGui::Text("Triangles: %d", triangles);
+    ImGui::Text("Pose cache hits: %.0f%% of %d",
+                poseCaching ? poseCache.hitRate() * 100.0 : 0.0, poseCache.lookups());
+    ImGui::Text("Animation tick: %.2f ms",
+                fixedStepAnimation ? tickMilliseconds.load() : 0.0);
+    {
+        std::lock_guard<std::mutex> lock(publishMutex);
+        ImGui::Text("Webcam IK: %.3f ms, %d limbs%s", webcamIk ? ikStats.milliseconds : 0.0,
+                    webcamIk ? ikStats.limbs : 0, ikStats.outOfTime ? ", out of time" : "");
+    }
     ImGui::SetWindowSize(ImVec2(sidePanelWidth, (viewport.y / 3) * 2));
     ImGui::SetWindowPos(ImVec2(0, 0));
+    ImGui::Checkbox("CPU picking", &cpuPicking);
+    ImGui::Checkbox("Deferred shading", &deferredShading);
+    ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+    ImGui::Checkbox("Compute skinning", &computeSkinning);
+    bool caching = poseCaching, ik = webcamIk;
+    if (ImGui::Checkbox("Pose cache", &caching))
+        poseCaching = caching;
+    ImGui::Checkbox("Fixed-step animation", &fixedStepAnimation);
+    if (ImGui::Checkbox("Webcam IK", &ik))
+        webcamIk = ik;
+    ImGui::Checkbox("Mesh LODs", &meshLods);
+    ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.25, 8.0);
+    ImGui::Checkbox("Clustered lighting", &clusteredLighting);
+    if (ImGui::SliderInt("Stage lights", &stageLights, 0, 1024))
+        initLights();
+    if (!crowdBenchmark) {
+        ImGui::SliderInt("Crowd", &crowdSize, 0, 16384);
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark"))
+            benchmarkCrowd();
+        ImGui::Checkbox("Sample crowd on GPU", &gpuCrowdSampling);
+    }
 
     if (selectedModel != -1) {
+        // The animation thread changes the animators while it ticks
+        std::lock_guard<std::mutex> lock(animationMutex);
         assert(selectedModel < int(models.size()));
         Model& model = models[selectedModel];
         auto animations = model.animationNames();
@@ -178,6 +431,21 @@ void Engine::drawModelInfo()
             ImGui::SameLine();
             if (ImGui::Button(model.animationPlaying() ? "Pause" : "Play"))
                 model.toggleAnimation();
+            ImGui::SameLine();
+            if (ImGui::Button("Export pose")) {
+                try {
+                    model.exportObj(model.getName() + ".obj");
+                } catch (std::string msg) {
+                    log(WARN, msg);
+                }
+            }
+            // Skin on the CPU too and compare with the compute pass
+            if (computeSkinning) {
+                ImGui::SameLine();
+                if (ImGui::Button("Check skinning"))
+                    log(DEBUG, model.getName() + ": CPU and GPU skinning differ by " +
+                               std::to_string(model.compareSkinning()));
+            }
 
             if (ImGui::BeginChild("##list", ImVec2(sidePanelWidth - 10, 0))) {
                 for (size_t i = 0; i < animations.size(); i++) {
@@ -209,23 +477,29 @@ void Engine::drawWebcamVisualization()
 
     ImGui::Image((ImTextureID)*webcamFrame.id, size);
 
+    std::vector<Keypoint> points;
+    {
+        std::lock_guard<std::mutex> lock(keypointsMutex);
+        points = keypoints;
+    }
+
     // Draw the skeleton constructed from the keypoints on top of the image
-    for (Keypoint kp : keypoints) {
+    for (Keypoint kp : points) {
         if (!kp.detected()) continue;
         glm::vec2 p = movenet.getPosition(kp.x, kp.y, size.x, size.y);
         drawList->AddCircleFilled({base.x + p.x, base.y + p.y}, 3, color);
     }
 
     for (auto [i, j] : keypointConnections) {
-        if (i >= int(keypoints.size()) || j >= int(keypoints.size()))
+        if (i >= int(points.size()) || j >= int(points.size()))
             continue; // Out of range
-        if (!keypoints[i].detected() || !keypoints[j].detected())
+        if (!points[i].detected() || !points[j].detected())
             continue; // Incomplete connection
 
         glm::vec2 p1 = movenet.getPosition(
-            keypoints[i].x, keypoints[i].y, size.x, size.y);
+            points[i].x, points[i].y, size.x, size.y);
         glm::vec2 p2 = movenet.getPosition(
-            keypoints[j].x, keypoints[j].y, size.x, size.y);
+            points[j].x, points[j].y, size.x, size.y);
         drawList->AddLine(
             {base.x + p1.x, base.y + p1.y},
             {base.x + p2.x, base.y + p2.y},
@@ -236,7 +510,251 @@ void Engine::drawWebcamVisualization()
     ImGui::End();
 }
 
-void Engine::drawModels(bool isFramebuffer, double timeInSeconds)
+void Engine::updateModels(double timeInSeconds)
+{
+    for (Model& model : models) {
+        if (model.isCalled("player")) {
+            model.setSize(glm::vec3(0.0, 5.0, 0.0), true);
+            model.setPosition(glm::vec3(0.0, -5.0, 0.0));
+        }
+    }
+
+    if (fixedStepAnimation) {
+        if (!animationThread.joinable())
+            startAnimationThread(timeInSeconds);
+
+        // One tick behind, so that the time usually falls between the two
+        float factor = 1.0;
+        {
+            std::lock_guard<std::mutex> lock(publishMutex);
+            double shown = timeInSeconds - 1.0 / animationTicksPerSecond;
+            if (latestTick > previousTick)
+                factor = std::clamp((shown - previousTick) / (latestTick - previousTick), 0.0, 1.0);
+            for (Model& model : models)
+                model.latchPoses();
+        }
+        parallelFor(models.size(), [&](size_t i) {
+            models[i].interpolatePose(factor);
+        });
+    } else {
+        if (animationThread.joinable())
+            stopAnimationThread();
+
+        // The poses, and their palettes, are computed in parallel
+        poseCache.beginFrame();
+        parallelFor(models.size(), [&](size_t i) {
+            models[i].animate(timeInSeconds, poseCaching ? &poseCache : nullptr);
+        });
+        ikStats = retargetKeypoints();
+    }
+
+    for (Model& model : models) {
+        model.upload();
+        float screenSize = meshLods
+            ? camera.getScreenSize(model.getWorldBounds())
+            : std::numeric_limits<float>::max();
+        model.selectLod(screenSize, lodPixelError);
+    }
+}
+
+void Engine::startAnimationThread(double timeInSeconds)
+{
+    stopAnimation = false;
+    previousTick = latestTick = 0.0;
+    animationThread = std::thread(&Engine::animationLoop, this, timeInSeconds);
+}
+
+void Engine::stopAnimationThread()
+{
+    if (!animationThread.joinable())
+        return;
+    stopAnimation = true;
+    animationThread.join();
+    for (Model& model : models)
+        model.stopInterpolating();
+}
+
+// Tick at a fixed rate from the time the thread started. The ticks keep
+// to their schedule, so after a stall the late ones are skipped rather
+// than run back to back, and since a pose only depends on its time,
+// playback stays in sync with the frames
+void Engine::animationLoop(double startTime)
+{
+    using Clock = std::chrono::steady_clock;
+    const std::chrono::duration<double> step(1.0 / animationTicksPerSecond);
+    Clock::time_point start = Clock::now();
+
+    long long tick = 0;
+    while (!stopAnimation) {
+        std::this_thread::sleep_until(
+            start + std::chrono::duration_cast<Clock::duration>(step * double(tick)));
+        tick = std::max(tick, (long long)((Clock::now() - start) / step));
+
+        Clock::time_point begin = Clock::now();
+        tickAnimations(startTime + tick * step.count());
+        tickMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - begin).count();
+        tick++;
+    }
+}
+
+void Engine::tickAnimations(double timeInSeconds)
+{
+    std::lock_guard<std::mutex> lock(animationMutex);
+    poseCache.beginFrame();
+    parallelFor(models.size(), [&](size_t i) {
+        models[i].animate(timeInSeconds, poseCaching ? &poseCache : nullptr);
+    });
+    IkStats stats = retargetKeypoints();
+
+    std::lock_guard<std::mutex> publish(publishMutex);
+    ikStats = stats;
+    for (Model& model : models)
+        model.publishPose();
+    previousTick = latestTick;
+    latestTick = timeInSeconds;
+}
+
+// Solve the first model's limbs for the latest keypoints, after it's been
+// animated. The rotations apply from its next update, a tick or frame later
+IkStats Engine::retargetKeypoints()
+{
+    if (models.empty())
+        return IkStats();
+    Model& model = models[0];
+    if (!webcamIk) {
+        if (ikSolver.bound()) {
+            model.clearPoseOverrides();
+            ikSolver.unbind();
+        }
+        return IkStats();
+    }
+
+    if (!ikSolver.bound() && model.bindLimbs(ikSolver) == 0)
+        log(WARN, model.getName() + ": no arms or legs to pose from the webcam");
+
+    std::vector<Keypoint> latest;
+    {
+        std::lock_guard<std::mutex> lock(keypointsMutex);
+        latest = keypoints;
+    }
+    return model.poseFromKeypoints(ikSolver, latest, frameSize, ikBudgetMilliseconds);
+}
+
+// Lay down the depth of the closest surfaces with a cheap vertex
+// program and no color writes, so that the following pass only
+// shades the visible fragments, using GL_EQUAL depth testing
+void Engine::drawDepthPrepass()
+{
+    prepassTimer.begin();
+    ShaderVariants& program = computeSkinning ? preskinnedDepthShaders : depthShaders;
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    for (Model& model : models)
+        model.drawDepth(program);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    prepassTimer.end();
+
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+// Skin every model once, the passes that follow read the skinned vertices
+void Engine::skinModels()
+{
+    skinningTimer.begin();
+    skinningShader.use();
+    for (Model& model : models)
+        model.skin(skinningShader);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    skinningTimer.end();
+}
+
+void Engine::benchmarkCrowd()
+{
+    crowdBenchmark = true;
+    crowdSize = 64;
+    benchmarkFrames = 0;
+    benchmarkBest = 0;
+}
+
+// Double the crowd once the timers have measured the current size
+void Engine::stepCrowdBenchmark()
+{
+    if (crowd.initialized() && crowd.clipCount() == 0) {
+        log(WARN, "The crowd benchmark needs a model with clips to bake");
+        crowdBenchmark = false;
+        return;
+    }
+    if (crowd.size() != crowdSize || ++benchmarkFrames < 120)
+        return;
+    benchmarkFrames = 0;
+
+    const double budget = 1000.0 / 60.0;
+    double frame = frameTimer.elapsed();
+    log(DEBUG, "Crowd of " + std::to_string(crowdSize) + ": " +
+               std::to_string(frame) + " ms per frame, " +
+               std::to_string(crowdTimer.elapsed()) + " ms drawing the crowd");
+    if (frame <= budget)
+        benchmarkBest = crowdSize;
+    if (frame > budget || crowdSize >= maxCrowdSize) {
+        log(DEBUG, "Crowd benchmark: " + std::to_string(benchmarkBest) +
+                   " characters fit in " + std::to_string(budget) + " ms");
+        crowdBenchmark = false;
+        return;
+    }
+    crowdSize *= 2;
+}
+
+// Bake the first model's clips when a crowd's first needed, then keep the
+// crowd as large as asked. Runs before the models are animated since
+// baking replaces the model's pose
+void Engine::updateCrowd(double timeInSeconds)
+{
+    if (crowdBenchmark)
+        stepCrowdBenchmark();
+    if (models.empty() || (crowdSize == 0 && !crowd.initialized()))
+        return;
+
+    Model& model = models[0];
+    if (!crowd.initialized()) {
+        try {
+            // Baking poses the model, which the animation thread mustn't do at the same time
+            std::lock_guard<std::mutex> lock(animationMutex);
+            crowd.init(model, crowdFramesPerSecond);
+        } catch (std::string msg) {
+            log(WARN, msg);
+            crowdSize = 0;
+            return;
+        }
+    }
+    if (gpuCrowdSampling && !crowd.canSample()) {
+        log(WARN, "The crowd's animations can't be sampled on the GPU, using the baked poses");
+        gpuCrowdSampling = false;
+    }
+    if (crowd.size() != crowdSize)
+        crowd.populate(model, crowdSize);
+    crowd.animate(timeInSeconds);
+}
+
+// Pose the crowd with the animation pass first when it's sampled on the GPU.
+// program is the baked or sampled program matching gpuCrowdSampling
+void Engine::drawCrowd(Shader& program)
+{
+    if (crowd.size() == 0) return;
+
+    if (gpuCrowdSampling) {
+        samplingTimer.begin();
+        crowd.sample(animationShader);
+        samplingTimer.end();
+    }
+
+    crowdTimer.begin();
+    program.use();
+    program.set<int>("clustered", clusteredLighting);
+    crowd.draw(program, models[0]);
+    crowdTimer.end();
+}
+
+void Engine::drawModels(bool isFramebuffer)
 {
     if (isFramebuffer)
         idOverlay.bind();
@@ -248,25 +766,105 @@ void Engine::drawModels(bool isFramebuffer, double timeInSeconds)
     glEnable(GL_DEPTH_TEST);
     glViewport(isFramebuffer ? 0 :  sidePanelWidth, 0, viewport.x, viewport.y);
 
-    shader.use();
-    shader.set<int>("isFramebuffer", isFramebuffer);
-    MVPTransforms transforms = camera.getMVPTransforms();
-    shader.writeBuffer("mvp", &transforms, 0, sizeof(MVPTransforms));
-
-    for (unsigned int i = 0; i < models.size(); i++) {
-        Model& model = models[i];
-        if (model.isCalled("player")) {
-            model.setSize(glm::vec3(0.0, 5.0, 0.0), true);
-            model.setPosition(glm::vec3(0.0, -5.0, 0.0));
+    // The id overlay only needs the positions
+    if (isFramebuffer) {
+        ShaderVariants& ids = computeSkinning ? preskinnedIdShaders : idShaders;
+        for (unsigned int i = 0; i < models.size(); i++) {
+            ids.set<float>("modelId", i + 1);
+            models[i].drawDepth(ids);
         }
-        shader.set<float>("modelId", i + 1);
-        model.draw(shader, timeInSeconds);
+        return;
     }
+
+    if (depthPrepass)
+        drawDepthPrepass();
+
+    mainPassTimer.begin();
+    ShaderVariants& program = computeSkinning ? preskinnedShaders : shaders;
+    program.set<int>("clustered", clusteredLighting);
+    for (Model& model : models)
+        model.draw(program);
+    mainPassTimer.end();
+
+    if (depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    // The crowd isn't in the depth pre-pass, so it's drawn after it's done
+    drawCrowd(gpuCrowdSampling ? crowdSampledShader : crowdShader);
+}
+
+void Engine::drawDeferred()
+{
+    gbuffer.resize(viewport.x, viewport.y);
+
+    // Geometry pass. Blending's off since the alpha
+    // channels of the G-buffer hold packed values
+    gbuffer.bind();
+    glDisable(GL_BLEND);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, viewport.x, viewport.y);
+    if (depthPrepass)
+        drawDepthPrepass();
+
+    mainPassTimer.begin();
+    ShaderVariants& program = computeSkinning ? preskinnedGbufferShaders : gbufferShaders;
+    for (Model& model : models)
+        model.draw(program);
+    mainPassTimer.end();
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    drawCrowd(gpuCrowdSampling ? crowdSampledGbufferShader : crowdGbufferShader);
+    glEnable(GL_BLEND);
+    gbuffer.unbind();
+
+    // Lighting pass over 16x16 screen tiles
+    deferredLightingShader.use();
+    deferredLightingShader.set<glm::mat4>(
+        "inverseProjection", glm::inverse(camera.getProjection()));
+    deferredLightingShader.set<glm::mat4>(
+        "inverseView", glm::inverse(camera.getMVPTransforms().view));
+    gbuffer.bindForLighting();
+    glDispatchCompute((int(viewport.x) + 15) / 16, (int(viewport.y) + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Composite into the window. The skybox fills in the empty pixels afterwards
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glViewport(sidePanelWidth, 0, viewport.x, viewport.y);
+
+    compositeShader.use();
+    gbuffer.bindForComposite();
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
 }
 
 void Engine::draw(float timeInSeconds)
 {
-    drawModels(true, timeInSeconds);
-    drawModels(false, timeInSeconds);
+    frameTimer.begin();
+
+    MVPTransforms transforms = camera.getMVPTransforms();
+    buffers.writeBuffer("mvp", &transforms, 0, sizeof(MVPTransforms));
+    addLoadedModels();
+    updateCrowd(timeInSeconds);
+    updateModels(timeInSeconds);
+    if (computeSkinning)
+        skinModels();
+
+    drawModels(true);
+    if (deferredShading) {
+        drawDeferred();
+    } else {
+        if (clusteredLighting)
+            binLights();
+        drawModels(false);
+    }
     skybox.draw(camera.getProjection(), camera.getViewWithoutTranslation());
+
+    frameTimer.end();
 }
@@ -1,11 +1,22 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
 #include "camera.h"
+#include "crowd.h"
 #include "framebuffer.h"
+#include "gbuffer.h"
+#include "ik.h"
 #include "model.h"
 #include "movenet.h"
+#include "picker.h"
 #include "pool.h"
+#include "posecache.h"
 #include "skybox.h"
+#include "timer.h"
 
 class Engine
 {
@@ -26,10 +37,34 @@ public:
 
     void handleClick(int mouseX, int mouseY);
     void handleWebcamFrame(void* framePixels);
+
+    // Add the clips of an animation file to the library the models share
+    void loadAnimations(std::string path);
+    // Play a source bone's keys on a target bone of the models
+    // that play the clips of another rig, see retarget.h
+    void aliasBone(std::string source, std::string target);
+
+    // Grow the crowd until a frame takes longer than 1/60th of a
+    // second on the GPU, then log the largest crowd that fit
+    void benchmarkCrowd();
 private:
     void loadModel(std::string name, std::string path, std::string base);
-    void drawModels(bool isidOverlay, double timeInSeconds);
+    void addLoadedModels();
+    void updateModels(double timeInSeconds);
+    void startAnimationThread(double timeInSeconds);
+    void stopAnimationThread();
+    void animationLoop(double startTime);
+    void tickAnimations(double timeInSeconds);
+    IkStats retargetKeypoints();
+    void drawModels(bool isidOverlay);
+    void drawDeferred();
+    void drawDepthPrepass();
+    void skinModels();
+    void updateCrowd(double timeInSeconds);
+    void drawCrowd(Shader& program);
+    void stepCrowdBenchmark();
     void initLights();
+    void binLights();
 
     void drawModelInfo();
     void drawWebcamVisualization();
@@ -41,17 +76,102 @@ private:
 
     Camera camera;
     Skybox skybox;
-    Shader shader;
+    Shader buffers; // Owns the storage buffers that every program reads
+    // Vertex skinning, specialized per influence bucket, see ShaderVariants
+    ShaderVariants shaders;
+
+    // Clustered forward lighting. A compute pass bins the lights into
+    // froxels so that fragments only shade with the lights near them
+    Shader clusterShader;
+    bool clusteredLighting;
+    int stageLights; // Number of lights on the stage, 0 for the default lights
+
+    // Deferred shading, as an alternative to the forward path
+    bool deferredShading;
+    GBuffer gbuffer;
+    ShaderVariants gbufferShaders;
+    Shader deferredLightingShader;
+    Shader compositeShader;
+    unsigned int emptyVao; // For drawing the full screen triangle
+
+    // Optional depth only pass before shading
+    bool depthPrepass;
+    ShaderVariants depthShaders;
+    ShaderVariants idShaders; // Writes the model ids for picking
+
+    // Compute skinning. Every vertex is skinned once per frame instead
+    // of in every pass, which then use the preskinned vertex programs
+    bool computeSkinning;
+    Shader skinningShader;
+    ShaderVariants preskinnedShaders;
+    ShaderVariants preskinnedGbufferShaders;
+    ShaderVariants preskinnedDepthShaders;
+    ShaderVariants preskinnedIdShaders;
+
+    // Instanced copies of the first model, posed from its baked animations
+    // or from the keyframes by the animation pass
+    Crowd crowd;
+    Shader crowdShader;
+    Shader crowdGbufferShader;
+    int crowdSize;
+    GpuTimer crowdTimer;
+    bool gpuCrowdSampling;
+    Shader animationShader;
+    Shader crowdSampledShader;
+    Shader crowdSampledGbufferShader;
+    GpuTimer samplingTimer;
+    bool crowdBenchmark;
+    int benchmarkFrames;
+    int benchmarkBest; // Largest crowd that fit in the frame budget so far
+
+    GpuTimer frameTimer;
+    GpuTimer prepassTimer;
+    GpuTimer mainPassTimer; // Forward shading or the G-buffer geometry pass
+    GpuTimer skinningTimer;
 
     Texture webcamFrame;
     glm::vec2 frameSize;
 
     MoveNet movenet;
     std::vector<Keypoint> keypoints;
+    std::mutex keypointsMutex; // The keypoints are written by the pool
+
+    // Pose the first model's limbs after the keypoints
+    std::atomic<bool> webcamIk; // Read by the animation thread
+    KeypointSolver ikSolver;
+    IkStats ikStats; // Guarded by publishMutex
 
     TextureLoader textureLoader;
+    AnimationLibrary animationLibrary;
     Framebuffer idOverlay; // Model id overlay
 
+    // Select models by ray casting on the CPU instead of reading the id overlay
+    bool cpuPicking;
+    Picker picker;
+
+    // Draw coarser meshes for the models that are small on the screen
+    bool meshLods;
+    float lodPixelError;
+
+    // Share the poses of the models playing the same clip at the same time
+    std::atomic<bool> poseCaching; // Read by the animation thread
+    PoseCache poseCache;
+
+    // Animate the models at a fixed rate on their own thread, so that the
+    // cost doesn't grow with the frame rate, and draw them one tick behind,
+    // between the last two poses
+    bool fixedStepAnimation;
+    std::thread animationThread;
+    std::atomic<bool> stopAnimation;
+    std::mutex animationMutex; // Held by a tick, or to change the animators
+    std::mutex publishMutex; // Guards the published poses and their times
+    double previousTick, latestTick;
+    std::atomic<float> tickMilliseconds; // CPU time of the last tick
+
+    // Only the render thread resizes it, while holding animationMutex
     std::vector<Model> models;
+    // Loaded on the pool, added to the models at the start of a frame
+    std::vector<Model> loadedModels;
+    std::mutex loadedMutex;
     ThreadPool pool;
 };
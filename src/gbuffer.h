@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad.h>
+
+// Geometry buffer for deferred shading. Holds what the lighting pass
+// needs to know about the closest surface at each pixel, packed
+// as described in shaders/deferred/packing.glsl
+class GBuffer
+{
+public:
+    void init(int w, int h)
+    {
+        width = w;
+        height = h;
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        normals = createTexture(GL_RG16F);
+        albedo = createTexture(GL_RGBA8);
+        emission = createTexture(GL_RGBA8);
+        depth = createTexture(GL_DEPTH_COMPONENT32F);
+        lit = createTexture(GL_RGBA16F);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normals, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, emission, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+        unsigned int attachments[3] = {
+            GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2
+        };
+        glDrawBuffers(3, attachments);
+
+        // Check if we've setup everything correctly
+        int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+            throw "Incomplete G-buffer!";
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void cleanup()
+    {
+        if (fbo == UINT_MAX) return;
+        glDeleteFramebuffers(1, &fbo);
+        unsigned int textures[5] = { normals, albedo, emission, depth, lit };
+        glDeleteTextures(5, textures);
+        fbo = UINT_MAX;
+    }
+
+    // Recreate the textures when the viewport size changes
+    void resize(int w, int h)
+    {
+        if (fbo != UINT_MAX && w == width && h == height)
+            return;
+        cleanup();
+        init(w, h);
+    }
+
+    // Bind the G-buffer for the lighting pass, which writes into the lit image
+    void bindForLighting()
+    {
+        unsigned int textures[4] = { normals, albedo, emission, depth };
+        for (int i = 0; i < 4; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glBindImageTexture(0, lit, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    }
+
+    // Bind the lit image and the depth for compositing
+    void bindForComposite()
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, lit);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, depth);
+    }
+
+    void unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+    void bind()
+    {
+        if (fbo == UINT_MAX)
+            throw "Uninitialized G-buffer";
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+private:
+    unsigned int createTexture(int internalFormat)
+    {
+        unsigned int tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tex;
+    }
+
+    int width = 0, height = 0;
+    unsigned int fbo = UINT_MAX; // frame buffer object
+    unsigned int normals, albedo, emission, depth;
+    unsigned int lit; // Output of the lighting pass
+};
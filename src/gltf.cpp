@@ -0,0 +1,754 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "json.h"
+#include "log.h"
+#include "mapped.h"
+#include "model.h"
+#include "packing.h"
+#include "pool.h"
+
+// Component types, as OpenGL enums
+const int GLTF_BYTE = 5120;
+const int GLTF_UNSIGNED_BYTE = 5121;
+const int GLTF_SHORT = 5122;
+const int GLTF_UNSIGNED_SHORT = 5123;
+const int GLTF_UNSIGNED_INT = 5125;
+const int GLTF_FLOAT = 5126;
+
+const int GLTF_TRIANGLES = 4;
+
+int componentSize(int componentType)
+{
+    switch (componentType) {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+    }
+    throw std::string("Invalid accessor component type");
+}
+
+int componentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    throw std::string("Unsupported accessor type " + type);
+}
+
+// The elements of an accessor, read in place from the mapped buffer
+struct Accessor
+{
+    const unsigned char* data = nullptr;
+    size_t count = 0, stride = 0;
+    int componentType = 0, components = 0;
+    bool normalized = false;
+
+    // Component c of element i, normalized integers map to [0, 1] or [-1, 1]
+    float get(size_t i, int c) const
+    {
+        const unsigned char* p = data + i * stride;
+        switch (componentType) {
+            case GLTF_FLOAT: {
+                float f;
+                memcpy(&f, p + c * 4, 4);
+                return f;
+            }
+            case GLTF_UNSIGNED_BYTE:
+                return normalized ? p[c] / 255.0f : p[c];
+            case GLTF_BYTE:
+                return normalized ? std::max((int8_t)p[c] / 127.0f, -1.0f) : (int8_t)p[c];
+            case GLTF_UNSIGNED_SHORT: {
+                uint16_t u;
+                memcpy(&u, p + c * 2, 2);
+                return normalized ? u / 65535.0f : u;
+            }
+            case GLTF_SHORT: {
+                int16_t s;
+                memcpy(&s, p + c * 2, 2);
+                return normalized ? std::max(s / 32767.0f, -1.0f) : s;
+            }
+        }
+        return integer(i, c);
+    }
+
+    unsigned int integer(size_t i, int c) const
+    {
+        const unsigned char* p = data + i * stride;
+        switch (componentType) {
+            case GLTF_UNSIGNED_BYTE: return p[c];
+            case GLTF_UNSIGNED_SHORT: {
+                uint16_t u;
+                memcpy(&u, p + c * 2, 2);
+                return u;
+            }
+            case GLTF_UNSIGNED_INT: {
+                uint32_t u;
+                memcpy(&u, p + c * 4, 4);
+                return u;
+            }
+        }
+        throw std::string("Accessor doesn't hold unsigned integers");
+    }
+
+    glm::vec3 vec3(size_t i) const { return glm::vec3(get(i, 0), get(i, 1), get(i, 2)); }
+};
+
+// The JSON document and the binary buffers it points to
+class GltfFile
+{
+public:
+    GltfFile(
+        std::string path, const MappedFile& source,
+        std::vector<std::shared_ptr<MappedFile>>& mappings
+    ) {
+        const unsigned char* data = source.data();
+        size_t size = source.size();
+
+        // A binary glTF has a header, a JSON chunk and an optional binary chunk
+        const unsigned char* bin = nullptr;
+        size_t binSize = 0;
+        const char* text = (const char*)data;
+        size_t textSize = size;
+        if (size >= 12 && memcmp(data, "glTF", 4) == 0) {
+            uint32_t header[3];
+            memcpy(header, data, sizeof(header));
+            if (header[1] != 2)
+                throw std::string("Only version 2 of binary glTF is supported");
+
+            size_t offset = 12;
+            textSize = 0;
+            while (offset + 8 <= size) {
+                uint32_t chunk[2]; // Length and type
+                memcpy(chunk, data + offset, sizeof(chunk));
+                offset += 8;
+                if (offset + chunk[0] > size)
+                    throw std::string("Truncated binary glTF chunk");
+                if (chunk[1] == 0x4e4f534a) { // JSON
+                    text = (const char*)data + offset;
+                    textSize = chunk[0];
+                } else if (chunk[1] == 0x004e4942) { // BIN
+                    bin = data + offset;
+                    binSize = chunk[0];
+                }
+                offset += chunk[0];
+            }
+        }
+        json = Json::parse(text, text + textSize);
+
+        if (json["asset"]["version"].string().substr(0, 1) != "2")
+            throw std::string("Only glTF 2.0 is supported");
+        if (json["extensionsRequired"].size() > 0)
+            throw std::string("Required extension " +
+                              json["extensionsRequired"][0].string() + " isn't supported");
+
+        // External buffers are mapped too and kept alive by the caller
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        const Json& bufferList = json["buffers"];
+        for (size_t i = 0; i < bufferList.size(); i++) {
+            const Json& buffer = bufferList[i];
+            size_t length = buffer["byteLength"].number();
+            if (!buffer.has("uri")) {
+                if (bin == nullptr || length > binSize)
+                    throw std::string("Missing binary chunk");
+                buffers.push_back({ bin, length });
+                continue;
+            }
+
+            std::string uri = buffer["uri"].string();
+            if (uri.rfind("data:", 0) == 0)
+                throw std::string("Buffers in data URIs aren't supported");
+            auto file = std::make_shared<MappedFile>(directory + uri);
+            if (length > file->size())
+                throw std::string("Buffer " + uri + " is too short");
+            mappings.push_back(file);
+            buffers.push_back({ file->data(), length });
+        }
+    }
+
+    const unsigned char* bufferView(int index, size_t& length) const
+    {
+        const Json& view = json["bufferViews"][index];
+        size_t buffer = view["buffer"].integer(-1);
+        size_t offset = view["byteOffset"].number();
+        length = view["byteLength"].number();
+        if (buffer >= buffers.size() || offset + length > buffers[buffer].second)
+            throw std::string("Invalid buffer view");
+        return buffers[buffer].first + offset;
+    }
+
+    Accessor accessor(int index) const
+    {
+        const Json& a = json["accessors"][index];
+        if (a.type == Json::Null)
+            throw std::string("Invalid accessor");
+        if (a.has("sparse") || !a.has("bufferView"))
+            throw std::string("Sparse accessors aren't supported");
+
+        Accessor result;
+        result.count = a["count"].number();
+        result.componentType = a["componentType"].integer();
+        result.components = componentCount(a["type"].string());
+        result.normalized = a["normalized"].boolean();
+
+        int viewIndex = a["bufferView"].integer();
+        size_t viewLength;
+        const unsigned char* view = bufferView(viewIndex, viewLength);
+        size_t offset = a["byteOffset"].number();
+        size_t elementSize = componentSize(result.componentType) * result.components;
+        result.stride = json["bufferViews"][viewIndex]["byteStride"].number(elementSize);
+        if (result.count > 0 &&
+            offset + (result.count - 1) * result.stride + elementSize > viewLength)
+            throw std::string("Accessor overflows its buffer view");
+        result.data = view + offset;
+        return result;
+    }
+
+    Json json;
+private:
+    std::vector<std::pair<const unsigned char*, size_t>> buffers;
+};
+
+// Rest pose of a node, split so the animations can replace single parts
+struct RestPose
+{
+    glm::vec3 translation = glm::vec3(0.0);
+    glm::quat rotation = glm::quat(1.0, 0.0, 0.0, 0.0);
+    glm::vec3 scale = glm::vec3(1.0);
+};
+
+// Area weighted vertex normals, for primitives that don't have any
+void computeNormals(const std::vector<SkinVertex>& skin,
+                    std::vector<ShadingVertex>& shading,
+                    const std::vector<unsigned int>& indexes)
+{
+    for (ShadingVertex& v : shading)
+        v.normal = glm::vec3(0.0);
+    for (size_t i = 0; i + 2 < indexes.size(); i += 3) {
+        glm::vec3 a = skin[indexes[i]].position;
+        glm::vec3 b = skin[indexes[i + 1]].position;
+        glm::vec3 c = skin[indexes[i + 2]].position;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        for (int j = 0; j < 3; j++)
+            shading[indexes[i + j]].normal += n;
+    }
+    for (ShadingVertex& v : shading) {
+        float length = glm::length(v.normal);
+        v.normal = length > 0.0 ? v.normal / length : glm::vec3(0.0, 1.0, 0.0);
+    }
+}
+
+// Tangents along the texture's u direction, for primitives that don't have any
+void computeTangents(const std::vector<SkinVertex>& skin,
+                     std::vector<ShadingVertex>& shading,
+                     const std::vector<unsigned int>& indexes)
+{
+    for (ShadingVertex& v : shading)
+        v.tangent = glm::vec3(0.0);
+    for (size_t i = 0; i + 2 < indexes.size(); i += 3) {
+        unsigned int a = indexes[i], b = indexes[i + 1], c = indexes[i + 2];
+        glm::vec3 e1 = skin[b].position - skin[a].position;
+        glm::vec3 e2 = skin[c].position - skin[a].position;
+        glm::vec2 d1 = shading[b].coord - shading[a].coord;
+        glm::vec2 d2 = shading[c].coord - shading[a].coord;
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (fabs(det) < 1e-12) continue;
+        glm::vec3 t = (e1 * d2.y - e2 * d1.y) / det;
+        shading[a].tangent += t;
+        shading[b].tangent += t;
+        shading[c].tangent += t;
+    }
+
+    for (ShadingVertex& v : shading) {
+        if (glm::length(v.tangent) == 0.0)
+            v.tangent = fallbackTangent(v.normal);
+    }
+}
+
+// Append a sampler's keyframes to the channel's, in the layout Keyframes wants
+template <typename T>
+void readKeyframes(
+    const Accessor& input, const Accessor& output, const std::string& interpolation,
+    std::vector<std::pair<double, T>>& keys
+) {
+    // Cubic splines store an in tangent, the value and an out tangent per key,
+    // only the value is kept and interpolated linearly
+    bool cubic = interpolation == "CUBICSPLINE";
+    bool step = interpolation == "STEP";
+    if (output.count < input.count * (cubic ? 3 : 1))
+        throw std::string("Animation sampler output is too short");
+
+    for (size_t i = 0; i < input.count; i++) {
+        size_t o = cubic ? i * 3 + 1 : i;
+        T value;
+        if constexpr (std::is_same<T, glm::quat>::value)
+            value = glm::quat(output.get(o, 3), output.get(o, 0), output.get(o, 1), output.get(o, 2));
+        else
+            value = output.vec3(o);
+
+        // A step holds the previous value right up to the key
+        double time = input.get(i, 0);
+        if (step && !keys.empty())
+            keys.push_back({ time, keys.back().second });
+        keys.push_back({ time, value });
+    }
+}
+
+// A weights channel holds every target's weight per key
+MorphKeyframes readMorphKeyframes(
+    const Accessor& input, const Accessor& output, const std::string& interpolation,
+    int numTargets
+) {
+    bool cubic = interpolation == "CUBICSPLINE";
+    bool step = interpolation == "STEP";
+    if (output.count < input.count * numTargets * (cubic ? 3 : 1))
+        throw std::string("Animation sampler output is too short");
+
+    int kept = std::min(numTargets, maxMorphTargets);
+    std::vector<double> times;
+    std::vector<float> weights;
+    for (size_t i = 0; i < input.count; i++) {
+        double time = input.get(i, 0);
+        if (step && !times.empty()) {
+            times.push_back(time);
+            // By index, since pushing back can move the weights being copied
+            size_t last = weights.size() - kept;
+            for (int t = 0; t < kept; t++)
+                weights.push_back(weights[last + t]);
+        }
+
+        size_t o = (cubic ? i * 3 + 1 : i) * numTargets;
+        times.push_back(time);
+        for (int t = 0; t < kept; t++)
+            weights.push_back(output.get(o + t, 0));
+    }
+    return MorphKeyframes(kept, times, weights);
+}
+
+// The interpolation expects keys that cover the whole animation
+template <typename T>
+void coverDuration(std::vector<std::pair<double, T>>& keys, T rest, double duration)
+{
+    if (keys.empty()) {
+        keys.push_back({ 0.0, rest });
+        return;
+    }
+    if (keys.size() == 1)
+        return; // Constant
+    if (keys.front().first > 0.0)
+        keys.insert(keys.begin(), { 0.0, keys.front().second });
+    if (keys.back().first < duration)
+        keys.push_back({ duration, keys.back().second });
+}
+
+void Model::loadGltf(
+    std::string path, const MappedFile& source,
+    std::vector<std::shared_ptr<MappedFile>>& mappings
+) {
+    GltfFile file(path, source, mappings);
+    const Json& json = file.json;
+    const Json& gltfNodes = json["nodes"];
+    const Json& gltfSkins = json["skins"];
+    const Json& gltfMeshes = json["meshes"];
+
+    std::vector<bool> isJoint(gltfNodes.size(), false);
+    for (size_t s = 0; s < gltfSkins.size(); s++) {
+        const Json& joints = gltfSkins[s]["joints"];
+        for (size_t j = 0; j < joints.size(); j++) {
+            size_t joint = joints[j].integer(-1);
+            if (joint >= gltfNodes.size())
+                throw std::string("Invalid skin joint");
+            isJoint[joint] = true;
+        }
+    }
+
+    // Flatten the scene's hierarchy depth first, like Animator::load does
+    std::vector<Node> nodes;
+    std::vector<int> flatIndex(gltfNodes.size(), -1);
+    std::vector<RestPose> rest(gltfNodes.size());
+    std::vector<int> drawnNodes; // glTF nodes with meshes, in draw order
+    std::vector<int> skinnedNodes;
+    std::vector<int> meshNodes(gltfNodes.size(), -1); // Flat node carrying each one's meshes
+
+    std::function<void(size_t, int)> flatten = [&](size_t index, int parent) {
+        if (index >= gltfNodes.size() || flatIndex[index] != -1)
+            throw std::string("Invalid node hierarchy");
+        const Json& n = gltfNodes[index];
+
+        Node node;
+        node.name = n["name"].string();
+        node.parent = parent;
+        node.meshCount = 0;
+        node.boneId = -1;
+
+        RestPose& pose = rest[index];
+        if (n.has("matrix")) {
+            for (int i = 0; i < 16; i++)
+                node.transform[i / 4][i % 4] = n["matrix"][i].number();
+        } else {
+            const Json& t = n["translation"];
+            const Json& r = n["rotation"];
+            const Json& s = n["scale"];
+            if (t.size() == 3)
+                pose.translation = glm::vec3(t[0].number(), t[1].number(), t[2].number());
+            if (r.size() == 4)
+                pose.rotation = glm::quat(r[3].number(), r[0].number(), r[1].number(), r[2].number());
+            if (s.size() == 3)
+                pose.scale = glm::vec3(s[0].number(), s[1].number(), s[2].number());
+            node.transform = glm::translate(glm::mat4(1.0), pose.translation) *
+                             glm::mat4(glm::normalize(pose.rotation)) *
+                             glm::scale(glm::mat4(1.0), pose.scale);
+        }
+
+        // The bones are looked up by name, so the names have to be unique
+        if (node.name.empty() || std::any_of(nodes.begin(), nodes.end(),
+                [&](const Node& other) { return other.name == node.name; }))
+            node.name += "#" + std::to_string(index);
+
+        int flat = nodes.size();
+        flatIndex[index] = flat;
+        nodes.push_back(node);
+
+        // As the spec recommends, a skinned mesh's node transform is ignored
+        // and its meshes hang off an identity node instead. Bones don't produce
+        // mesh transforms, so a joint's own mesh gets a child node to carry it
+        if (n.has("mesh")) {
+            size_t primitives = gltfMeshes[n["mesh"].integer()]["primitives"].size();
+            if (n.has("skin")) {
+                skinnedNodes.push_back(index);
+            } else if (isJoint[index]) {
+                meshNodes[index] = nodes.size();
+                nodes.push_back({ node.name + "#mesh", flat, (int)primitives, -1, glm::mat4(1.0) });
+                drawnNodes.push_back(index);
+            } else {
+                meshNodes[index] = flat;
+                nodes[flat].meshCount = primitives;
+                drawnNodes.push_back(index);
+            }
+        }
+
+        const Json& children = n["children"];
+        for (size_t i = 0; i < children.size(); i++)
+            flatten(children[i].integer(-1), flat);
+    };
+
+    const Json& scene = json["scenes"][json["scene"].integer(0)];
+    if (scene.type != Json::Null) {
+        for (size_t i = 0; i < scene["nodes"].size(); i++)
+            flatten(scene["nodes"][i].integer(-1), -1);
+    } else {
+        // Without scenes, every node without a parent is a root
+        std::vector<bool> isChild(gltfNodes.size(), false);
+        for (size_t i = 0; i < gltfNodes.size(); i++) {
+            const Json& children = gltfNodes[i]["children"];
+            for (size_t j = 0; j < children.size(); j++)
+                isChild[std::min<size_t>(children[j].integer(-1), gltfNodes.size() - 1)] = true;
+        }
+        for (size_t i = 0; i < gltfNodes.size(); i++) {
+            if (!isChild[i]) flatten(i, -1);
+        }
+    }
+
+    // One root per skinned node, so that its morph weights can be told apart
+    for (int index : skinnedNodes) {
+        int primitives = gltfMeshes[gltfNodes[index]["mesh"].integer()]["primitives"].size();
+        meshNodes[index] = nodes.size();
+        nodes.push_back({ nodes[flatIndex[index]].name + "#skinned", -1, primitives, -1, glm::mat4(1.0) });
+        drawnNodes.push_back(index);
+    }
+
+    // Every joint of every skin is a bone, the first skin's inverse bind matrix wins
+    BoneMap bones;
+    std::vector<std::vector<int>> skinBones(gltfSkins.size());
+    for (size_t s = 0; s < gltfSkins.size(); s++) {
+        const Json& skin = gltfSkins[s];
+        const Json& joints = skin["joints"];
+        Accessor inverseBind;
+        if (skin.has("inverseBindMatrices")) {
+            inverseBind = file.accessor(skin["inverseBindMatrices"].integer());
+            if (inverseBind.count < joints.size() || inverseBind.components != 16)
+                throw std::string("Invalid inverse bind matrices");
+        }
+
+        for (size_t j = 0; j < joints.size(); j++) {
+            int flat = flatIndex[joints[j].integer()];
+            if (flat == -1) {
+                skinBones[s].push_back(-1); // Not in the scene
+                continue;
+            }
+
+            std::string& boneName = nodes[flat].name;
+            if (!bones.count(boneName)) {
+                Bone bone;
+                bone.id = bones.size();
+                bone.inverseBindMatrix = glm::mat4(1.0);
+                if (inverseBind.data != nullptr) {
+                    for (int i = 0; i < 16; i++)
+                        bone.inverseBindMatrix[i / 4][i % 4] = inverseBind.get(j, i);
+                }
+                bones[boneName] = bone;
+                nodes[flat].boneId = bone.id;
+            }
+            skinBones[s].push_back(bones[boneName].id);
+        }
+    }
+#ifdef PACKED_VERTICES
+    if (bones.size() > 256)
+        throw std::string("Too many bones for the packed vertex format");
+#endif
+
+    // The same primitive drawn by several nodes is only processed once
+    struct Primitive { int mesh, primitive, skin; };
+    std::vector<Primitive> primitives;
+    std::vector<size_t> drawOrder;
+    for (int index : drawnNodes) {
+        const Json& n = gltfNodes[index];
+        int mesh = n["mesh"].integer();
+        int skin = n["skin"].integer(-1);
+        for (size_t p = 0; p < gltfMeshes[mesh]["primitives"].size(); p++) {
+            size_t unique = 0;
+            while (unique < primitives.size() &&
+                   (primitives[unique].mesh != mesh ||
+                    primitives[unique].primitive != (int)p ||
+                    primitives[unique].skin != skin))
+                unique++;
+            if (unique == primitives.size())
+                primitives.push_back({ mesh, (int)p, skin });
+            drawOrder.push_back(unique);
+        }
+    }
+
+    std::vector<Mesh> processed(primitives.size());
+    std::vector<std::string> reports(primitives.size());
+    parallelFor(primitives.size(), [&](size_t i) {
+        const Primitive& p = primitives[i];
+        const Json& data = gltfMeshes[p.mesh]["primitives"][p.primitive];
+        const Json& attributes = data["attributes"];
+        Mesh& mesh = processed[i];
+        mesh.initialized = false;
+
+        if (data["mode"].integer(GLTF_TRIANGLES) != GLTF_TRIANGLES)
+            throw std::string("Only triangle primitives are supported");
+        if (!attributes.has("POSITION"))
+            throw std::string("Primitive without positions");
+
+        // The attributes are decoded from the mapping straight into the
+        // vertex streams, which get reordered and packed afterwards
+        Accessor positions = file.accessor(attributes["POSITION"].integer());
+        size_t numVertices = positions.count;
+        mesh.skinVertices.resize(numVertices);
+        mesh.shadingVertices.resize(numVertices);
+        for (size_t v = 0; v < numVertices; v++) {
+            SkinVertex& skin = mesh.skinVertices[v];
+            skin.position = positions.vec3(v);
+            skin.boneIds = glm::ivec4(-1.0);
+            skin.boneWeights = glm::vec4(0.0);
+            mesh.box.update(skin.position);
+            mesh.shadingVertices[v].coord = glm::vec2(0.0);
+        }
+
+        if (data.has("indices")) {
+            Accessor indexes = file.accessor(data["indices"].integer());
+            mesh.indexes.resize(indexes.count);
+            for (size_t j = 0; j < indexes.count; j++) {
+                mesh.indexes[j] = indexes.integer(j, 0);
+                if (mesh.indexes[j] >= numVertices)
+                    throw std::string("Vertex index out of range");
+            }
+        } else {
+            mesh.indexes.resize(numVertices);
+            std::iota(mesh.indexes.begin(), mesh.indexes.end(), 0);
+        }
+        mesh.indexes.resize(mesh.indexes.size() / 3 * 3);
+
+        if (attributes.has("TEXCOORD_0")) {
+            Accessor coords = file.accessor(attributes["TEXCOORD_0"].integer());
+            for (size_t v = 0; v < std::min(numVertices, coords.count); v++)
+                mesh.shadingVertices[v].coord = glm::vec2(coords.get(v, 0), coords.get(v, 1));
+        }
+
+        if (attributes.has("NORMAL")) {
+            Accessor normals = file.accessor(attributes["NORMAL"].integer());
+            for (size_t v = 0; v < std::min(numVertices, normals.count); v++)
+                mesh.shadingVertices[v].normal = normals.vec3(v);
+        } else {
+            computeNormals(mesh.skinVertices, mesh.shadingVertices, mesh.indexes);
+        }
+
+        if (attributes.has("TANGENT")) {
+            Accessor tangents = file.accessor(attributes["TANGENT"].integer());
+            for (size_t v = 0; v < std::min(numVertices, tangents.count); v++)
+                mesh.shadingVertices[v].tangent = tangents.vec3(v);
+        } else {
+            computeTangents(mesh.skinVertices, mesh.shadingVertices, mesh.indexes);
+        }
+
+        // The joints index the skin's joint list, not the bones
+        if (p.skin != -1 && attributes.has("JOINTS_0") && attributes.has("WEIGHTS_0")) {
+            Accessor joints = file.accessor(attributes["JOINTS_0"].integer());
+            Accessor weights = file.accessor(attributes["WEIGHTS_0"].integer());
+            const std::vector<int>& jointBones = skinBones[p.skin];
+            size_t count = std::min({ numVertices, joints.count, weights.count });
+            for (size_t v = 0; v < count; v++) {
+                for (int c = 0; c < 4; c++) {
+                    float weight = weights.get(v, c);
+                    unsigned int joint = joints.integer(v, c);
+                    if (weight <= 0.0 || joint >= jointBones.size() || jointBones[joint] == -1)
+                        continue;
+                    addBoneToVertex(mesh.skinVertices[v], jointBones[joint], weight);
+                }
+            }
+        }
+
+        // The targets are offsets already, the mesh's weights are the defaults
+        const Json& targets = data["targets"];
+        if (targets.size() > (size_t)maxMorphTargets)
+            log(WARN, path + ": dropping the morph targets past " + std::to_string(maxMorphTargets));
+        const Json& defaults = gltfMeshes[p.mesh]["weights"];
+        for (size_t t = 0; t < std::min(targets.size(), (size_t)maxMorphTargets); t++) {
+            mesh.morphWeights.push_back(defaults[t].number(0.0));
+            Accessor positionDeltas, normalDeltas;
+            if (targets[t].has("POSITION"))
+                positionDeltas = file.accessor(targets[t]["POSITION"].integer());
+            if (targets[t].has("NORMAL"))
+                normalDeltas = file.accessor(targets[t]["NORMAL"].integer());
+            for (size_t v = 0; v < numVertices; v++) {
+                glm::vec3 position(0.0), normal(0.0);
+                if (v < positionDeltas.count) position = positionDeltas.vec3(v);
+                if (v < normalDeltas.count) normal = normalDeltas.vec3(v);
+                addMorphDelta(mesh, t, v, position, normal);
+            }
+        }
+
+        reports[i] = prepareMesh(mesh);
+    });
+
+    // Materials, the texture loader isn't thread safe
+    const Json& textures = json["textures"];
+    const Json& images = json["images"];
+    for (size_t i = 0; i < primitives.size(); i++) {
+        const Primitive& p = primitives[i];
+        const Json& data = gltfMeshes[p.mesh]["primitives"][p.primitive];
+        const Json& material = json["materials"][data["material"].integer(-1)];
+        Mesh& mesh = processed[i];
+
+        std::pair<std::string, const Json*> slots[] = {
+            { "diffuse", &material["pbrMetallicRoughness"]["baseColorTexture"] },
+            { "normal", &material["normalTexture"] },
+            { "emission", &material["emissiveTexture"] },
+        };
+        for (auto& [sampler, slot] : slots) {
+            if (!slot->has("index")) continue;
+            int imageIndex = textures[(*slot)["index"].integer()]["source"].integer(-1);
+            const Json& image = images[imageIndex];
+
+            TextureRef ref;
+            ref.sampler = sampler;
+            if (image.has("bufferView")) {
+                // Decoded straight from the mapping
+                size_t length;
+                ref.embedded = file.bufferView(image["bufferView"].integer(), length);
+                ref.width = length;
+                ref.height = 0;
+                ref.path = path + "#" + std::to_string(imageIndex);
+            } else if (image.has("uri") && image["uri"].string().rfind("data:", 0) != 0) {
+                ref.path = "./" + image["uri"].string();
+            } else {
+                log(WARN, path + ": skipping an image in a data URI");
+                continue;
+            }
+            mesh.textureRefs.push_back(ref);
+        }
+        mesh.textures = textureLoader->get(mesh.textureRefs, textureBasePath);
+
+        std::string meshName = gltfMeshes[p.mesh]["name"].string();
+        log(DEBUG, name + "/" + meshName + "#" + std::to_string(p.primitive) + reports[i]);
+    }
+
+    for (size_t i : drawOrder) {
+        box.update(processed[i].box);
+        meshes.push_back(processed[i]);
+    }
+
+    // The channels go straight into keyframes, in seconds
+    std::vector<Clip> clips;
+    const Json& gltfAnimations = json["animations"];
+    for (size_t a = 0; a < gltfAnimations.size(); a++) {
+        const Json& animation = gltfAnimations[a];
+        const Json& samplers = animation["samplers"];
+        const Json& channels = animation["channels"];
+
+        std::vector<std::vector<Keyframes::VectorKey>> positions(gltfNodes.size());
+        std::vector<std::vector<Keyframes::VectorKey>> scalings(gltfNodes.size());
+        std::vector<std::vector<Keyframes::QuatKey>> rotations(gltfNodes.size());
+        std::vector<bool> animated(gltfNodes.size(), false);
+        std::vector<MorphKeyframes> morphChannels;
+        std::vector<std::string> morphNodes;
+        double duration = 0.0;
+
+        for (size_t c = 0; c < channels.size(); c++) {
+            const Json& channel = channels[c];
+            size_t target = channel["target"]["node"].integer(-1);
+            std::string targetPath = channel["target"]["path"].string();
+            if (target >= gltfNodes.size() || flatIndex[target] == -1)
+                continue;
+
+            const Json& sampler = samplers[channel["sampler"].integer()];
+            Accessor input = file.accessor(sampler["input"].integer());
+            Accessor output = file.accessor(sampler["output"].integer());
+            std::string interpolation = sampler["interpolation"].type == Json::String
+                ? sampler["interpolation"].string() : "LINEAR";
+            if (input.count > 0)
+                duration = std::max<double>(duration, input.get(input.count - 1, 0));
+
+            // Weights drive every primitive of the node's mesh, which share their targets
+            if (targetPath == "weights") {
+                if (meshNodes[target] == -1) continue;
+                const Json& mesh = gltfMeshes[gltfNodes[target]["mesh"].integer()];
+                int numTargets = mesh["primitives"][0]["targets"].size();
+                if (numTargets == 0) continue;
+                morphNodes.push_back(nodes[meshNodes[target]].name);
+                morphChannels.push_back(readMorphKeyframes(input, output, interpolation, numTargets));
+                continue;
+            }
+
+            animated[target] = true;
+            if (targetPath == "translation")
+                readKeyframes(input, output, interpolation, positions[target]);
+            else if (targetPath == "scale")
+                readKeyframes(input, output, interpolation, scalings[target]);
+            else if (targetPath == "rotation")
+                readKeyframes(input, output, interpolation, rotations[target]);
+        }
+        if (duration <= 0.0)
+            continue; // A single pose, nothing to play
+
+        Clip clip;
+        clip.name = animation["name"].string();
+        if (clip.name.empty())
+            clip.name = "Animation " + std::to_string(a);
+        clip.ticksPerSecond = 1.0;
+        clip.duration = duration;
+        for (size_t n = 0; n < gltfNodes.size(); n++) {
+            if (!animated[n]) continue;
+            coverDuration(positions[n], rest[n].translation, duration);
+            coverDuration(scalings[n], rest[n].scale, duration);
+            coverDuration(rotations[n], rest[n].rotation, duration);
+            clip.channelNodes.push_back(nodes[flatIndex[n]].name);
+            clip.channels.push_back(Keyframes(positions[n], scalings[n], rotations[n]));
+        }
+        clip.morphChannels = std::move(morphChannels);
+        clip.morphNodes = std::move(morphNodes);
+        clips.push_back(std::move(clip));
+    }
+
+    animator.load(nodes, bones, clips);
+}
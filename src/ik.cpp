@@ -0,0 +1,217 @@
+#include <chrono>
+
+#include "ik.h"
+#include "retarget.h"
+
+using Clock = std::chrono::steady_clock;
+
+// A limb's bones by their roles, see boneRole
+struct LimbTemplate
+{
+    const char* name;
+    char side;
+    int keypoints[3];
+    const char* roles[3];
+    float rootLimit, bendLimit; // In degrees
+};
+
+// The keypoints are numbered like keypointConnections in movenet.h
+static const LimbTemplate limbTemplates[] = {
+    { "left arm", 'l', { 5, 7, 9 }, { "upperarm", "lowerarm", "hand" }, 120.0, 150.0 },
+    { "right arm", 'r', { 6, 8, 10 }, { "upperarm", "lowerarm", "hand" }, 120.0, 150.0 },
+    { "left leg", 'l', { 11, 13, 15 }, { "upperleg", "lowerleg", "foot" }, 100.0, 150.0 },
+    { "right leg", 'r', { 12, 14, 16 }, { "upperleg", "lowerleg", "foot" }, 100.0, 150.0 },
+};
+
+static bool isAncestor(const std::vector<Node>& nodes, int ancestor, int node)
+{
+    for (int i = nodes[node].parent; i != -1; i = nodes[i].parent) {
+        if (i == ancestor) return true;
+    }
+    return false;
+}
+
+int KeypointSolver::bind(const std::vector<Node>& nodes)
+{
+    std::vector<char> sides(nodes.size());
+    std::vector<std::string> roles(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+        sides[i] = boneRole(nodes[i].name, roles[i]);
+
+    limbs.clear();
+    int found = 0;
+    for (const LimbTemplate& t : limbTemplates) {
+        LimbChain limb;
+        limb.name = t.name;
+        limb.rootLimit = glm::radians(t.rootLimit);
+        limb.bendLimit = glm::radians(t.bendLimit);
+        for (int k = 0; k < 3; k++) {
+            limb.keypoints[k] = t.keypoints[k];
+            limb.nodes[k] = -1;
+            for (size_t i = 0; i < nodes.size() && limb.nodes[k] == -1; i++) {
+                if (sides[i] == t.side && roles[i] == t.roles[k])
+                    limb.nodes[k] = i;
+            }
+        }
+
+        // There can be twist bones in between, but the joints have to be in order
+        bool complete = limb.nodes[0] != -1 && limb.nodes[1] != -1 && limb.nodes[2] != -1 &&
+            isAncestor(nodes, limb.nodes[0], limb.nodes[1]) &&
+            isAncestor(nodes, limb.nodes[1], limb.nodes[2]);
+        if (!complete)
+            limb.nodes[0] = limb.nodes[1] = limb.nodes[2] = -1;
+        else
+            found++;
+        limbs.push_back(limb);
+    }
+
+    boundNodes = nodes.size();
+    return found;
+}
+
+static glm::vec3 position(const glm::mat4& m) { return glm::vec3(m[3]); }
+
+static glm::vec3 safeNormalize(glm::vec3 v, glm::vec3 fallback)
+{
+    float length = glm::length(v);
+    return length > 1e-6 ? v / length : fallback;
+}
+
+// Turn the direction towards the axis until it's at most maxAngle away from it
+static glm::vec3 limitCone(glm::vec3 direction, glm::vec3 axis, float maxAngle)
+{
+    float cosine = glm::dot(direction, axis);
+    if (cosine >= cos(maxAngle))
+        return direction;
+
+    glm::vec3 other = fabs(axis.x) < 0.9 ? glm::vec3(1.0, 0.0, 0.0) : glm::vec3(0.0, 1.0, 0.0);
+    glm::vec3 side = safeNormalize(direction - axis * cosine, glm::normalize(glm::cross(axis, other)));
+    return axis * float(cos(maxAngle)) + side * float(sin(maxAngle));
+}
+
+// The rotation of a transform, without its scale
+static glm::quat rotationOf(const glm::mat4& m)
+{
+    glm::mat3 r(m);
+    for (int c = 0; c < 3; c++)
+        r[c] = glm::normalize(r[c]);
+    return glm::normalize(glm::quat_cast(r));
+}
+
+// Turn a global transform about its own origin
+static glm::mat4 turn(const glm::mat4& m, glm::quat rotation)
+{
+    glm::mat4 result = glm::mat4_cast(rotation) * m;
+    result[3] = m[3];
+    return result;
+}
+
+// In pixels with y up, so that it lines up with the model's x and y. The
+// person faces the camera like the model does, so their left is on the right
+static glm::vec3 imagePoint(Keypoint k, glm::vec2 frameSize)
+{
+    return glm::vec3(k.x * frameSize.x, (1.0 - k.y) * frameSize.y, 0.0);
+}
+
+IkStats KeypointSolver::solve(
+    const std::vector<Keypoint>& keypoints, glm::vec2 frameSize,
+    const std::vector<Node>& nodes, const std::vector<glm::mat4>& globals,
+    double budgetMilliseconds, PoseOverrides& overrides
+) {
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(budgetMilliseconds));
+
+    IkStats stats;
+    overrides.nodes.clear();
+    overrides.rotations.clear();
+    if (globals.size() != nodes.size() || nodes.size() != boundNodes)
+        return stats; // No pose yet, or another rig
+
+    for (LimbChain& limb : limbs) {
+        if (limb.nodes[0] == -1) continue;
+        bool seen = true;
+        glm::vec3 k[3];
+        for (int j = 0; j < 3; j++) {
+            if (limb.keypoints[j] >= int(keypoints.size())) {
+                seen = false;
+                break;
+            }
+            Keypoint kp = keypoints[limb.keypoints[j]];
+            seen = seen && kp.detected();
+            k[j] = imagePoint(kp, frameSize);
+        }
+        if (!seen) continue;
+        if (Clock::now() >= deadline) {
+            stats.outOfTime = true;
+            break;
+        }
+
+        int n0 = limb.nodes[0], n1 = limb.nodes[1], n2 = limb.nodes[2];
+        glm::vec3 p[3] = { position(globals[n0]), position(globals[n1]), position(globals[n2]) };
+        float lengths[2] = { glm::distance(p[0], p[1]), glm::distance(p[1], p[2]) };
+        float reach = lengths[0] + lengths[1];
+        float personReach = glm::distance(k[0], k[1]) + glm::distance(k[1], k[2]);
+        if (reach <= 0.0 || personReach <= 0.0) continue;
+
+        // The person's limb scaled to the model's, from the model's shoulder or hip
+        float scale = reach / personReach;
+        glm::vec3 target = p[0] + (k[2] - k[0]) * scale;
+        glm::vec3 bend = p[0] + (k[1] - k[0]) * scale;
+        glm::vec3 upperBefore = safeNormalize(p[1] - p[0], glm::vec3(0.0, -1.0, 0.0));
+
+        // The root's limit is about the upper bone's rest direction. There
+        // can be twist bones between the joints, so the rest offset is composed
+        glm::mat4 parent = nodes[n0].parent == -1 ? glm::mat4(1.0) : globals[nodes[n0].parent];
+        glm::mat4 offset(1.0);
+        for (int i = n1; i != n0; i = nodes[i].parent)
+            offset = nodes[i].transform * offset;
+        glm::vec3 rest = safeNormalize(
+            glm::mat3(parent * nodes[n0].transform) * position(offset), upperBefore);
+
+        // Place the joints from the root with the limits applied
+        auto forward = [&]() {
+            glm::vec3 upper = limitCone(safeNormalize(p[1] - p[0], rest), rest, limb.rootLimit);
+            p[1] = p[0] + upper * lengths[0];
+            glm::vec3 lower = limitCone(safeNormalize(p[2] - p[1], upper), upper, limb.bendLimit);
+            p[2] = p[1] + lower * lengths[1];
+        };
+
+        // Start from the bend the keypoints show, so the limb folds the same way
+        p[1] = p[0] + safeNormalize(bend - p[0], upperBefore) * lengths[0];
+        p[2] = p[1] + safeNormalize(target - p[1], upperBefore) * lengths[1];
+        forward();
+
+        for (int i = 0; i < maxIterations; i++) {
+            if (glm::distance(p[2], target) <= tolerance * reach)
+                break;
+            if (Clock::now() >= deadline) {
+                stats.outOfTime = true;
+                break;
+            }
+            p[2] = target;
+            p[1] = p[2] + safeNormalize(p[1] - p[2], -upperBefore) * lengths[1];
+            forward();
+            stats.iterations++;
+        }
+
+        // Turn the root so that the middle joint lands where it was solved,
+        // which moves everything under it, then turn the middle joint
+        glm::mat4 root = turn(globals[n0], glm::quat(upperBefore, safeNormalize(p[1] - p[0], upperBefore)));
+        glm::mat4 moved = root * glm::inverse(globals[n0]);
+        glm::mat4 middleBefore = moved * globals[n1];
+        glm::vec3 lowerBefore = safeNormalize(position(moved * globals[n2]) - position(middleBefore), upperBefore);
+        glm::mat4 middle = turn(middleBefore, glm::quat(lowerBefore, safeNormalize(p[2] - p[1], lowerBefore)));
+
+        int middleParent = nodes[n1].parent;
+        glm::mat4 newParent = middleParent == n0 ? root : moved * globals[middleParent];
+        overrides.nodes.push_back(n0);
+        overrides.rotations.push_back(rotationOf(glm::inverse(parent) * root));
+        overrides.nodes.push_back(n1);
+        overrides.rotations.push_back(rotationOf(glm::inverse(newParent) * middle));
+        stats.limbs++;
+    }
+
+    stats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return stats;
+}
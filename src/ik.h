@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "animator.h"
+#include "movenet.h"
+
+// A limb of the rig driven by 3 keypoints: the upper bone, the lower
+// bone and the hand or foot, with the joints they rotate about
+struct LimbChain
+{
+    std::string name;
+    int keypoints[3]; // Shoulder, elbow and wrist, or hip, knee and ankle
+    int nodes[3];     // Their nodes in the rig, -1 when it doesn't have them
+    float rootLimit;  // Largest angle from the rest direction at the root, in radians
+    float bendLimit;  // Largest bend at the middle joint, in radians
+};
+
+// What the last solve did, for the stats
+struct IkStats
+{
+    int limbs = 0; // Solved this time, out of those whose keypoints were seen
+    int iterations = 0;
+    bool outOfTime = false;
+    double milliseconds = 0.0;
+};
+
+// Retargets the MoveNet keypoints onto a model's arms and legs with FABRIK.
+// The keypoints only have image coordinates, so each limb reaches for a
+// target in the model's frontal plane: the wrist or ankle, relative to the
+// shoulder or hip, scaled from the person's limb length to the model's.
+// The elbow or knee keypoint seeds the bend, so the solution folds the same
+// way. The model space is assumed to be y up, facing +z
+class KeypointSolver
+{
+public:
+    // Find the limbs by their bone names, like LeftForeArm, lowerarm_l or
+    // forearm.L. Returns how many of the 4 limbs the rig has
+    int bind(const std::vector<Node>& nodes);
+    bool bound() { return boundNodes > 0; }
+    // Forget the rig, so that the next model gets bound
+    void unbind() { boundNodes = 0; }
+
+    // Solve the limbs whose keypoints were detected, given the global
+    // transforms of the model's current pose, and write their local
+    // rotations. Stops when budgetMilliseconds runs out, keeping the
+    // limbs solved so far and leaving the others to the animation
+    IkStats solve(
+        const std::vector<Keypoint>& keypoints, glm::vec2 frameSize,
+        const std::vector<Node>& nodes, const std::vector<glm::mat4>& globals,
+        double budgetMilliseconds, PoseOverrides& overrides);
+
+    int maxIterations = 16;
+    float tolerance = 0.001; // Relative to the limb's length
+private:
+    std::vector<LimbChain> limbs;
+    size_t boundNodes = 0;
+};
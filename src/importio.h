@@ -0,0 +1,129 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/ProgressHandler.hpp>
+
+#include "mapped.h"
+
+// Reads a memory mapped file, so Assimp's reads are
+// copies out of the page cache rather than read calls
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+    MappedIOStream(std::string path) : file(path)
+    {
+        // The importers mostly read the file front to back
+        file.advise(MADV_SEQUENTIAL);
+    }
+
+    size_t Read(void* buffer, size_t size, size_t count) override
+    {
+        if (size == 0) return 0;
+        count = std::min(count, (file.size() - position) / size);
+        memcpy(buffer, file.data() + position, size * count);
+        position += size * count;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override { return 0; }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t target = origin == aiOrigin_SET ? offset
+                      : origin == aiOrigin_CUR ? position + offset
+                      : file.size() + offset;
+        if (target > file.size())
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return file.size(); }
+    void Flush() override {}
+private:
+    MappedFile file;
+    size_t position = 0;
+};
+
+// Opens every file the importer reads, the model and
+// whatever it references, as a MappedIOStream
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char* path) const override
+    {
+        struct stat info;
+        return stat(path, &info) == 0;
+    }
+
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream* Open(const char* path, const char* mode = "rb") override
+    {
+        if (strchr(mode, 'w') != nullptr || strchr(mode, 'a') != nullptr)
+            return nullptr; // Read only
+        try {
+            return new MappedIOStream(path);
+        } catch (std::string) {
+            return nullptr;
+        }
+    }
+
+    void Close(Assimp::IOStream* stream) override { delete stream; }
+};
+
+// Times the file reading and each post processing step of an import.
+// Assimp only passes the steps' indexes, which follow the order they're
+// registered in by Assimp's PostStepRegistry, and steps that aren't
+// enabled come out at nearly zero
+class ImportTimer : public Assimp::ProgressHandler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ImportTimer() : start(Clock::now()), last(start) {}
+
+    bool Update(float) override { return true; }
+
+    void UpdatePostProcess(int step, int numSteps) override
+    {
+        Clock::time_point now = Clock::now();
+        if (step == 0)
+            readTime = milliseconds(now - start);
+        else
+            stepTimes.push_back({ step - 1, milliseconds(now - last) });
+        last = now;
+        (void)numSteps;
+    }
+
+    // The reading time, then the steps that took at least minimum milliseconds
+    std::string report(double minimum = 0.1)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "read %.1f ms", readTime);
+        std::string result = text;
+        for (auto& [step, time] : stepTimes) {
+            if (time < minimum) continue;
+            snprintf(text, sizeof(text), ", step %d %.1f ms", step, time);
+            result += text;
+        }
+        return result;
+    }
+private:
+    static double milliseconds(Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    Clock::time_point start, last;
+    double readTime = 0.0;
+    std::vector<std::pair<int, double>> stepTimes;
+};
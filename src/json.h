@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Minimal JSON reader, enough for glTF. Values are read only, looking up a
+// missing key or index gives a null value so lookups can be chained
+class Json
+{
+public:
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    static Json parse(const char* begin, const char* end)
+    {
+        const char* p = begin;
+        Json value = parseValue(p, end);
+        skipSpace(p, end);
+        if (p != end)
+            throw std::string("Trailing characters after the JSON value");
+        return value;
+    }
+
+    const Json& operator[](const std::string& key) const
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+            if (keys[i] == key) return values[i];
+        return null();
+    }
+
+    const Json& operator[](size_t index) const
+    {
+        return type == Array && index < values.size() ? values[index] : null();
+    }
+
+    bool has(const std::string& key) const { return operator[](key).type != Null; }
+    size_t size() const { return type == Array || type == Object ? values.size() : 0; }
+
+    double number(double otherwise = 0.0) const { return type == Number ? numberValue : otherwise; }
+    int integer(int otherwise = 0) const { return type == Number ? (int)numberValue : otherwise; }
+    bool boolean(bool otherwise = false) const { return type == Bool ? boolValue : otherwise; }
+    const std::string& string() const { return stringValue; }
+
+    Type type = Null;
+private:
+    static const Json& null()
+    {
+        static Json value;
+        return value;
+    }
+
+    static void skipSpace(const char*& p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    static void expect(const char*& p, const char* end, const char* word)
+    {
+        for (; *word; word++, p++) {
+            if (p >= end || *p != *word)
+                throw std::string("Invalid JSON literal");
+        }
+    }
+
+    static Json parseValue(const char*& p, const char* end)
+    {
+        skipSpace(p, end);
+        if (p >= end)
+            throw std::string("Unexpected end of JSON");
+
+        Json value;
+        if (*p == '{') {
+            value.type = Object;
+            p++;
+            skipSpace(p, end);
+            if (p < end && *p == '}') { p++; return value; }
+            while (true) {
+                skipSpace(p, end);
+                value.keys.push_back(parseString(p, end));
+                skipSpace(p, end);
+                expect(p, end, ":");
+                value.values.push_back(parseValue(p, end));
+                skipSpace(p, end);
+                if (p < end && *p == ',') { p++; continue; }
+                expect(p, end, "}");
+                return value;
+            }
+        } else if (*p == '[') {
+            value.type = Array;
+            p++;
+            skipSpace(p, end);
+            if (p < end && *p == ']') { p++; return value; }
+            while (true) {
+                value.values.push_back(parseValue(p, end));
+                skipSpace(p, end);
+                if (p < end && *p == ',') { p++; continue; }
+                expect(p, end, "]");
+                return value;
+            }
+        } else if (*p == '"') {
+            value.type = String;
+            value.stringValue = parseString(p, end);
+        } else if (*p == 't') {
+            expect(p, end, "true");
+            value.type = Bool;
+            value.boolValue = true;
+        } else if (*p == 'f') {
+            expect(p, end, "false");
+            value.type = Bool;
+            value.boolValue = false;
+        } else if (*p == 'n') {
+            expect(p, end, "null");
+        } else {
+            // strtod stops at the first character that isn't part of the number
+            std::string digits;
+            while (p < end && (isdigit(*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                digits += *p++;
+            if (digits.empty())
+                throw std::string("Invalid JSON value");
+            value.type = Number;
+            value.numberValue = strtod(digits.c_str(), nullptr);
+        }
+        return value;
+    }
+
+    static std::string parseString(const char*& p, const char* end)
+    {
+        expect(p, end, "\"");
+        std::string s;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                s += *p++;
+                continue;
+            }
+            if (++p >= end) break;
+            char c = *p++;
+            switch (c) {
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'u': {
+                    if (end - p < 4)
+                        throw std::string("Invalid JSON escape");
+                    unsigned int code = strtoul(std::string(p, 4).c_str(), nullptr, 16);
+                    p += 4;
+                    // Encode as UTF-8, surrogate pairs aren't combined
+                    if (code < 0x80) {
+                        s += (char)code;
+                    } else if (code < 0x800) {
+                        s += (char)(0xc0 | (code >> 6));
+                        s += (char)(0x80 | (code & 0x3f));
+                    } else {
+                        s += (char)(0xe0 | (code >> 12));
+                        s += (char)(0x80 | ((code >> 6) & 0x3f));
+                        s += (char)(0x80 | (code & 0x3f));
+                    }
+                    break;
+                }
+                default: s += c; break; // Quotes and slashes
+            }
+        }
+        expect(p, end, "\"");
+        return s;
+    }
+
+    bool boolValue = false;
+    double numberValue = 0.0;
+    std::string stringValue;
+    std::vector<std::string> keys; // Only for objects
+    std::vector<Json> values;
+};
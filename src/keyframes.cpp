@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "convert.h"
 #include "keyframes.h"
 
@@ -21,23 +23,22 @@ Keyframes::Keyframes(aiNodeAnim* n)
 
 // Interpolate between 2 vectors or quaternions
 template <typename T>
-T interpolate(std::vector<std::pair<double, T>>& keyframes, double time) {
+T interpolate(const std::vector<std::pair<double, T>>& keyframes, double time) {
     // In order to interpolate we need at least 2 values
     if (keyframes.size() == 1)
         return keyframes[0].second;
 
-    // Get the current keyframe
-    size_t index = 0;
-    for (size_t i = 0; i < keyframes.size(); i++) {
-        if (keyframes[i].first > time) {
-            index = i - 1;
-            break;
-        }
-    }
+    // Get the current keyframe. Times outside of the keys, like the clip's
+    // duration when the last key is on it, hold the first or last key
+    auto after = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+        [](double t, const std::pair<double, T>& key) { return t < key.first; });
+    if (after == keyframes.begin())
+        return keyframes.front().second;
+    if (after == keyframes.end())
+        return keyframes.back().second;
 
-    assert(index + 1 < keyframes.size());
-    auto current = keyframes[index];
-    auto next = keyframes[index + 1];
+    auto current = *(after - 1);
+    auto next = *after;
 
     // Calculate the percentage of the animation that has ran
     float factor = (time - current.first) / (next.first - current.first);
@@ -49,14 +50,23 @@ T interpolate(std::vector<std::pair<double, T>>& keyframes, double time) {
     return glm::mix(current.second, next.second, factor);
 }
 
-glm::mat4 Keyframes::getInterpolatedTransform(double time)
+bool Keyframes::sample(double time, glm::vec3& position, glm::quat& rotation, glm::vec3& scaling) const
 {
     if (positions.size() == 0)
-        return glm::mat4(1.0);
+        return false;
+
+    position = interpolate<glm::vec3>(positions, time);
+    scaling = interpolate<glm::vec3>(scalings, time);
+    rotation = interpolate<glm::quat>(rotations, time);
+    return true;
+}
 
-    glm::vec3 position = interpolate<glm::vec3>(positions, time);
-    glm::vec3 scaling = interpolate<glm::vec3>(scalings, time);
-    glm::quat rotation = interpolate<glm::quat>(rotations, time);
+glm::mat4 Keyframes::getInterpolatedTransform(double time) const
+{
+    glm::vec3 position, scaling;
+    glm::quat rotation;
+    if (!sample(time, position, rotation, scaling))
+        return glm::mat4(1.0);
 
     glm::mat4 t = glm::translate(glm::mat4(1.0), position);
     glm::mat4 s = glm::scale(glm::mat4(1.0), scaling);
@@ -64,3 +74,39 @@ glm::mat4 Keyframes::getInterpolatedTransform(double time)
 
     return t * r * s;
 }
+
+MorphKeyframes::MorphKeyframes(aiMeshMorphAnim* channel)
+{
+    // The keys only list the targets they weigh, the others weigh nothing
+    for (unsigned int i = 0; i < channel->mNumKeys; i++) {
+        aiMeshMorphKey& key = channel->mKeys[i];
+        for (unsigned int j = 0; j < key.mNumValuesAndWeights; j++)
+            numTargets = std::max<int>(numTargets, key.mValues[j] + 1);
+    }
+
+    weights.assign(channel->mNumKeys * numTargets, 0.0);
+    for (unsigned int i = 0; i < channel->mNumKeys; i++) {
+        aiMeshMorphKey& key = channel->mKeys[i];
+        times.push_back(key.mTime);
+        for (unsigned int j = 0; j < key.mNumValuesAndWeights; j++)
+            weights[i * numTargets + key.mValues[j]] = key.mWeights[j];
+    }
+}
+
+void MorphKeyframes::getInterpolatedWeights(double time, std::vector<float>& result) const
+{
+    result.assign(numTargets, 0.0);
+    if (times.empty())
+        return;
+
+    size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    size_t current = next == 0 ? 0 : next - 1;
+    next = std::min(next, times.size() - 1);
+    float factor = next == current ? 0.0
+        : std::clamp<float>((time - times[current]) / (times[next] - times[current]), 0.0, 1.0);
+
+    for (int i = 0; i < numTargets; i++) {
+        result[i] = glm::mix(weights[current * numTargets + i],
+                             weights[next * numTargets + i], factor);
+    }
+}
@@ -12,13 +12,49 @@
 class Keyframes
 {
 public:
+    // The pair groups the time at which the transform
+    // happened with the transform itself
+    using VectorKey = std::pair<double, glm::vec3>;
+    using QuatKey = std::pair<double, glm::quat>;
+
     Keyframes() {}
     Keyframes(aiNodeAnim* n);
-    glm::mat4 getInterpolatedTransform(double time);
+    Keyframes(
+        std::vector<VectorKey> positions,
+        std::vector<VectorKey> scalings,
+        std::vector<QuatKey> rotations
+    ) : positions(positions), scalings(scalings), rotations(rotations) {}
+    glm::mat4 getInterpolatedTransform(double time) const;
+    // The interpolated components, false when there are no keys
+    bool sample(double time, glm::vec3& position, glm::quat& rotation, glm::vec3& scaling) const;
+
+    const std::vector<VectorKey>& getPositions() const { return positions; }
+    const std::vector<VectorKey>& getScalings() const { return scalings; }
+    const std::vector<QuatKey>& getRotations() const { return rotations; }
 private:
-    // The pair groups the time at which the transform
-    // happened with the transform itself
-    std::vector<std::pair<double, glm::vec3>> positions;
-    std::vector<std::pair<double, glm::vec3>> scalings;
-    std::vector<std::pair<double, glm::quat>> rotations;
+    std::vector<VectorKey> positions;
+    std::vector<VectorKey> scalings;
+    std::vector<QuatKey> rotations;
+};
+
+// The weights of a node's morph targets at each keyframe
+class MorphKeyframes
+{
+public:
+    MorphKeyframes() {}
+    MorphKeyframes(aiMeshMorphAnim* channel);
+    // weights holds numTargets weights per key
+    MorphKeyframes(int numTargets, std::vector<double> times, std::vector<float> weights)
+        : numTargets(numTargets), times(times), weights(weights) {}
+
+    // Linearly blend the weights of the keys around the time
+    void getInterpolatedWeights(double time, std::vector<float>& result) const;
+
+    int getNumTargets() const { return numTargets; }
+    const std::vector<double>& getTimes() const { return times; }
+    const std::vector<float>& getWeights() const { return weights; }
+private:
+    int numTargets = 0;
+    std::vector<double> times;
+    std::vector<float> weights;
 };
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <unordered_set>
+
+#include <assimp/Importer.hpp>
+
+#include "importio.h"
+#include "library.h"
+#include "log.h"
+#include "mapped.h"
+#include "stream.h"
+
+uint64_t skeletonSignature(const std::vector<Node>& nodes)
+{
+    // Sorted so that the order siblings were exported in doesn't matter
+    std::vector<std::string> entries;
+    for (const Node& node : nodes) {
+        if (node.meshCount > 0) continue;
+        std::string parent = node.parent == -1 ? "" : nodes[node.parent].name;
+        entries.push_back(parent + "/" + node.name);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::string all;
+    for (std::string& entry : entries)
+        all += entry + "\n";
+    return hashBytes((const unsigned char*)all.data(), all.size());
+}
+
+std::vector<std::shared_ptr<const Clip>> AnimationLibrary::add(
+    const std::vector<Node>& nodes,
+    const std::vector<std::shared_ptr<const Clip>>& clips
+) {
+    uint64_t signature = skeletonSignature(nodes);
+    std::lock_guard<std::mutex> lock(mutex);
+    Skeleton& skeleton = skeletons[signature];
+    if (skeleton.nodes.empty())
+        skeleton.nodes = nodes;
+
+    // Within a rig, a clip with the same name is the same clip
+    std::vector<std::shared_ptr<const Clip>> shared;
+    for (const std::shared_ptr<const Clip>& clip : clips) {
+        auto it = std::find_if(skeleton.clips.begin(), skeleton.clips.end(),
+            [&](auto& other) { return other->name == clip->name; });
+        if (it != skeleton.clips.end()) {
+            shared.push_back(*it);
+            continue;
+        }
+
+        skeleton.clips.push_back(clip);
+        std::vector<std::string>& animated = skeleton.animatedNodes;
+        animated.insert(animated.end(), clip->channelNodes.begin(), clip->channelNodes.end());
+        std::sort(animated.begin(), animated.end());
+        animated.erase(std::unique(animated.begin(), animated.end()), animated.end());
+        shared.push_back(clip);
+        changes++;
+    }
+    return shared;
+}
+
+std::vector<std::shared_ptr<const Clip>> AnimationLibrary::clipsFor(const std::vector<Node>& nodes)
+{
+    std::unordered_set<std::string> names;
+    for (const Node& node : nodes)
+        names.insert(node.name);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<const Clip>> result;
+    for (auto& [signature, skeleton] : skeletons) {
+        if (skeleton.animatedNodes.empty()) continue;
+        bool compatible = std::all_of(
+            skeleton.animatedNodes.begin(), skeleton.animatedNodes.end(),
+            [&](const std::string& name) { return names.count(name) > 0; });
+        if (compatible)
+            result.insert(result.end(), skeleton.clips.begin(), skeleton.clips.end());
+    }
+    return result;
+}
+
+// Of the names, parents and rest transforms, since the maps correct for the rest pose
+static uint64_t restPoseHash(const std::vector<Node>& nodes)
+{
+    std::string all;
+    for (const Node& node : nodes) {
+        all += node.name + "/" + std::to_string(node.parent) + "\n";
+        all.append((const char*)&node.transform, sizeof(node.transform));
+    }
+    return hashBytes((const unsigned char*)all.data(), all.size());
+}
+
+std::vector<AnimationLibrary::RetargetedClip> AnimationLibrary::retargetedClipsFor(
+    const std::vector<Node>& nodes
+) {
+    // Below that, the clips would only move a few limbs of the model
+    const float minCoverage = 2.0 / 3.0;
+
+    std::unordered_set<std::string> names;
+    for (const Node& node : nodes)
+        names.insert(node.name);
+    uint64_t target = restPoseHash(nodes);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<RetargetedClip> result;
+    for (auto& [signature, skeleton] : skeletons) {
+        if (skeleton.animatedNodes.empty() || skeleton.nodes.empty()) continue;
+        bool compatible = std::all_of(
+            skeleton.animatedNodes.begin(), skeleton.animatedNodes.end(),
+            [&](const std::string& name) { return names.count(name) > 0; });
+        if (compatible) continue; // Played as they are, see clipsFor
+
+        auto key = std::make_pair(signature, target);
+        auto it = maps.find(key);
+        if (it == maps.end()) {
+            auto map = std::make_shared<const RetargetMap>(skeleton.nodes, nodes, aliases);
+
+            // Count the animated source nodes that drive a target node
+            std::unordered_set<std::string> driving;
+            for (int source : map->sources) {
+                if (source != -1)
+                    driving.insert(map->sourceNames[source]);
+            }
+            size_t covered = std::count_if(
+                skeleton.animatedNodes.begin(), skeleton.animatedNodes.end(),
+                [&](const std::string& name) { return driving.count(name) > 0; });
+            bool enough = covered >= minCoverage * skeleton.animatedNodes.size();
+            log(DEBUG, "Retarget map with " + std::to_string(covered) + " of " +
+                std::to_string(skeleton.animatedNodes.size()) + " animated nodes" +
+                (enough ? "" : ", not used"));
+            it = maps.emplace(key, enough ? map : nullptr).first;
+        }
+        if (!it->second) continue;
+
+        for (const std::shared_ptr<const Clip>& clip : skeleton.clips)
+            result.push_back({ clip, it->second });
+    }
+    return result;
+}
+
+void AnimationLibrary::addBoneAlias(std::string source, std::string target)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    aliases.push_back({ source, target });
+    maps.clear();
+    changes++;
+}
+
+void AnimationLibrary::import(std::string path, ThreadPool* pool)
+{
+    const double chunkSeconds = 2.0;
+
+    // Only mapped, it's read when it has to be hashed or imported
+    MappedFile source(path);
+    std::string streamedPath = path + ".stream";
+    std::vector<Node> nodes;
+    std::vector<std::shared_ptr<const Clip>> clips;
+    if (!loadStreamedClips(streamedPath, source, pool, nodes, clips)) {
+        Assimp::Importer importer;
+        importer.SetIOHandler(new MappedIOSystem());
+        const aiScene* scene = importer.ReadFile(path, 0);
+        if (scene == nullptr)
+            throw std::string(importer.GetErrorString());
+        if (!scene->mRootNode)
+            throw std::string("Invalid animation file");
+
+        // Only the hierarchy and the clips are kept
+        Animator animator;
+        animator.load(scene);
+        writeStreamedClips(streamedPath, source,
+                           animator.getNodes(), animator.getClips(), chunkSeconds);
+
+        // Play from the file that was just written, so the long clips'
+        // keyframes don't stay in memory
+        if (!loadStreamedClips(streamedPath, source, pool, nodes, clips)) {
+            nodes = animator.getNodes();
+            clips = animator.getClips();
+        }
+    }
+
+    add(nodes, clips);
+    log(DEBUG, "Imported " + std::to_string(clips.size()) + " clips from " + path);
+}
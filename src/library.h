@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "animator.h"
+#include "pool.h"
+#include "retarget.h"
+
+// Clips shared by every model with a compatible rig, so that characters
+// that share a rig only cost their meshes, not a copy of every clip.
+// The clips are grouped by the signature of the skeleton they were
+// imported with, and a model plays every group whose animated nodes it has
+class AnimationLibrary
+{
+public:
+    // Swap the clips for the library's copies, adding the ones it doesn't have
+    std::vector<std::shared_ptr<const Clip>> add(
+        const std::vector<Node>& nodes,
+        const std::vector<std::shared_ptr<const Clip>>& clips);
+
+    // Every clip a model with these nodes can play
+    std::vector<std::shared_ptr<const Clip>> clipsFor(const std::vector<Node>& nodes);
+
+    // A clip of another rig, with the map that carries it over
+    struct RetargetedClip
+    {
+        std::shared_ptr<const Clip> clip;
+        std::shared_ptr<const RetargetMap> map;
+    };
+
+    // The clips of the rigs a model with these nodes can't play as they
+    // are, but whose animated nodes it mostly has under other names. The
+    // maps are built once per pair of skeletons
+    std::vector<RetargetedClip> retargetedClipsFor(const std::vector<Node>& nodes);
+
+    // Map a source bone to a target bone when their names don't tell.
+    // Rebuilds the maps, and the models pick them up on their next share
+    void addBoneAlias(std::string source, std::string target);
+
+    // Add the clips of a file, which doesn't need to have any meshes. They're
+    // written to a streamed file next to it on the first import, and long
+    // clips then play from it, with their chunks decoded on the pool
+    void import(std::string path, ThreadPool* pool);
+
+    // Changes whenever clips are added
+    size_t version() { return changes; }
+private:
+    struct Skeleton
+    {
+        std::vector<Node> nodes; // Of the first model or file added
+        std::vector<std::string> animatedNodes; // Sorted
+        std::vector<std::shared_ptr<const Clip>> clips;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Skeleton> skeletons;
+    BoneAliases aliases;
+    // By the source's signature and the target's rest pose, null when
+    // too few of the animated nodes map for the clips to be worth playing
+    std::map<std::pair<uint64_t, uint64_t>, std::shared_ptr<const RetargetMap>> maps;
+    std::atomic<size_t> changes = 1;
+};
+
+// Hash of the rig's hierarchy, which is every node but those holding meshes
+uint64_t skeletonSignature(const std::vector<Node>& nodes);
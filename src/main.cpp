@@ -56,8 +56,31 @@ struct App
 
 SDL_AppResult SDL_AppInit(void** state, int argc, char** argv)
 {
-    (void)argc;
-    (void)argv;
+    // Flags to compare the model import paths, animation files to share,
+    // bones to map between rigs and whether to run the crowd benchmark
+    std::vector<std::string> animationFiles;
+    std::vector<std::pair<std::string, std::string>> boneAliases;
+    bool crowdBenchmark = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--assimp")
+            Model::forceAssimp = true;
+        else if (arg == "--no-cooked")
+            Model::ignoreCooked = true;
+        else if (arg == "--animations" && i + 1 < argc)
+            animationFiles.push_back(argv[++i]);
+        else if (arg == "--crowd-benchmark")
+            crowdBenchmark = true;
+        else if (arg == "--bone-alias" && i + 1 < argc) {
+            // As source=target
+            std::string alias = argv[++i];
+            size_t split = alias.find('=');
+            if (split != std::string::npos)
+                boneAliases.push_back({ alias.substr(0, split), alias.substr(split + 1) });
+            else
+                log(WARN, "Expected --bone-alias source=target, got " + alias);
+        }
+    }
 
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_CAMERA);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
@@ -106,6 +129,12 @@ SDL_AppResult SDL_AppInit(void** state, int argc, char** argv)
 
     try {
         app->engine.init(windowWidth, windowHeight, frameWidth, frameHeight);
+        for (auto& [source, target] : boneAliases)
+            app->engine.aliasBone(source, target);
+        for (std::string& path : animationFiles)
+            app->engine.loadAnimations(path);
+        if (crowdBenchmark)
+            app->engine.benchmarkCrowd();
     } catch (std::string msg) {
         log(ERROR, msg);
     }
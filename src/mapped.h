@@ -0,0 +1,100 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(std::string path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw "Couldn't open " + path;
+
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            close(fd);
+            throw "Couldn't stat " + path;
+        }
+
+        length = info.st_size;
+        modified = info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec;
+        if (length > 0)
+            bytes = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // The mapping stays valid
+        if (bytes == MAP_FAILED) {
+            bytes = nullptr;
+            throw "Couldn't map " + path;
+        }
+    }
+
+    ~MappedFile()
+    {
+        if (bytes != nullptr)
+            munmap(bytes, length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Hint how the mapping will be read, e.g. MADV_SEQUENTIAL
+    void advise(int advice) const
+    {
+        if (bytes != nullptr)
+            madvise(bytes, length, advice);
+    }
+
+    const unsigned char* data() const { return (const unsigned char*)bytes; }
+    size_t size() const { return length; }
+    // When the file was last written, in nanoseconds since the epoch
+    int64_t modifiedTime() const { return modified; }
+private:
+    void* bytes = nullptr;
+    size_t length = 0;
+    int64_t modified = 0;
+};
+
+// FNV-1a, to tell whether a file changed
+inline uint64_t hashBytes(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+// Whether a file built from the source is still up to date, given the size,
+// modification time and hash of the source it recorded. The source is only
+// hashed when the size matches but the time doesn't, and touched is then set
+// when it's unchanged, so that the caller records the new time
+inline bool sameSource(
+    const MappedFile& source, uint64_t size, int64_t time, uint64_t hash, bool& touched
+) {
+    touched = false;
+    if (size != source.size())
+        return false;
+    if (time == source.modifiedTime())
+        return true;
+    touched = hashBytes(source.data(), source.size()) == hash;
+    return touched;
+}
+
+// Overwrite some bytes of a file in place, false when it can't be written
+inline bool writeAt(std::string path, size_t offset, const void* data, size_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd == -1)
+        return false;
+    bool written = pwrite(fd, data, size, offset) == ssize_t(size);
+    close(fd);
+    return written;
+}
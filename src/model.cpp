@@ -1,3 +1,11 @@
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
@@ -5,56 +13,211 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "convert.h"
+#include "cook.h"
+#include "crowd.h"
+#include "ik.h"
+#include "importio.h"
+#include "log.h"
+#include "mapped.h"
 #include "model.h"
+#include "optimizer.h"
+#include "pool.h"
+#include "packing.h"
+#include "picker.h"
+#include "skinning.h"
 
 struct ModelTransforms
 {
     glm::mat4 model;
-    glm::mat4 meshTransform;
-    glm::mat4 boneTransforms[];
+    PaletteBone boneTransforms[];
 };
 
+void Mesh::buildGpuData()
+{
+#ifdef PACKED_VERTICES
+    std::vector<PackedSkinVertex> skin;
+    for (SkinVertex& v : skinVertices)
+        skin.push_back(packSkinVertex(v, box));
+    std::vector<PackedShadingVertex> shading;
+    for (ShadingVertex& v : shadingVertices)
+        shading.push_back(packShadingVertex(v));
+#else
+    std::vector<SkinVertex>& skin = skinVertices;
+    std::vector<ShadingVertex>& shading = shadingVertices;
+#endif
+    skinSize = skin.size() * sizeof(skin[0]);
+    shadingSize = shading.size() * sizeof(shading[0]);
+
+    // Every level of detail shares one index buffer. The
+    // indexes are narrowed when they fit in 16 bits
+    std::vector<unsigned int> allIndexes = indexes;
+    allIndexes.insert(allIndexes.end(), lodIndexes.begin(), lodIndexes.end());
+    std::vector<uint16_t> narrow;
+    if (skinVertices.size() <= 65536) {
+        indexType = GL_UNSIGNED_SHORT;
+        narrow.assign(allIndexes.begin(), allIndexes.end());
+        indexesSize = narrow.size() * sizeof(uint16_t);
+    } else {
+        indexType = GL_UNSIGNED_INT;
+        indexesSize = allIndexes.size() * sizeof(unsigned int);
+    }
+
+    unsigned char* data = new unsigned char[skinSize + shadingSize + indexesSize];
+    memcpy(data, skin.data(), skinSize);
+    memcpy(data + skinSize, shading.data(), shadingSize);
+    memcpy(data + skinSize + shadingSize,
+           narrow.empty() ? (void*)allIndexes.data() : (void*)narrow.data(), indexesSize);
+    gpuData = std::shared_ptr<const unsigned char>(data, std::default_delete<unsigned char[]>());
+
+    shadingVertices.clear();
+    shadingVertices.shrink_to_fit();
+    lodIndexes.clear();
+    lodIndexes.shrink_to_fit();
+}
+
+void Mesh::buildMorphTable()
+{
+    if (morphDeltas.empty())
+        return;
+
+    // Counting sort of the deltas by vertex
+    morphOffsets.assign(skinVertices.size() + 1, 0);
+    for (unsigned int v : morphVertices)
+        morphOffsets[v + 1]++;
+    std::partial_sum(morphOffsets.begin(), morphOffsets.end(), morphOffsets.begin());
+
+    std::vector<uint32_t> next(morphOffsets.begin(), morphOffsets.end() - 1);
+    std::vector<MorphDelta> sorted(morphDeltas.size());
+    for (size_t i = 0; i < morphDeltas.size(); i++)
+        sorted[next[morphVertices[i]]++] = morphDeltas[i];
+    morphDeltas = std::move(sorted);
+    morphVertices.clear();
+    morphVertices.shrink_to_fit();
+}
+
+// Bucket of a vertex by the number of bones that move it. Like the
+// shader, the influences stop at the first missing bone
+static int influenceBucket(const SkinVertex& v)
+{
+    int count = 0;
+    for (int i = 0; i < 4 && v.boneIds[i] >= 0; i++) {
+        if (v.boneWeights[i] > 0.0)
+            count = i + 1;
+    }
+    return count <= 2 ? count : numInfluenceBuckets - 1;
+}
+
+void Mesh::bucketTriangles()
+{
+    std::vector<int> vertexBuckets;
+    for (SkinVertex& v : skinVertices)
+        vertexBuckets.push_back(influenceBucket(v));
+
+    // A stable partition, which keeps the vertex cache order within the buckets
+    auto partition = [&](unsigned int* triangles, MeshLod& level) {
+        std::vector<unsigned int> sorted[numInfluenceBuckets];
+        for (size_t i = 0; i < level.count; i += 3) {
+            int a = vertexBuckets[triangles[i]];
+            int b = vertexBuckets[triangles[i + 1]];
+            int c = vertexBuckets[triangles[i + 2]];
+            int bucket = std::max({ a, b, c });
+            if (std::min({ a, b, c }) == 0 && bucket > 0)
+                bucket = numInfluenceBuckets - 1; // Some unskinned vertices
+            sorted[bucket].insert(sorted[bucket].end(), triangles + i, triangles + i + 3);
+        }
+        for (int b = 0; b < numInfluenceBuckets; b++) {
+            level.buckets[b] = sorted[b].size();
+            std::copy(sorted[b].begin(), sorted[b].end(), triangles);
+            triangles += sorted[b].size();
+        }
+    };
+
+    // The full mesh's indexes come first, then the coarser levels'
+    for (MeshLod& level : lods) {
+        unsigned int* triangles = level.offset < indexes.size()
+            ? &indexes[level.offset]
+            : &lodIndexes[level.offset - indexes.size()];
+        partition(triangles, level);
+    }
+}
+
+// Upload bytes to a new buffer
+unsigned int createBuffer(int target, const unsigned char* data, size_t size)
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    return buffer;
+}
+
 void Mesh::init()
 {
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    const unsigned char* data = gpuData.get();
+    skinVbo = createBuffer(GL_ARRAY_BUFFER, data, skinSize);
+    shadingVbo = createBuffer(GL_ARRAY_BUFFER, data + skinSize, shadingSize);
+    ebo = createBuffer(GL_ELEMENT_ARRAY_BUFFER, data + skinSize + shadingSize, indexesSize);
+    if (!morphDeltas.empty()) {
+        morphOffsetsBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER,
+            (const unsigned char*)morphOffsets.data(), morphOffsets.size() * sizeof(uint32_t));
+        morphDeltasBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER,
+            (const unsigned char*)morphDeltas.data(), morphDeltas.size() * sizeof(MorphDelta));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    // Both vertex arrays share the skin stream
+    glGenVertexArrays(1, &vao);
+    glGenVertexArrays(1, &depthVao);
+    for (unsigned int array : { vao, depthVao }) {
+        glBindVertexArray(array);
+        glBindBuffer(GL_ARRAY_BUFFER, skinVbo);
+#ifdef PACKED_VERTICES
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedSkinVertex), (void*)offsetof(PackedSkinVertex, position));
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(PackedSkinVertex), (void*)offsetof(PackedSkinVertex, boneIds));
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedSkinVertex), (void*)offsetof(PackedSkinVertex, boneWeights));
+#else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, position));
+        glVertexAttribIPointer(4, 4, GL_INT, sizeof(SkinVertex), (void*)offsetof(SkinVertex, boneIds));
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, boneWeights));
+#endif
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(4);
+        glEnableVertexAttribArray(5);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    // Only the shading passes read the second stream
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, shadingVbo);
+#ifdef PACKED_VERTICES
+    glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, sizeof(PackedShadingVertex), (void*)offsetof(PackedShadingVertex, frame));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedShadingVertex), (void*)offsetof(PackedShadingVertex, coord));
+    glEnableVertexAttribArray(3);
+#else
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShadingVertex), (void*)offsetof(ShadingVertex, normal));
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ShadingVertex), (void*)offsetof(ShadingVertex, tangent));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, coord));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(ShadingVertex), (void*)offsetof(ShadingVertex, coord));
     glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(4, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIds));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
-    glEnableVertexAttribArray(5);
-
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes.size() * sizeof(unsigned int), indexes.data(), GL_STATIC_DRAW);
+#endif
 
     for (auto& [sampler, texture] : textures) {
         texture.init();
     }
 
-    vertices.clear(); // Won't need this anymore
     glBindVertexArray(0);
+    gpuData.reset();
 }
 
-void Mesh::draw(Shader& shader)
+void Mesh::draw(Shader& shader, bool preskinned, int instances, int bucket)
 {
     if (!initialized) {
         initialized = true;
         init();
     }
-    glBindVertexArray(vao);
+    glBindVertexArray(preskinned ? skinnedVao : vao);
 
     // Bind the texture samplers
     int index = 0;
@@ -67,18 +230,105 @@ void Mesh::draw(Shader& shader)
 
     // Draw
     shader.set<int>("material.hasNormal", textures.count("normal") > 0);
-    glDrawElements(GL_TRIANGLES, indexes.size(), GL_UNSIGNED_INT, 0);
+    drawLod(instances, bucket);
+}
+
+void Mesh::drawLod(int instances, int bucket)
+{
+    if (!morphDeltas.empty()) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, morphOffsetsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, morphDeltasBuffer);
+    }
+
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    MeshLod& l = lods[lod];
+    size_t offset = l.offset, count = l.count;
+    if (bucket != -1) {
+        for (int b = 0; b < bucket; b++)
+            offset += l.buckets[b];
+        count = l.buckets[bucket];
+    }
+    glDrawElementsInstanced(GL_TRIANGLES, count, indexType,
+                            (void*)(offset * indexSize), instances);
+}
+
+void Mesh::drawDepth(bool preskinned, int bucket)
+{
+    if (!initialized) {
+        initialized = true;
+        init();
+    }
+    glBindVertexArray(preskinned ? skinnedDepthVao : depthVao);
+    drawLod(1, bucket);
+}
+
+void Mesh::skin()
+{
+    if (!initialized) {
+        initialized = true;
+        init();
+    }
+
+    if (skinnedVbo == 0) {
+        skinnedVbo = createBuffer(GL_ARRAY_BUFFER, nullptr, skinVertices.size() * sizeof(SkinnedVertex));
+
+        // Same layout as the other arrays, the skinned stream replaces the skin stream
+        glGenVertexArrays(1, &skinnedVao);
+        glGenVertexArrays(1, &skinnedDepthVao);
+        for (unsigned int array : { skinnedVao, skinnedDepthVao }) {
+            glBindVertexArray(array);
+            glBindBuffer(GL_ARRAY_BUFFER, skinnedVbo);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, position));
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        }
+
+        glBindVertexArray(skinnedVao);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, tangent));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ARRAY_BUFFER, shadingVbo);
+#ifdef PACKED_VERTICES
+        glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedShadingVertex), (void*)offsetof(PackedShadingVertex, coord));
+#else
+        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(ShadingVertex), (void*)offsetof(ShadingVertex, coord));
+#endif
+        glEnableVertexAttribArray(3);
+        glBindVertexArray(0);
+    }
+
+    // The vertex buffers are read as storage buffers
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, skinVbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, shadingVbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, skinnedVbo);
+    if (!morphDeltas.empty()) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, morphOffsetsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, morphDeltasBuffer);
+    }
+    glDispatchCompute((skinVertices.size() + 63) / 64, 1, 1);
 }
 
 void Mesh::cleanup()
 {
     glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &depthVao);
+    glDeleteBuffers(1, &skinVbo);
+    glDeleteBuffers(1, &shadingVbo);
     glDeleteBuffers(1, &ebo);
+    if (!morphDeltas.empty()) {
+        glDeleteBuffers(1, &morphOffsetsBuffer);
+        glDeleteBuffers(1, &morphDeltasBuffer);
+    }
+    if (skinnedVbo != 0) {
+        glDeleteVertexArrays(1, &skinnedVao);
+        glDeleteVertexArrays(1, &skinnedDepthVao);
+        glDeleteBuffers(1, &skinnedVbo);
+    }
 }
 
 Model::Model(
-    TextureLoader* loader,
+    TextureLoader* loader, AnimationLibrary* library,
     std::string id, std::string path, std::string basePath
 ) {
     name = id;
@@ -87,21 +337,73 @@ Model::Model(
     scale = glm::vec3(1.0);
     position = glm::vec3(0.0);
 
-    Assimp::Importer importer;
+    textureLoader = loader;
+    animationLibrary = library;
+
+    // Skip importing when the model was already cooked from this exact file
+    auto start = std::chrono::steady_clock::now();
+    std::string cookedPath = path + ".cooked";
+    MappedFile source(path);
+    std::string importedWith = "cooked file";
+    if (ignoreCooked || !loadCooked(cookedPath, source)) {
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        for (char& c : extension) c = tolower(c);
+
+        // The embedded textures point into the mappings or
+        // the Assimp scene, which are kept until they're cooked
+        std::vector<std::shared_ptr<MappedFile>> mappings;
+        Assimp::Importer importer;
+        importedWith = "Assimp";
+        if (!forceAssimp && (extension == "gltf" || extension == "glb")) {
+            try {
+                loadGltf(path, source, mappings);
+                importedWith = "glTF loader";
+            } catch (std::string msg) {
+                log(WARN, path + ": " + msg + ", falling back to Assimp");
+                meshes.clear();
+                box = BoundingBox();
+            }
+        }
+        if (importedWith == "Assimp")
+            loadAssimp(path, importer);
+
+        cook(cookedPath, source);
+        for (Mesh& mesh : meshes)
+            mesh.textureRefs.clear(); // Point into the source
+    }
+
+    animator.share(*animationLibrary);
+
+    // Peak RSS is the whole process's, so it's only telling for the first model
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    char stats[128];
+    snprintf(stats, sizeof(stats), " in %.1f ms, peak RSS %.1f MB",
+             elapsed.count(), usage.ru_maxrss / 1024.0);
+    log(DEBUG, "Loaded " + name + " with the " + importedWith + stats);
+}
+
+void Model::loadAssimp(std::string path, Assimp::Importer& importer)
+{
+    // The importer owns and deletes both handlers
+    importer.SetIOHandler(new MappedIOSystem());
+    ImportTimer* timer = new ImportTimer();
+    importer.SetProgressHandler(timer);
+
     unsigned int flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
                          aiProcess_CalcTangentSpace | aiProcess_FlipUVs |
-                         aiProcess_GenBoundingBoxes;
+                         aiProcess_GenBoundingBoxes | aiProcess_JoinIdenticalVertices;
     const aiScene* scene = importer.ReadFile(path, flags);
     if (scene == nullptr)
         throw std::string(importer.GetErrorString());
 
     if (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         throw std::string("Invalid model file");
+    log(DEBUG, name + ": " + timer->report());
 
     animator.load(scene);
-    textureLoader = loader;
-
-    processNode(scene, scene->mRootNode);
+    processMeshes(scene);
 }
 
 void Model::cleanup()
@@ -109,6 +411,9 @@ void Model::cleanup()
     for (Mesh& mesh : meshes) {
         mesh.cleanup();
     }
+
+    if (transformsBuffer != UINT_MAX)
+        glDeleteBuffers(1, &transformsBuffer);
 }
 
 void Model::setPosition(glm::vec3 v) { position = v; }
@@ -142,18 +447,54 @@ void Model::setSize(glm::vec3 size, bool preserveAspectRatio)
     }
 }
 
-void Model::processNode(const aiScene* scene, const aiNode* node)
+// Record the order the meshes are drawn in, which is the
+// order the animation computes the mesh transforms in
+void Model::processNode(const aiNode* node, std::vector<unsigned int>& order)
 {
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        processMesh(scene, scene->mMeshes[node->mMeshes[i]]);
+        order.push_back(node->mMeshes[i]);
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(scene, node->mChildren[i]);
+        processNode(node->mChildren[i], order);
     }
 }
 
-void Model::addBoneToVertex(Vertex& v, int boneId, float weight)
+void Model::processMeshes(const aiScene* scene)
+{
+    std::vector<unsigned int> order;
+    processNode(scene->mRootNode, order);
+
+    // Only process the meshes that are drawn, each of them once
+    std::vector<bool> used(scene->mNumMeshes, false);
+    for (unsigned int i : order)
+        used[i] = true;
+
+    std::vector<Mesh> processed(scene->mNumMeshes);
+    std::vector<std::string> reports(scene->mNumMeshes);
+    parallelFor(scene->mNumMeshes, [&](size_t i) {
+        if (used[i])
+            reports[i] = processMesh(scene->mMeshes[i], processed[i]);
+    });
+
+    // The texture loader isn't thread safe
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+        if (!used[i]) continue;
+        aiMesh* data = scene->mMeshes[i];
+        Mesh& mesh = processed[i];
+        mesh.textureRefs = textureLoader->references(
+                scene, scene->mMaterials[data->mMaterialIndex]);
+        mesh.textures = textureLoader->get(mesh.textureRefs, textureBasePath);
+        box.update(mesh.box);
+        log(DEBUG, name + "/" + data->mName.C_Str() + reports[i]);
+    }
+
+    meshes.reserve(order.size());
+    for (unsigned int i : order)
+        meshes.push_back(processed[i]);
+}
+
+void Model::addBoneToVertex(SkinVertex& v, int boneId, float weight)
 {
     // Each bone has at most 4 bones that can influence it
     for (int i = 0; i < 4; i++) {
@@ -171,94 +512,783 @@ void Model::getBoneWeights(aiMesh* data, Mesh& mesh)
         aiBone* bone = data->mBones[i];
         std::string name = std::string(bone->mName.C_Str());
         int boneId = animator.getBoneId(name);
+        if (boneId == -1) continue;
+#ifdef PACKED_VERTICES
+        if (boneId > 255)
+            throw std::string("Too many bones for the packed vertex format");
+#endif
 
         for (unsigned int j = 0; j < bone->mNumWeights; j++) {
             float weight = bone->mWeights[j].mWeight;
             int vertexIndex = bone->mWeights[j].mVertexId;
-            addBoneToVertex(mesh.vertices[vertexIndex], boneId, weight);
+            addBoneToVertex(mesh.skinVertices[vertexIndex], boneId, weight);
+        }
+    }
+}
+
+void Model::addMorphDelta(Mesh& mesh, int target, unsigned int vertex,
+                          glm::vec3 position, glm::vec3 normal)
+{
+    // Only the vertices a target moves get a delta
+    const float threshold = 1e-6;
+    if (glm::length(position) < threshold && glm::length(normal) < threshold)
+        return;
+    mesh.morphDeltas.push_back(packMorphDelta(target, position, normal));
+    mesh.morphVertices.push_back(vertex);
+}
+
+void Model::getMorphTargets(aiMesh* data, Mesh& mesh)
+{
+    if (data->mNumAnimMeshes > (unsigned int)maxMorphTargets)
+        log(WARN, name + "/" + data->mName.C_Str() + ": dropping the morph targets past " +
+                  std::to_string(maxMorphTargets));
+
+    // Assimp's targets replace the positions and normals, they're stored as offsets
+    unsigned int numTargets = std::min(data->mNumAnimMeshes, (unsigned int)maxMorphTargets);
+    for (unsigned int t = 0; t < numTargets; t++) {
+        aiAnimMesh* target = data->mAnimMeshes[t];
+        mesh.morphWeights.push_back(target->mWeight);
+        for (unsigned int i = 0; i < data->mNumVertices && i < target->mNumVertices; i++) {
+            glm::vec3 position(0.0), normal(0.0);
+            if (target->HasPositions())
+                position = toVec3(target->mVertices[i]) - toVec3(data->mVertices[i]);
+            if (target->HasNormals() && data->HasNormals())
+                normal = toVec3(target->mNormals[i]) - toVec3(data->mNormals[i]);
+            addMorphDelta(mesh, t, i, position, normal);
+        }
+    }
+}
+
+void Model::computeBoneBounds(Mesh& mesh)
+{
+    std::unordered_map<int, BoundingBox> boxes;
+    for (SkinVertex& v : mesh.skinVertices) {
+        for (int i = 0; i < 4; i++) {
+            if (v.boneIds[i] == -1) break;
+            boxes[v.boneIds[i]].update(v.position);
+        }
+    }
+
+    for (auto& [boneId, box] : boxes) {
+        mesh.boneBounds.push_back({ boneId, box });
+    }
+}
+
+std::string Model::optimizeMesh(Mesh& mesh)
+{
+    size_t numVertices = mesh.skinVertices.size();
+    CacheStats before = analyzeVertexCache(mesh.indexes, numVertices);
+
+    std::vector<glm::vec3> positions;
+    for (SkinVertex& v : mesh.skinVertices)
+        positions.push_back(v.position);
+    std::vector<unsigned int> clusters = optimizeVertexCache(mesh.indexes, numVertices);
+    optimizeOverdraw(mesh.indexes, positions, clusters);
+
+    std::vector<int> remap = optimizeVertexFetch(mesh.indexes, numVertices);
+    remapVertices(mesh.skinVertices, remap);
+    remapVertices(mesh.shadingVertices, remap);
+
+    // The deltas of vertices that no triangle uses are dropped
+    size_t kept = 0;
+    for (size_t i = 0; i < mesh.morphDeltas.size(); i++) {
+        int v = remap[mesh.morphVertices[i]];
+        if (v == -1) continue;
+        mesh.morphVertices[kept] = v;
+        mesh.morphDeltas[kept++] = mesh.morphDeltas[i];
+    }
+    mesh.morphVertices.resize(kept);
+    mesh.morphDeltas.resize(kept);
+
+    CacheStats after = analyzeVertexCache(mesh.indexes, mesh.skinVertices.size());
+    char stats[128];
+    snprintf(stats, sizeof(stats), ": ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+             before.acmr, after.acmr, before.atvr, after.atvr);
+    return stats;
+}
+
+void Model::generateLods(Mesh& mesh)
+{
+    const int maxLods = 6;
+    const size_t minTriangles = 64;
+
+    mesh.lod = 0;
+    mesh.lods = { { 0, mesh.indexes.size(), 0.0, {} } };
+
+    // Vertices only collapse onto ones mostly moved by the same bone
+    std::vector<int> groups;
+    std::vector<glm::vec3> positions;
+    for (SkinVertex& v : mesh.skinVertices) {
+        int dominant = 0;
+        for (int i = 1; i < 4; i++) {
+            if (v.boneWeights[i] > v.boneWeights[dominant])
+                dominant = i;
         }
+        groups.push_back(v.boneIds[dominant]);
+        positions.push_back(v.position);
+    }
+
+    // Halve the triangles at every level, until it stops making progress
+    std::vector<unsigned int> previous = mesh.indexes;
+    float error = 0.0;
+    while ((int)mesh.lods.size() < maxLods && previous.size() / 3 > minTriangles) {
+        float stepError = 0.0;
+        size_t target = previous.size() / 6 * 3;
+        std::vector<unsigned int> lodIndexes =
+            simplify(previous, positions, groups, target, stepError);
+        if (lodIndexes.size() > previous.size() * 0.9)
+            break;
+        optimizeVertexCache(lodIndexes, positions.size());
+
+        // The errors of the successive simplifications add up at worst
+        error += stepError;
+        mesh.lods.push_back({
+            mesh.indexes.size() + mesh.lodIndexes.size(), lodIndexes.size(), error, {}
+        });
+        mesh.lodIndexes.insert(mesh.lodIndexes.end(), lodIndexes.begin(), lodIndexes.end());
+        previous = std::move(lodIndexes);
     }
 }
 
-void Model::processMesh(const aiScene* scene, aiMesh* data)
+std::string Model::processMesh(aiMesh* data, Mesh& mesh)
 {
-    Mesh mesh;
     mesh.initialized = false;
-    mesh.textures = textureLoader->get(
-            scene, scene->mMaterials[data->mMaterialIndex], textureBasePath);
 
+    size_t numIndexes = 0;
+    for (unsigned int i = 0; i < data->mNumFaces; i++)
+        numIndexes += data->mFaces[i].mNumIndices;
+    mesh.indexes.resize(numIndexes);
+    size_t index = 0;
     for (unsigned int i = 0; i < data->mNumFaces; i++) {
         for (unsigned int j = 0; j < data->mFaces[i].mNumIndices; j++) {
-            mesh.indexes.push_back(data->mFaces[i].mIndices[j]);
+            mesh.indexes[index++] = data->mFaces[i].mIndices[j];
         }
     }
 
+    mesh.skinVertices.resize(data->mNumVertices);
+    mesh.shadingVertices.resize(data->mNumVertices);
     for (unsigned int i = 0; i < data->mNumVertices; i++) {
-        Vertex v;
-        v.boneIds = glm::ivec4(-1.0);
-        v.boneWeights = glm::vec4(0.0);
-        v.position = toVec3(data->mVertices[i]);
+        SkinVertex& skin = mesh.skinVertices[i];
+        skin.boneIds = glm::ivec4(-1.0);
+        skin.boneWeights = glm::vec4(0.0);
+        skin.position = toVec3(data->mVertices[i]);
+
+        ShadingVertex& v = mesh.shadingVertices[i];
         if (data->HasNormals())
             v.normal = toVec3(data->mNormals[i]);
 
         // The tangent is derived from the texture coordinate, so if there's
-        // no texture coordinate, there can't be a tangent. If the tangent is
-        // made to default to (0, 0, 0), the TBN matrix will be singular, which
-        // would fuck up the lighting calculations. So, the tangent is better
-        // off as randomly initialized.
+        // no texture coordinate, there can't be a tangent
         if (data->mTextureCoords[0]) {
             v.coord = toVec2(data->mTextureCoords[0][i]);
             v.tangent = toVec3(data->mTangents[i]);
         } else {
             v.coord = glm::vec2(0, 0);
-            v.tangent = glm::vec3(rand(), rand(), rand());
+            v.tangent = fallbackTangent(v.normal);
         }
-
-        mesh.vertices.push_back(v);
     }
 
-    box.update(toVec3(data->mAABB.mMin));
-    box.update(toVec3(data->mAABB.mMax));
+    mesh.box.update(toVec3(data->mAABB.mMin));
+    mesh.box.update(toVec3(data->mAABB.mMax));
     getBoneWeights(data, mesh);
+    getMorphTargets(data, mesh);
+    return prepareMesh(mesh);
+}
+
+std::string Model::prepareMesh(Mesh& mesh)
+{
+    std::string report = optimizeMesh(mesh);
+    mesh.buildMorphTable();
+    generateLods(mesh);
+    mesh.bucketTriangles();
+    mesh.buildGpuData();
+    computeBoneBounds(mesh);
+    return report;
+}
 
-    meshes.push_back(std::move(mesh));
+void Model::animate(double timeInSeconds, PoseCache* cache)
+{
+    // Pick up the clips added to the library since the last frame
+    animator.share(*animationLibrary);
+    animator.run(timeInSeconds, cache);
+}
+
+void Model::publishPose()
+{
+    publishedPoses[0] = publishedPoses[1];
+    publishedPoses[1] = animator.snapshot();
+}
+
+void Model::latchPoses()
+{
+    latchedPoses[0] = publishedPoses[0];
+    latchedPoses[1] = publishedPoses[1];
+    interpolating = true;
+}
+
+void Model::interpolatePose(float factor)
+{
+    if (latchedPoses[1] == nullptr)
+        return; // Nothing published yet
+    interpolatePoses(latchedPoses[0] ? *latchedPoses[0] : *latchedPoses[1],
+                     *latchedPoses[1], factor, interpolatedPose);
 }
 
-void Model::draw(Shader& shader, double timeInSeconds)
+void Model::stopInterpolating()
 {
-    // Initial the shader storage buffer object
-    if (!shader.haveBuffer(name)) {
+    interpolating = false;
+    for (int i = 0; i < 2; i++)
+        publishedPoses[i] = latchedPoses[i] = nullptr;
+}
+
+const Pose* Model::currentPose()
+{
+    if (!interpolating)
+        return animator.current();
+    return latchedPoses[1] ? &interpolatedPose : nullptr;
+}
+
+void Model::upload()
+{
+    preskinned = false;
+
+    // Initialize the shader storage buffer object
+    if (transformsBuffer == UINT_MAX) {
         int maxPossibleSize =
-            sizeof(glm::mat4) * (animator.getNumBoneTransforms() + 2);
-        shader.createBuffer(name, 1, maxPossibleSize);
+            sizeof(glm::mat4) + sizeof(PaletteBone) * animator.getNumBoneTransforms();
+        glGenBuffers(1, &transformsBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, maxPossibleSize, nullptr, GL_DYNAMIC_DRAW);
     }
-    shader.bindBuffer(name);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, transformsBuffer);
 
     // Set the value of the model matrix
+    glm::mat4 transform = getTransform();
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(ModelTransforms, model),
+                    sizeof(transform), glm::value_ptr(transform));
+
+    // Upload the whole bone palette at once
+    const Pose* pose = currentPose();
+    if (pose != nullptr && !pose->palette.empty()) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                        offsetof(ModelTransforms, boneTransforms),
+                        pose->palette.size() * sizeof(PaletteBone),
+                        pose->palette.data());
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Model::drawDepth(ShaderVariants& programs)
+{
+    if (transformsBuffer == UINT_MAX)
+        return; // Hasn't been updated yet
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, transformsBuffer);
+
+    if (preskinned) {
+        programs.unspecialized().use();
+        for (Mesh& mesh : meshes)
+            mesh.drawDepth(true);
+        return;
+    }
+
+    const Pose* pose = currentPose();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        MeshLod& level = meshes[i].lods[meshes[i].lod];
+        for (int b = 0; b < numInfluenceBuckets; b++) {
+            if (level.buckets[b] == 0) continue;
+            programs[b].use();
+            setMeshUniforms(programs[b], i, pose);
+            meshes[i].drawDepth(false, b);
+        }
+    }
+}
+
+void Model::draw(ShaderVariants& programs)
+{
+    if (transformsBuffer == UINT_MAX)
+        return; // Hasn't been updated yet
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, transformsBuffer);
+
+    if (preskinned) {
+        programs.unspecialized().use();
+        for (Mesh& mesh : meshes)
+            mesh.draw(programs.unspecialized(), true);
+        return;
+    }
+
+    const Pose* pose = currentPose();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        MeshLod& level = meshes[i].lods[meshes[i].lod];
+        for (int b = 0; b < numInfluenceBuckets; b++) {
+            if (level.buckets[b] == 0) continue;
+            programs[b].use();
+            setMeshUniforms(programs[b], i, pose);
+            meshes[i].draw(programs[b], false, 1, b);
+        }
+    }
+}
+
+void Model::skin(Shader& shader)
+{
+    if (transformsBuffer == UINT_MAX)
+        return; // Hasn't been updated yet
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, transformsBuffer);
+
+    const Pose* pose = currentPose();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        setMeshUniforms(shader, i, pose);
+        shader.set<int>("numVertices", meshes[i].skinVertices.size());
+        meshes[i].skin();
+    }
+    preskinned = true;
+}
+
+void Model::cook(std::string cookedPath, const MappedFile& source)
+{
+    CookWriter writer;
+    CookedHeader header = {};
+    memcpy(header.magic, "MOCH", 4);
+    header.version = cookedVersion;
+#ifdef PACKED_VERTICES
+    header.packedVertices = 1;
+#endif
+    header.sourceHash = hashBytes(source.data(), source.size());
+    header.sourceSize = source.size();
+    header.sourceTime = source.modifiedTime();
+
+    animator.cook(writer, header);
+
+    std::vector<CookedMesh> cookedMeshes;
+    for (Mesh& mesh : meshes) {
+        std::vector<CookedTexture> textures;
+        for (TextureRef& ref : mesh.textureRefs) {
+            CookedTexture t = {};
+            t.sampler = writer.write(ref.sampler);
+            t.path = writer.write(ref.path);
+            if (ref.embedded != nullptr) {
+                size_t size = ref.height == 0 ? ref.width : ref.width * ref.height * sizeof(aiTexel);
+                t.embedded = writer.write(ref.embedded, size);
+            }
+            t.width = ref.width;
+            t.height = ref.height;
+            textures.push_back(t);
+        }
+
+        CookedMesh m = {};
+        m.box = mesh.box;
+        m.indexType = mesh.indexType;
+        m.textures = writer.write(textures);
+        m.skinVertices = writer.write(mesh.skinVertices);
+        m.indexes = writer.write(mesh.indexes);
+        m.lods = writer.write(mesh.lods);
+        m.boneBounds = writer.write(mesh.boneBounds);
+        m.gpuData = writer.write(
+            mesh.gpuData.get(), mesh.skinSize + mesh.shadingSize + mesh.indexesSize);
+        m.skinSize = mesh.skinSize;
+        m.shadingSize = mesh.shadingSize;
+        m.indexesSize = mesh.indexesSize;
+        m.morphOffsets = writer.write(mesh.morphOffsets);
+        m.morphDeltas = writer.write(mesh.morphDeltas);
+        m.morphWeights = writer.write(mesh.morphWeights);
+        cookedMeshes.push_back(m);
+    }
+    header.meshes = writer.write(cookedMeshes);
+    memcpy(writer.bytes.data(), &header, sizeof(header));
+    writer.save(cookedPath);
+}
+
+bool Model::loadCooked(std::string cookedPath, const MappedFile& source)
+{
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(cookedPath);
+    } catch (std::string) {
+        return false; // Hasn't been cooked yet
+    }
+
+    try {
+        CookReader reader(file);
+        const CookedHeader& header = reader.header();
+#ifdef PACKED_VERTICES
+        uint32_t packedVertices = 1;
+#else
+        uint32_t packedVertices = 0;
+#endif
+        if (memcmp(header.magic, "MOCH", 4) != 0 ||
+            header.version != cookedVersion ||
+            header.packedVertices != packedVertices)
+            return false; // Stale
+
+        bool touched;
+        if (!sameSource(source, header.sourceSize, header.sourceTime, header.sourceHash, touched))
+            return false;
+        if (touched) {
+            // Written but unchanged, so the next launches don't hash it again
+            int64_t time = source.modifiedTime();
+            writeAt(cookedPath, offsetof(CookedHeader, sourceTime), &time, sizeof(time));
+        }
+
+        animator.loadCooked(reader);
+
+        const CookedMesh* cookedMeshes = reader.get<CookedMesh>(header.meshes);
+        for (size_t i = 0; i < header.meshes.count; i++) {
+            const CookedMesh& m = cookedMeshes[i];
+            Mesh mesh;
+            mesh.initialized = false;
+            mesh.lod = 0;
+            mesh.box = m.box;
+            mesh.indexType = m.indexType;
+
+            // The embedded textures get decoded straight from the mapping
+            std::vector<TextureRef> refs;
+            const CookedTexture* textures = reader.get<CookedTexture>(m.textures);
+            for (size_t j = 0; j < m.textures.count; j++) {
+                TextureRef ref;
+                ref.sampler = reader.string(textures[j].sampler);
+                ref.path = reader.string(textures[j].path);
+                if (textures[j].embedded.count > 0)
+                    ref.embedded = reader.get<unsigned char>(textures[j].embedded);
+                ref.width = textures[j].width;
+                ref.height = textures[j].height;
+                refs.push_back(ref);
+            }
+            mesh.textures = textureLoader->get(refs, textureBasePath);
+
+            mesh.skinVertices = reader.array<SkinVertex>(m.skinVertices);
+            mesh.indexes = reader.array<unsigned int>(m.indexes);
+            mesh.lods = reader.array<MeshLod>(m.lods);
+            mesh.boneBounds = reader.array<BoneBounds>(m.boneBounds);
+
+            // Uploaded from the mapping, which is kept alive until then
+            if (m.skinSize + m.shadingSize + m.indexesSize != m.gpuData.count)
+                throw std::string("Cooked mesh has an invalid size");
+            mesh.gpuData = reader.share(m.gpuData);
+            mesh.skinSize = m.skinSize;
+            mesh.shadingSize = m.shadingSize;
+            mesh.indexesSize = m.indexesSize;
+
+            mesh.morphDeltas = reader.array<MorphDelta>(m.morphDeltas);
+            mesh.morphWeights = reader.array<float>(m.morphWeights);
+            mesh.morphOffsets = reader.array<uint32_t>(m.morphOffsets);
+            if (!mesh.morphDeltas.empty() && mesh.morphOffsets.size() != mesh.skinVertices.size() + 1)
+                throw std::string("Cooked mesh has invalid morph targets");
+
+            box.update(mesh.box);
+            meshes.push_back(std::move(mesh));
+        }
+    } catch (std::string msg) {
+        log(WARN, cookedPath + ": " + msg);
+        meshes.clear();
+        box = BoundingBox();
+        return false;
+    }
+
+    return true;
+}
+
+void Model::bakeAnimations(float framesPerSecond, int maxSize, BakedAnimations& baked)
+{
+    int numBones = animator.getNumBoneTransforms();
+    int slots = numBones + meshes.size();
+    baked.width = slots * 3;
+    baked.rows = 0;
+    baked.texels.clear();
+    baked.clips.clear();
+    if (baked.width > maxSize)
+        throw std::string(name + ": too many bones to bake");
+
+    std::vector<std::string> names = animator.animationNames();
+    for (size_t a = 0; a < names.size(); a++) {
+        if (animator.sample(a, 0.0) == nullptr) {
+            log(WARN, name + ": " + names[a] + " is streamed, it can't be baked");
+            continue;
+        }
+
+        double seconds = animator.clipSeconds(a);
+        int frames = std::max(1, int(ceil(seconds * framesPerSecond)));
+        if (baked.rows + frames + 1 > maxSize) {
+            log(WARN, name + ": the baked texture is full, " + names[a] +
+                      " and the clips after it are left out");
+            break;
+        }
+
+        baked.clips.push_back({ baked.rows, frames, float(seconds), int(a) });
+        for (int f = 0; f <= frames; f++) {
+            Pose* pose = animator.sample(a, seconds * f / frames);
+            for (int s = 0; s < slots; s++) {
+                glm::mat4 m = s < numBones
+                    ? pose->boneTransforms[s]
+                    : getMeshTransform(s - numBones, pose);
+                for (int r = 0; r < 3; r++) {
+                    for (int c = 0; c < 4; c++)
+                        baked.texels.push_back(m[c][r]);
+                }
+            }
+            baked.rows++;
+        }
+    }
+}
+
+void Model::flattenAnimations(AnimationTables& tables)
+{
+    animator.flatten(meshes.size(), tables);
+}
+
+void Model::drawInstanced(Shader& shader, int count)
+{
+    for (size_t i = 0; i < meshes.size(); i++) {
+        setMeshUniforms(shader, i, nullptr);
+        shader.set<int>("meshSlot", animator.getNumBoneTransforms() + i);
+        meshes[i].draw(shader, false, count);
+    }
+}
+
+int Model::bindLimbs(KeypointSolver& solver)
+{
+    return solver.bind(animator.getNodes());
+}
+
+IkStats Model::poseFromKeypoints(
+    KeypointSolver& solver, const std::vector<Keypoint>& keypoints,
+    glm::vec2 frameSize, double budgetMilliseconds
+) {
+    PoseOverrides overrides;
+    IkStats stats = solver.solve(keypoints, frameSize, animator.getNodes(),
+                                 animator.getGlobalTransforms(), budgetMilliseconds, overrides);
+    animator.setOverrides(overrides);
+    return stats;
+}
+
+void Model::clearPoseOverrides()
+{
+    animator.setOverrides(PoseOverrides());
+}
+
+void Model::setMeshUniforms(Shader& shader, size_t meshIndex, const Pose* pose)
+{
+    shader.set<glm::mat4>("meshTransform", getMeshTransform(meshIndex, pose));
+    bool hasMorphTargets = !meshes[meshIndex].morphDeltas.empty();
+    shader.set<int>("hasMorphTargets", hasMorphTargets);
+    if (hasMorphTargets)
+        shader.set<std::vector<float>>("morphWeights", getMorphWeights(meshIndex, pose));
+#ifdef PACKED_VERTICES
+    // Bounds to dequantize the positions with
+    BoundingBox& b = meshes[meshIndex].box;
+    shader.set<glm::vec3>("positionOffset", b.min);
+    shader.set<glm::vec3>("positionScale", b.max - b.min);
+#endif
+}
+
+void Model::selectLod(float screenSize, float maxPixelError)
+{
+    float size = glm::length(box.max - box.min);
+    float pixelsPerUnit = size > 0.0 ? screenSize / size : 0.0;
+
+    for (Mesh& mesh : meshes) {
+        mesh.lod = 0;
+        for (size_t i = 1; i < mesh.lods.size(); i++) {
+            if (mesh.lods[i].error * pixelsPerUnit > maxPixelError)
+                break;
+            mesh.lod = i;
+        }
+    }
+}
+
+int Model::triangleCount()
+{
+    int count = 0;
+    for (Mesh& mesh : meshes)
+        count += mesh.lods[mesh.lod].count / 3;
+    return count;
+}
+
+glm::mat4 Model::getTransform()
+{
     glm::mat4 transform = glm::mat4(1.0);
     transform = glm::translate(transform, position);
     transform = glm::scale(transform, scale);
-    shader.writeBuffer(name, glm::value_ptr(transform), offsetof(ModelTransforms, model), sizeof(transform));
+    return transform;
+}
+
+glm::mat4 Model::getMeshTransform(size_t meshIndex, const Pose* pose)
+{
+    if (pose == nullptr || meshIndex >= pose->meshTransforms.size())
+        return glm::mat4(1.0);
+    return pose->meshTransforms[meshIndex];
+}
 
-    Animation* animation = animator.run(timeInSeconds);
+std::vector<float> Model::getMorphWeights(size_t meshIndex, const Pose* pose)
+{
+    std::vector<float> weights = meshes[meshIndex].morphWeights;
+    if (pose != nullptr && meshIndex < pose->morphWeights.size() &&
+        !pose->morphWeights[meshIndex].empty())
+        weights = pose->morphWeights[meshIndex];
+    weights.resize(std::min<size_t>(weights.size(), maxMorphTargets));
+    return weights;
+}
+
+std::vector<glm::vec3> Model::skinPositions(size_t meshIndex, const Pose* pose)
+{
+    Mesh& mesh = meshes[meshIndex];
+    size_t count = mesh.skinVertices.size();
+
+    // The morph targets move the positions before they're skinned
+    std::vector<glm::vec3> morphed;
+    if (!mesh.morphDeltas.empty()) {
+        std::vector<float> morphWeights = getMorphWeights(meshIndex, pose);
+        morphed.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            morphed[i] = mesh.skinVertices[i].position;
+            for (uint32_t d = mesh.morphOffsets[i]; d < mesh.morphOffsets[i + 1]; d++) {
+                const MorphDelta& delta = mesh.morphDeltas[d];
+                if (delta.target < morphWeights.size())
+                    morphed[i] += morphWeights[delta.target] * unpackMorphPosition(delta);
+            }
+        }
+    }
+
+    static const std::vector<glm::mat4> noBones;
+    std::vector<glm::vec3> positions(count);
+    skinMeshPositions(
+        mesh.skinVertices.data(), morphed.empty() ? nullptr : morphed.data(), count,
+        pose != nullptr ? pose->boneTransforms : noBones,
+        getMeshTransform(meshIndex, pose), positions.data());
+    return positions;
+}
+
+std::vector<std::vector<glm::vec3>> Model::skinMeshes()
+{
+    const Pose* pose = currentPose();
+    std::vector<std::vector<glm::vec3>> positions(meshes.size());
+    parallelFor(meshes.size(), [&](size_t i) {
+        positions[i] = skinPositions(i, pose);
+    });
+    return positions;
+}
+
+float Model::compareSkinning()
+{
+    if (!preskinned)
+        return -1; // The compute pass didn't run this frame
+
+    std::vector<std::vector<glm::vec3>> cpu = skinMeshes();
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    float largest = 0.0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::vector<SkinnedVertex> gpu(cpu[i].size());
+        glBindBuffer(GL_ARRAY_BUFFER, meshes[i].skinnedVbo);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpu.size() * sizeof(SkinnedVertex), gpu.data());
+        for (size_t v = 0; v < gpu.size(); v++)
+            largest = std::max(largest, glm::length(gpu[v].position - cpu[i][v]));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return largest;
+}
+
+void Model::exportObj(std::string path)
+{
+    std::ofstream file(path);
+    if (!file.good())
+        throw std::string("Couldn't write " + path);
+
+    // In world space, one object per mesh
+    glm::mat4 transform = getTransform();
+    std::vector<std::vector<glm::vec3>> positions = skinMeshes();
+    size_t firstVertex = 1;
+    char line[128];
+    for (size_t i = 0; i < meshes.size(); i++) {
+        file << "o " << name << "#" << i << "\n";
+        for (glm::vec3& p : positions[i]) {
+            glm::vec3 world = glm::vec3(transform * glm::vec4(p, 1.0));
+            snprintf(line, sizeof(line), "v %f %f %f\n", world.x, world.y, world.z);
+            file << line;
+        }
+
+        std::vector<unsigned int>& indexes = meshes[i].indexes;
+        for (size_t j = 0; j + 2 < indexes.size(); j += 3) {
+            snprintf(line, sizeof(line), "f %zu %zu %zu\n", firstVertex + indexes[j],
+                     firstVertex + indexes[j + 1], firstVertex + indexes[j + 2]);
+            file << line;
+        }
+        firstVertex += positions[i].size();
+    }
+
+    if (!file.good())
+        throw std::string("Couldn't write " + path);
+}
+
+BoundingBox Model::getWorldBounds()
+{
+    const Pose* pose = currentPose();
+    BoundingBox local;
 
     for (size_t i = 0; i < meshes.size(); i++) {
         Mesh& mesh = meshes[i];
+        glm::mat4 meshTransform = getMeshTransform(i, pose);
 
-        if (animation != nullptr) {
-            for (size_t j = 0; j < animation->boneTransforms.size(); j++) {
-                glm::mat4& t = animation->boneTransforms[j];
-                int offset = offsetof(ModelTransforms, boneTransforms) + j * sizeof(glm::mat4);
-                shader.writeBuffer(name, glm::value_ptr(t), offset, sizeof(t));
-            }
+        if (pose == nullptr || mesh.boneBounds.empty()) {
+            local.update(mesh.box.transform(meshTransform));
+            continue;
+        }
+
+        for (BoneBounds& b : mesh.boneBounds) {
+            glm::mat4 t = pose->boneTransforms[b.boneId] * meshTransform;
+            local.update(b.box.transform(t));
+        }
+    }
+
+    return local.transform(getTransform());
+}
+
+bool Model::intersect(Ray ray, bool exact, float& distance)
+{
+    // Move the ray into model space. The direction is left unnormalized
+    // so that distances along it are the same as in world space
+    glm::mat4 inverse = glm::inverse(getTransform());
+    Ray local = {
+        glm::vec3(inverse * glm::vec4(ray.origin, 1.0)),
+        glm::vec3(inverse * glm::vec4(ray.direction, 0.0))
+    };
+
+    const Pose* pose = currentPose();
+    bool hit = false;
+    distance = std::numeric_limits<float>::max();
 
-            glm::mat4& t = animation->meshTransforms[i];
-            shader.writeBuffer(name, glm::value_ptr(t), offsetof(ModelTransforms, meshTransform), sizeof(t));
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh& mesh = meshes[i];
+        glm::mat4 meshTransform = getMeshTransform(i, pose);
+
+        // Broad phase against the bounds of each bone
+        float closestBox = -1;
+        if (pose == nullptr || mesh.boneBounds.empty()) {
+            closestBox = intersectBox(local, mesh.box.transform(meshTransform));
         } else {
-            glm::mat4 t = glm::mat4(1.0);
-            shader.writeBuffer(name, glm::value_ptr(t), offsetof(ModelTransforms, meshTransform), sizeof(t));
+            for (BoneBounds& b : mesh.boneBounds) {
+                glm::mat4 t = pose->boneTransforms[b.boneId] * meshTransform;
+                float d = intersectBox(local, b.box.transform(t));
+                if (d >= 0 && (closestBox < 0 || d < closestBox))
+                    closestBox = d;
+            }
         }
+        if (closestBox < 0 || closestBox > distance)
+            continue;
 
-        mesh.draw(shader);
+        if (!exact) {
+            distance = closestBox;
+            hit = true;
+            continue;
+        }
+
+        std::vector<glm::vec3> positions = skinPositions(i, pose);
+        for (TriangleBatch& batch : makeTriangleBatches(positions, mesh.indexes)) {
+            float d = intersectTriangles(local, batch);
+            if (d >= 0 && d < distance) {
+                distance = d;
+                hit = true;
+            }
+        }
     }
+
+    return hit;
 }
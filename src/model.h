@@ -1,59 +1,158 @@
 #pragma once
 
+#include <memory>
+
+#include <assimp/Importer.hpp>
 #include <assimp/mesh.h>
 #include <glm/glm.hpp>
 
 #include "animator.h"
+#include "bounds.h"
+#include "library.h"
+#include "mapped.h"
 #include "shader.h"
 #include "textures.h"
 
-struct BoundingBox
+class MappedFile;
+struct AnimationTables;
+struct IkStats;
+struct Keypoint;
+class KeypointSolver;
+class PoseCache;
+struct BakedAnimations;
+
+// Bounds of the vertices a bone influences, in bind pose
+struct BoneBounds
+{
+    int boneId;
+    BoundingBox box;
+};
+
+// A level of detail, as a range of the mesh's index buffer. Its triangles
+// are grouped into influence buckets, see ShaderVariants: those whose
+// vertices have no bones, exactly 1, 1 or 2, then the rest, including
+// the triangles that mix unskinned and skinned vertices
+struct MeshLod
 {
-    glm::vec3 min;
-    glm::vec3 max;
-
-    BoundingBox()
-    {
-        min = glm::vec3(std::numeric_limits<float>::max());
-        max = glm::vec3(std::numeric_limits<float>::min());
-    }
-
-    // Update the min and max extremes of the bounding box
-    void update(glm::vec3 v)
-    {
-        for (int i = 0; i < 3; i++) {
-            min[i] = std::min(v[i], min[i]);
-            max[i] = std::max(v[i], max[i]);
-        }
-     }
+    size_t offset, count;
+    float error; // Largest distance from the full mesh, in model space
+    size_t buckets[numInfluenceBuckets]; // Number of indexes in each bucket, in order
 };
 
 struct Mesh
 {
     void init();
     void cleanup();
-    void draw(Shader& shader);
+    // Preskinned draws read the compute skinning's output instead of the skin stream
+    // A bucket of -1 draws every triangle of the level
+    void draw(Shader& shader, bool preskinned, int instances = 1, int bucket = -1);
+    void drawDepth(bool preskinned, int bucket = -1); // Only binds the positions
+    void drawLod(int instances, int bucket);
+    // Skin the vertices into skinnedVbo with the compute skinning program
+    void skin();
+
+    // Pack the vertex streams and the indexes of every level of
+    // detail into gpuData, in the layout that init uploads
+    void buildGpuData();
+    // Sort the morph deltas by vertex and build their offsets
+    void buildMorphTable();
+    // Sort the triangles of every level of detail into influence buckets
+    void bucketTriangles();
+
+    // Vertex array object, vertex buffer objects, element buffer object
+    unsigned int vao, skinVbo, shadingVbo, ebo;
+    unsigned int depthVao;
+    int indexType; // GL_UNSIGNED_SHORT when there are few enough vertices
+
+    // The skin stream is kept on the CPU for picking, the shading
+    // stream and the coarser levels only until they're packed
+    std::vector<SkinVertex> skinVertices;
+    std::vector<ShadingVertex> shadingVertices;
+    std::vector<unsigned int> indexes;
 
-    // Vertex array object, vertex buffer object, element buffer object
-    unsigned int vao, vbo, ebo;
+    // Coarser levels of detail, their indexes come after the full mesh's
+    std::vector<MeshLod> lods;
+    std::vector<unsigned int> lodIndexes;
+    int lod; // Level drawn this frame
 
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indexes;
+    // The skin stream, shading stream and indexes one after the other.
+    // Either owned or pointing into a cooked model, released once uploaded
+    std::shared_ptr<const unsigned char> gpuData;
+    size_t skinSize, shadingSize, indexesSize;
+
+    BoundingBox box;
+    std::vector<BoneBounds> boneBounds;
+
+    // Morph targets, as sparse deltas of the vertices they move grouped
+    // by vertex: vertex v's are morphDeltas[morphOffsets[v]] up to
+    // morphOffsets[v + 1]. Kept on the CPU for picking
+    std::vector<uint32_t> morphOffsets;
+    std::vector<MorphDelta> morphDeltas;
+    std::vector<unsigned int> morphVertices; // Vertex of each delta, only while importing
+    std::vector<float> morphWeights; // Used when no animation drives them
+    unsigned int morphOffsetsBuffer, morphDeltasBuffer;
+
+    // SkinnedVertex stream written by the compute skinning pass,
+    // created on the first frame the mesh is skinned that way
+    unsigned int skinnedVbo = 0, skinnedVao = 0, skinnedDepthVao = 0;
 
     bool initialized;
     TextureMap textures;
+    std::vector<TextureRef> textureRefs; // Only valid while importing
 };
 
 class Model
 {
 public:
     Model(
-        TextureLoader* loader,
+        TextureLoader* loader, AnimationLibrary* library,
         std::string id, std::string path, std::string basePath
     );
-    void draw(Shader& shader, double timeInSeconds);
+    // Run the animation, then upload the model's transforms. Called once per
+    // frame, or per animation tick, so that every pass that draws the model
+    // shares the same pose. Models can be animated in parallel, upload needs
+    // the GL context. With a cache, models with the same pose share it
+    void animate(double timeInSeconds, PoseCache* cache = nullptr);
+    void upload();
+
+    // When the animation runs at a fixed rate on another thread, each tick
+    // publishes its pose, keeping the one before. The renderer latches both
+    // under the same lock, then draws a blend of them until the next frame
+    void publishPose();
+    void latchPoses();
+    void interpolatePose(float factor);
+    void stopInterpolating(); // Back to drawing the animator's own pose
+    const Pose* currentPose(); // The pose drawn this frame, or nullptr
+
+    // Pick the coarsest level of detail of each mesh whose error stays
+    // under maxPixelError, given the model's height on the screen in pixels
+    void selectLod(float screenSize, float maxPixelError);
+    int triangleCount(); // Number of triangles drawn at the selected levels
+    // Draw each influence bucket with its variant of the program
+    void draw(ShaderVariants& programs);
+    // Draw with only the skin stream bound, for the depth and id passes
+    void drawDepth(ShaderVariants& programs);
+    // Skin the meshes with the compute skinning program, after update. The
+    // draws of this frame then expect the programs in src/shaders/preskinned,
+    // which don't skin, so only their unspecialized variant is used
+    void skin(Shader& shader);
     void cleanup();
 
+    // Sample every clip the model plays into the rows of a texture at most
+    // maxSize texels wide and high, see crowd.h. Replaces the current pose
+    void bakeAnimations(float framesPerSecond, int maxSize, BakedAnimations& baked);
+    // The rig and keyframes for the animation pass, see sampler.h
+    void flattenAnimations(AnimationTables& tables);
+    // Draw count copies of the model with the crowd program
+    void drawInstanced(Shader& shader, int count);
+    // Solve the limbs for the keypoints with the current pose, and pose
+    // them that way from the next update on, see ik.h
+    int bindLimbs(KeypointSolver& solver);
+    IkStats poseFromKeypoints(
+        KeypointSolver& solver, const std::vector<Keypoint>& keypoints,
+        glm::vec2 frameSize, double budgetMilliseconds);
+    void clearPoseOverrides();
+
     void setPosition(glm::vec3 v);
     void setSize(glm::vec3 size, bool preserveAspectRatio);
 
@@ -64,14 +163,64 @@ public:
     void setCurrentAnimation(int index);
     std::vector<std::string> animationNames();
 
+    glm::mat4 getTransform();
+
+    // World space bounds of the model in its current pose
+    BoundingBox getWorldBounds();
+
+    // Skin every mesh on the CPU in the current pose, in model space.
+    // The meshes are skinned in parallel
+    std::vector<std::vector<glm::vec3>> skinMeshes();
+    // Largest distance between the positions skinned on the CPU and by the
+    // compute pass this frame, or -1 if the compute pass didn't run
+    float compareSkinning();
+    // Write the current pose to a Wavefront OBJ file, in world space
+    void exportObj(std::string path);
+
+    // Intersect the ray with the model in its current pose. The per bone
+    // bounds are tested and, if exact is set, the skinned triangles as well
+    bool intersect(Ray ray, bool exact, float& distance);
+
+    // Import with Assimp even when there's a native loader for the format,
+    // and ignore the cooked files, to compare the import paths
+    static inline bool forceAssimp = false;
+    static inline bool ignoreCooked = false;
+
     std::string getName() { return name; }
     bool isCalled(std::string s) { return name == s; }
 private:
-    void processNode(const aiScene* scene, const aiNode* node);
-    void processMesh(const aiScene* scene, aiMesh* meshData);
+    // Load the cooked model if it was cooked from the same source
+    bool loadCooked(std::string cookedPath, const MappedFile& source);
+    void cook(std::string cookedPath, const MappedFile& source);
+
+    // Native glTF 2.0 loader, reads the accessors in place from the
+    // mapped files. Throws when the file uses something it doesn't support
+    void loadGltf(
+        std::string path, const MappedFile& source,
+        std::vector<std::shared_ptr<MappedFile>>& mappings);
+    void loadAssimp(std::string path, Assimp::Importer& importer);
+
+    void processNode(const aiNode* node, std::vector<unsigned int>& order);
+    void processMeshes(const aiScene* scene);
+    // Can run on several threads at once, returns the optimizer's statistics
+    std::string processMesh(aiMesh* meshData, Mesh& mesh);
+    // Optimize, simplify and pack a mesh whose vertices have been read
+    std::string prepareMesh(Mesh& mesh);
 
     void getBoneWeights(aiMesh* data, Mesh& mesh);
-    void addBoneToVertex(Vertex& v, int boneId, float weight);
+    void getMorphTargets(aiMesh* data, Mesh& mesh);
+    void addMorphDelta(Mesh& mesh, int target, unsigned int vertex,
+                       glm::vec3 position, glm::vec3 normal);
+    void addBoneToVertex(SkinVertex& v, int boneId, float weight);
+    void computeBoneBounds(Mesh& mesh);
+    std::string optimizeMesh(Mesh& mesh);
+    void generateLods(Mesh& mesh);
+
+    // Mirrors the skinning done in vertex.glsl, see skinning.h
+    std::vector<glm::vec3> skinPositions(size_t meshIndex, const Pose* pose);
+    glm::mat4 getMeshTransform(size_t meshIndex, const Pose* pose);
+    std::vector<float> getMorphWeights(size_t meshIndex, const Pose* pose);
+    void setMeshUniforms(Shader& shader, size_t meshIndex, const Pose* pose);
 
     std::string name;
     std::string textureBasePath;
@@ -82,5 +231,15 @@ private:
 
     Animator animator;
     std::vector<Mesh> meshes;
+
+    // Shader storage buffer holding the ModelTransforms
+    unsigned int transformsBuffer = UINT_MAX;
+    bool preskinned = false; // Whether skin ran since the last upload
+
+    std::shared_ptr<const Pose> publishedPoses[2]; // Previous and latest tick
+    std::shared_ptr<const Pose> latchedPoses[2]; // The ones drawn this frame
+    Pose interpolatedPose;
+    bool interpolating = false;
     TextureLoader* textureLoader;
+    AnimationLibrary* animationLibrary;
 };
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
+#include "optimizer.h"
+
+CacheStats analyzeVertexCache(
+    const std::vector<unsigned int>& indexes, size_t numVertices, int cacheSize
+) {
+    // Time at which each vertex was last pushed into the cache
+    std::vector<size_t> pushed(numVertices, 0);
+    std::vector<bool> used(numVertices, false);
+    size_t time = cacheSize + 1;
+    size_t transformed = 0;
+
+    for (unsigned int v : indexes) {
+        used[v] = true;
+        if (time - pushed[v] > (size_t)cacheSize) {
+            pushed[v] = time++;
+            transformed++;
+        }
+    }
+
+    size_t numTriangles = indexes.size() / 3;
+    size_t numUsed = std::count(used.begin(), used.end(), true);
+    return {
+        numTriangles ? (float)transformed / numTriangles : 0,
+        numUsed ? (float)transformed / numUsed : 0
+    };
+}
+
+// Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw". Fans around a vertex at a time, and picks the next
+// vertex to fan around among the ones that are still in the cache.
+// The clusters are only split at dead ends, without the paper's extra
+// splits on an ACMR threshold
+std::vector<unsigned int> optimizeVertexCache(
+    std::vector<unsigned int>& indexes, size_t numVertices, int cacheSize
+) {
+    size_t numTriangles = indexes.size() / 3;
+
+    // Triangles that use each vertex
+    std::vector<unsigned int> offsets(numVertices + 1, 0);
+    for (unsigned int v : indexes)
+        offsets[v + 1]++;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<unsigned int> adjacency(indexes.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexes.size(); i++)
+        adjacency[fill[indexes[i]]++] = i / 3;
+
+    // Number of triangles that haven't been emitted yet for each vertex
+    std::vector<int> live(numVertices);
+    for (size_t v = 0; v < numVertices; v++)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<size_t> pushed(numVertices, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    std::vector<unsigned int> clusters;
+    result.reserve(indexes.size());
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int fan = numVertices > 0 ? 0 : -1;
+    bool skipped = true;
+
+    while (fan != -1) {
+        if (skipped)
+            clusters.push_back(result.size() / 3);
+        candidates.clear();
+
+        for (unsigned int i = offsets[fan]; i < offsets[fan + 1]; i++) {
+            unsigned int t = adjacency[i];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+
+            for (int j = 0; j < 3; j++) {
+                unsigned int v = indexes[t * 3 + j];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - pushed[v] > (size_t)cacheSize)
+                    pushed[v] = time++;
+            }
+        }
+
+        // Prefer the candidate that's still going to be in the cache
+        // once all of its remaining triangles have been emitted
+        fan = -1;
+        int best = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] <= 0) continue;
+            int priority = 0;
+            if (time - pushed[v] + 2 * live[v] <= (size_t)cacheSize)
+                priority = time - pushed[v];
+            if (priority > best) {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        // Dead end, go back to a recently used vertex or any vertex left.
+        // The locality is lost either way, so a new cluster starts
+        skipped = fan == -1;
+        while (fan == -1 && !deadEnds.empty()) {
+            unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0) fan = v;
+        }
+        while (fan == -1 && cursor < numVertices) {
+            if (live[cursor] > 0) fan = cursor;
+            cursor++;
+        }
+    }
+
+    // Remove the cluster started by a vertex without triangles
+    if (!clusters.empty() && clusters.back() == result.size() / 3)
+        clusters.pop_back();
+
+    indexes = std::move(result);
+    return clusters;
+}
+
+void optimizeOverdraw(
+    std::vector<unsigned int>& indexes,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& clusters
+) {
+    size_t numTriangles = indexes.size() / 3;
+    if (clusters.size() < 2) return;
+
+    // Area weighted centroid and normal of the mesh and each cluster
+    struct Cluster
+    {
+        unsigned int first, count;
+        glm::vec3 centroid, normal;
+        float area;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+    glm::vec3 meshCentroid(0.0);
+    float meshArea = 0.0;
+
+    for (size_t i = 0; i < clusters.size(); i++) {
+        Cluster& c = sorted[i];
+        c.first = clusters[i];
+        c.count = (i + 1 < clusters.size() ? clusters[i + 1] : numTriangles) - c.first;
+        c.centroid = c.normal = glm::vec3(0.0);
+        c.area = 0.0;
+
+        for (unsigned int t = c.first; t < c.first + c.count; t++) {
+            glm::vec3 a = positions[indexes[t * 3]];
+            glm::vec3 b = positions[indexes[t * 3 + 1]];
+            glm::vec3 d = positions[indexes[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, d - a); // Length is twice the area
+            float area = glm::length(n);
+
+            c.centroid += (a + b + d) * (area / 3.0f);
+            c.normal += n;
+            c.area += area;
+        }
+
+        meshCentroid += c.centroid;
+        meshArea += c.area;
+        if (c.area > 0.0)
+            c.centroid /= c.area;
+    }
+    if (meshArea > 0.0)
+        meshCentroid /= meshArea;
+
+    for (Cluster& c : sorted) {
+        float length = glm::length(c.normal);
+        c.sortKey = length > 0.0 ? glm::dot(c.centroid - meshCentroid, c.normal / length) : 0.0;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indexes.size());
+    for (Cluster& c : sorted) {
+        result.insert(result.end(),
+                      indexes.begin() + c.first * 3,
+                      indexes.begin() + (c.first + c.count) * 3);
+    }
+    indexes = std::move(result);
+}
+
+std::vector<int> optimizeVertexFetch(std::vector<unsigned int>& indexes, size_t numVertices)
+{
+    std::vector<int> remap(numVertices, -1);
+    int next = 0;
+    for (unsigned int& v : indexes) {
+        if (remap[v] == -1)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    return remap;
+}
+
+// Sum of squared distances to a set of planes
+struct Quadric
+{
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+    void addPlane(glm::vec3 n, float d)
+    {
+        a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z; a03 += n.x * d;
+        a11 += n.y * n.y; a12 += n.y * n.z; a13 += n.y * d;
+        a22 += n.z * n.z; a23 += n.z * d;
+        a33 += d * d;
+    }
+
+    void add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+    }
+
+    double evaluate(glm::vec3 p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                   a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                   a22 * z * z + 2 * a23 * z +
+                   a33;
+        return std::max(e, 0.0);
+    }
+};
+
+struct Collapse
+{
+    unsigned int from, to;
+    double cost;
+};
+
+// Would moving the vertex flip any of its triangles, other than the removed ones
+bool flipsTriangles(
+    const std::vector<unsigned int>& indexes,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& triangles,
+    unsigned int from, unsigned int to
+) {
+    for (unsigned int t : triangles) {
+        unsigned int v[3] = { indexes[t * 3], indexes[t * 3 + 1], indexes[t * 3 + 2] };
+        if (v[0] == to || v[1] == to || v[2] == to)
+            continue; // Collapses away
+
+        glm::vec3 p[3];
+        for (int i = 0; i < 3; i++)
+            p[i] = positions[v[i]];
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+        for (int i = 0; i < 3; i++)
+            if (v[i] == from) p[i] = positions[to];
+        glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+        if (glm::dot(before, after) <= 0.0)
+            return true;
+    }
+    return false;
+}
+
+uint64_t edgeKey(unsigned int a, unsigned int b)
+{
+    return ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+}
+
+std::vector<unsigned int> simplify(
+    const std::vector<unsigned int>& indexes,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<int>& groups,
+    size_t targetIndexCount, float& error
+) {
+    size_t numVertices = positions.size();
+    std::vector<unsigned int> result = indexes;
+    double maxCost = 0.0;
+
+    // Planes of the original triangles
+    std::vector<Quadric> quadrics(numVertices, Quadric {});
+    for (size_t t = 0; t < indexes.size() / 3; t++) {
+        glm::vec3 a = positions[indexes[t * 3]];
+        glm::vec3 b = positions[indexes[t * 3 + 1]];
+        glm::vec3 c = positions[indexes[t * 3 + 2]];
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if (length == 0.0) continue;
+        n = n / length;
+
+        for (int i = 0; i < 3; i++)
+            quadrics[indexes[t * 3 + i]].addPlane(n, -glm::dot(n, a));
+    }
+
+    // Collapse in passes, each vertex moves or receives at most once per
+    // pass, so the costs and the flip checks stay valid within a pass
+    while (result.size() > targetIndexCount) {
+        size_t numTriangles = result.size() / 3;
+
+        // Edges that only have one triangle are on a border
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t t = 0; t < numTriangles; t++) {
+            for (int i = 0; i < 3; i++)
+                edges[edgeKey(result[t * 3 + i], result[t * 3 + (i + 1) % 3])]++;
+        }
+        std::vector<bool> locked(numVertices, false);
+        for (auto& [key, count] : edges) {
+            if (count != 1) continue;
+            locked[key >> 32] = true;
+            locked[key & 0xffffffff] = true;
+        }
+
+        std::vector<std::vector<unsigned int>> triangles(numVertices);
+        for (size_t t = 0; t < numTriangles; t++) {
+            for (int i = 0; i < 3; i++)
+                triangles[result[t * 3 + i]].push_back(t);
+        }
+
+        std::vector<Collapse> collapses;
+        for (size_t t = 0; t < numTriangles; t++) {
+            for (int i = 0; i < 3; i++) {
+                unsigned int a = result[t * 3 + i];
+                unsigned int b = result[t * 3 + (i + 1) % 3];
+                for (auto [from, to] : { std::pair(a, b), std::pair(b, a) }) {
+                    if (locked[from] || groups[from] != groups[to]) continue;
+                    Quadric q = quadrics[from];
+                    q.add(quadrics[to]);
+                    collapses.push_back({ from, to, q.evaluate(positions[to]) });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        std::vector<unsigned int> remap(numVertices);
+        std::iota(remap.begin(), remap.end(), 0);
+        std::vector<bool> touched(numVertices, false);
+        size_t removed = 0;
+        size_t toRemove = (result.size() - targetIndexCount) / 3;
+
+        for (Collapse& c : collapses) {
+            if (removed >= toRemove) break;
+            if (touched[c.from] || touched[c.to]) continue;
+            if (flipsTriangles(result, positions, triangles[c.from], c.from, c.to))
+                continue;
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            maxCost = std::max(maxCost, c.cost);
+
+            // Lock the neighbourhood for the rest of the pass
+            for (unsigned int t : triangles[c.from]) {
+                bool shared = false;
+                for (int i = 0; i < 3; i++) {
+                    touched[result[t * 3 + i]] = true;
+                    shared |= result[t * 3 + i] == c.to;
+                }
+                removed += shared;
+            }
+        }
+        if (removed == 0) break; // Nothing left that can collapse
+
+        // Drop the triangles that became degenerate
+        std::vector<unsigned int> next;
+        next.reserve(result.size());
+        for (size_t t = 0; t < numTriangles; t++) {
+            unsigned int a = remap[result[t * 3]];
+            unsigned int b = remap[result[t * 3 + 1]];
+            unsigned int c = remap[result[t * 3 + 2]];
+            if (a == b || b == c || a == c) continue;
+            next.insert(next.end(), { a, b, c });
+        }
+        result = std::move(next);
+    }
+
+    error = std::sqrt(maxCost);
+    return result;
+}
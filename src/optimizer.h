@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Import time reordering of the index and vertex buffers, so that the GPU
+// transforms fewer vertices, shades fewer hidden fragments and fetches
+// the vertices in order. Works on triangle lists
+
+// Post-transform vertex cache efficiency, simulated with a FIFO cache
+struct CacheStats
+{
+    float acmr; // Average transformed vertices per triangle, 0.5 at best
+    float atvr; // Average transformations per vertex, 1 at best
+};
+
+CacheStats analyzeVertexCache(
+    const std::vector<unsigned int>& indexes, size_t numVertices, int cacheSize = 16);
+
+// Reorder the triangles for the post-transform vertex cache (Tipsify).
+// Returns the first triangle of each cluster, the triangles between
+// which the vertex cache is cold anyway, for optimizeOverdraw
+std::vector<unsigned int> optimizeVertexCache(
+    std::vector<unsigned int>& indexes, size_t numVertices, int cacheSize = 16);
+
+// Sort the clusters so the ones facing outwards of the mesh get drawn first,
+// which makes them more likely to occlude the rest from any view direction
+void optimizeOverdraw(
+    std::vector<unsigned int>& indexes,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& clusters);
+
+// Number the vertices in the order they're first used by the triangles.
+// Returns the new index of each vertex, unused vertices are mapped to -1
+std::vector<int> optimizeVertexFetch(std::vector<unsigned int>& indexes, size_t numVertices);
+
+// Move the vertices to the positions given by optimizeVertexFetch
+template <typename T>
+void remapVertices(std::vector<T>& vertices, const std::vector<int>& remap)
+{
+    size_t used = 0;
+    for (int i : remap)
+        if (i != -1) used++;
+
+    std::vector<T> result(used);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        if (remap[i] != -1)
+            result[remap[i]] = vertices[i];
+    }
+    vertices = std::move(result);
+}
+
+// Quadric error metric edge collapse (Garland & Heckbert), collapsing
+// vertices onto their neighbours so the vertex buffer can be shared by
+// every level of detail. Vertices on borders are locked, which includes
+// UV seams as the vertices on either side of them aren't welded, and
+// vertices only collapse onto ones of the same group (dominant bone).
+// Returns the new indexes, and the largest error in the mesh's units
+std::vector<unsigned int> simplify(
+    const std::vector<unsigned int>& indexes,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<int>& groups,
+    size_t targetIndexCount, float& error);
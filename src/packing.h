@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "bounds.h"
+#include "vertex.h"
+
+// Quantization used by the packed vertex layout, decoded in skinning.glsl
+// and vertex.glsl. Mirrors octahedral.glsl
+
+inline glm::vec2 octahedralEncode(glm::vec3 n)
+{
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (n.z < 0.0) {
+        glm::vec2 signs(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        return (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+    }
+    return glm::vec2(n.x, n.y);
+}
+
+// A tangent for vertices that can't have one, like those without a texture
+// coordinate. Zero would make the TBN matrix singular, so it's any unit
+// vector perpendicular to the normal, the same on every import
+inline glm::vec3 fallbackTangent(glm::vec3 normal)
+{
+    glm::vec3 axis = std::abs(normal.x) < 0.9 ? glm::vec3(1.0, 0.0, 0.0) : glm::vec3(0.0, 1.0, 0.0);
+    glm::vec3 t = glm::cross(normal, axis);
+    float length = glm::length(t);
+    return length > 0.0 ? t / length : axis;
+}
+
+inline int16_t packSnorm16(float f)
+{
+    return std::round(std::clamp(f, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Positions are stored relative to the bounds of the mesh
+inline PackedSkinVertex packSkinVertex(const SkinVertex& v, const BoundingBox& box)
+{
+    PackedSkinVertex p;
+    glm::vec3 size = box.max - box.min;
+    for (int i = 0; i < 3; i++) {
+        float f = size[i] > 0.0 ? (v.position[i] - box.min[i]) / size[i] : 0.0;
+        p.position[i] = std::round(std::clamp(f, 0.0f, 1.0f) * 65535.0f);
+    }
+    p.position[3] = 0;
+
+    // Round the weights and keep the influences that still have some, the
+    // largest first. The shaders stop at the first influence without weight
+    std::pair<int, int> influences[4]; // Weight, then bone id
+    int count = 0, sum = 0;
+    for (int i = 0; i < 4; i++) {
+        int weight = v.boneIds[i] != -1 ? std::round(v.boneWeights[i] * 255.0f) : 0;
+        if (weight > 0) {
+            influences[count++] = { weight, v.boneIds[i] };
+            sum += weight;
+        }
+    }
+    std::sort(influences, influences + count, std::greater<>());
+
+    for (int i = 0; i < 4; i++) {
+        p.boneIds[i] = i < count ? influences[i].second : 0;
+        p.boneWeights[i] = i < count ? influences[i].first : 0;
+    }
+
+    // Give the rounding error to the largest weight, so they still add up to exactly 1
+    if (sum > 0)
+        p.boneWeights[0] += 255 - sum;
+
+    return p;
+}
+
+inline PackedShadingVertex packShadingVertex(const ShadingVertex& v)
+{
+    PackedShadingVertex p;
+    glm::vec2 normal = octahedralEncode(glm::normalize(v.normal));
+    glm::vec2 tangent = octahedralEncode(glm::normalize(v.tangent));
+    p.frame = glm::i16vec4(
+        packSnorm16(normal.x), packSnorm16(normal.y),
+        packSnorm16(tangent.x), packSnorm16(tangent.y)
+    );
+    p.coord = glm::u16vec2(glm::packHalf1x16(v.coord.x), glm::packHalf1x16(v.coord.y));
+    return p;
+}
+
+inline MorphDelta packMorphDelta(uint32_t target, glm::vec3 position, glm::vec3 normal)
+{
+    return {
+        target,
+        glm::packHalf2x16(glm::vec2(position.x, position.y)),
+        glm::packHalf2x16(glm::vec2(position.z, normal.x)),
+        glm::packHalf2x16(glm::vec2(normal.y, normal.z))
+    };
+}
+
+inline glm::vec3 unpackMorphPosition(const MorphDelta& d)
+{
+    glm::vec2 xy = glm::unpackHalf2x16(d.position);
+    return glm::vec3(xy, glm::unpackHalf2x16(d.positionNormal).x);
+}
+
+inline PaletteBone toPaletteBone(const glm::mat4& m)
+{
+#if defined(DUAL_QUATERNION_PALETTE)
+    // Rotation without the scale, then dual = translation * real / 2
+    glm::mat3 rotation(
+        glm::normalize(glm::vec3(m[0])),
+        glm::normalize(glm::vec3(m[1])),
+        glm::normalize(glm::vec3(m[2])));
+    glm::quat q = glm::normalize(glm::quat_cast(rotation));
+    glm::vec3 r(q.x, q.y, q.z);
+    glm::vec3 t(m[3]);
+    glm::vec3 d = 0.5f * (q.w * t + glm::cross(t, r));
+    return { glm::vec4(r, q.w), glm::vec4(d, -0.5f * glm::dot(t, r)) };
+#elif defined(AFFINE_PALETTE)
+    glm::mat4 rows = glm::transpose(m);
+    return { { rows[0], rows[1], rows[2] } };
+#else
+    return m;
+#endif
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "picker.h"
+
+std::vector<TriangleBatch> makeTriangleBatches(
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& indexes
+) {
+    size_t numTriangles = indexes.size() / 3;
+    std::vector<TriangleBatch> batches((numTriangles + 3) / 4);
+
+    for (size_t i = 0; i < batches.size() * 4; i++) {
+        TriangleBatch& batch = batches[i / 4];
+        int lane = i % 4;
+
+        glm::vec3 v0(0.0), e1(0.0), e2(0.0);
+        if (i < numTriangles) {
+            v0 = positions[indexes[i * 3]];
+            e1 = positions[indexes[i * 3 + 1]] - v0;
+            e2 = positions[indexes[i * 3 + 2]] - v0;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            batch.v0[axis][lane] = v0[axis];
+            batch.e1[axis][lane] = e1[axis];
+            batch.e2[axis][lane] = e2[axis];
+        }
+    }
+
+    return batches;
+}
+
+// Möller–Trumbore ray triangle intersection, one triangle per lane
+float intersectTriangles(const Ray& ray, const TriangleBatch& b)
+{
+    const float epsilon = 1e-7;
+
+#if defined(__SSE2__)
+    __m128 dx = _mm_set1_ps(ray.direction.x);
+    __m128 dy = _mm_set1_ps(ray.direction.y);
+    __m128 dz = _mm_set1_ps(ray.direction.z);
+
+    __m128 e1x = _mm_loadu_ps(b.e1[0]);
+    __m128 e1y = _mm_loadu_ps(b.e1[1]);
+    __m128 e1z = _mm_loadu_ps(b.e1[2]);
+    __m128 e2x = _mm_loadu_ps(b.e2[0]);
+    __m128 e2y = _mm_loadu_ps(b.e2[1]);
+    __m128 e2z = _mm_loadu_ps(b.e2[2]);
+
+    // p = direction x e2
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                            _mm_mul_ps(e1z, pz));
+    __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0), det);
+
+    // s = origin - v0
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_loadu_ps(b.v0[0]));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_loadu_ps(b.v0[1]));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_loadu_ps(b.v0[2]));
+
+    __m128 u = _mm_mul_ps(inverse,
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)));
+
+    // q = s x e1
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+    __m128 v = _mm_mul_ps(inverse,
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+    __m128 t = _mm_mul_ps(inverse,
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_cmpgt_ps(absDet, _mm_set1_ps(epsilon));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0)));
+    hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, _mm_set1_ps(epsilon)));
+
+    // Replace the misses with infinity and take the minimum across the lanes
+    __m128 infinity = _mm_set1_ps(INFINITY);
+    t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, infinity));
+    t = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+    t = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    float closest = _mm_cvtss_f32(t);
+    return closest == INFINITY ? -1 : closest;
+#else
+    float closest = -1;
+    for (int i = 0; i < 4; i++) {
+        glm::vec3 v0(b.v0[0][i], b.v0[1][i], b.v0[2][i]);
+        glm::vec3 e1(b.e1[0][i], b.e1[1][i], b.e1[2][i]);
+        glm::vec3 e2(b.e2[0][i], b.e2[1][i], b.e2[2][i]);
+
+        glm::vec3 p = glm::cross(ray.direction, e2);
+        float det = glm::dot(e1, p);
+        if (fabs(det) <= epsilon) continue;
+
+        float inverse = 1.0 / det;
+        glm::vec3 s = ray.origin - v0;
+        float u = glm::dot(s, p) * inverse;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(ray.direction, q) * inverse;
+        float t = glm::dot(e2, q) * inverse;
+
+        if (u < 0.0 || v < 0.0 || u + v > 1.0 || t <= epsilon) continue;
+        if (closest < 0 || t < closest) closest = t;
+    }
+    return closest;
+#endif
+}
+
+// Recursively split the models along the longest axis of their bounds
+int Picker::build(int first, int count)
+{
+    BVHNode node;
+    node.first = first;
+    node.count = count;
+    node.left = node.right = -1;
+    for (int i = first; i < first + count; i++)
+        node.box.update(bounds[order[i]]);
+
+    int index = nodes.size();
+    nodes.push_back(node);
+    if (count <= 2) return index; // Small enough to be a leaf
+
+    glm::vec3 size = node.box.max - node.box.min;
+    int axis = size.x > size.y && size.x > size.z ? 0 : size.y > size.z ? 1 : 2;
+    int half = count / 2;
+    std::nth_element(
+        order.begin() + first, order.begin() + first + half,
+        order.begin() + first + count,
+        [&](int a, int b) {
+            return bounds[a].center()[axis] < bounds[b].center()[axis];
+        });
+
+    int left = build(first, half);
+    int right = build(first + half, count - half);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+int Picker::pick(std::vector<Model>& models, Ray ray, bool exact)
+{
+    // The models move every frame, so the hierarchy's rebuilt on each pick
+    nodes.clear();
+    order.clear();
+    bounds.clear();
+    for (size_t i = 0; i < models.size(); i++) {
+        bounds.push_back(models[i].getWorldBounds());
+        if (bounds.back().valid())
+            order.push_back(i);
+    }
+    if (order.empty()) return -1;
+    build(0, order.size());
+
+    int closestModel = -1;
+    float closest = std::numeric_limits<float>::max();
+
+    std::vector<int> stack = { 0 };
+    while (!stack.empty()) {
+        BVHNode& node = nodes[stack.back()];
+        stack.pop_back();
+
+        float t = intersectBox(ray, node.box);
+        if (t < 0 || t > closest)
+            continue; // Missed, or there's already something closer
+
+        if (node.left != -1) {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++) {
+            float distance = 0;
+            int m = order[i];
+            if (models[m].intersect(ray, exact, distance) && distance < closest) {
+                closest = distance;
+                closestModel = m;
+            }
+        }
+    }
+
+    return closestModel;
+}
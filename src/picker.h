@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "bounds.h"
+#include "model.h"
+
+// 4 triangles laid out as a structure of arrays so they can be tested at once
+struct TriangleBatch
+{
+    float v0[3][4];
+    float e1[3][4]; // v1 - v0
+    float e2[3][4]; // v2 - v0
+};
+
+// Group the triangles into batches of 4. The last batch
+// is padded with degenerate triangles that never get hit
+std::vector<TriangleBatch> makeTriangleBatches(
+    const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& indexes
+);
+
+// Intersect a ray with 4 triangles at once. Returns the
+// distance to the closest hit or -1 if none were hit
+float intersectTriangles(const Ray& ray, const TriangleBatch& batch);
+
+// Selects models on the CPU by casting a ray through a bounding volume
+// hierarchy of the models' animated bounds. Doesn't touch OpenGL,
+// so it works in headless tools too
+class Picker
+{
+public:
+    // Return the index of the closest model hit by the ray, or -1.
+    // When exact is set, the skinned triangles are tested,
+    // otherwise the per bone bounds are good enough
+    int pick(std::vector<Model>& models, Ray ray, bool exact);
+private:
+    struct BVHNode
+    {
+        BoundingBox box;
+        int left, right; // Child nodes, -1 for leaves
+        int first, count; // Range in the model order
+    };
+
+    int build(int first, int count);
+
+    std::vector<BVHNode> nodes;
+    std::vector<int> order; // Model indexes
+    std::vector<BoundingBox> bounds;
+};
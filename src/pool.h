@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
 #include <vector>
 
 using Task = std::function<void()>;
@@ -62,3 +68,125 @@ private:
     std::vector<std::thread> threads;
     std::queue<Task> tasks;
 };
+
+// Workers that stay up for the whole run, for the loops that parallelFor
+// splits up. The caller works on its own loop too and waits for the indexes
+// the workers took, so a loop nested in another one always gets done, even
+// when every worker is busy with the outer one
+class ForkJoinPool
+{
+public:
+    ForkJoinPool(int numThreads)
+    {
+        for (int i = 0; i < numThreads; i++)
+            threads.push_back(std::thread(&ForkJoinPool::threadLoop, this));
+    }
+
+    ~ForkJoinPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(guard);
+            stop = true;
+            available.notify_all();
+        }
+        for (auto& t : threads)
+            t.join();
+    }
+
+    // One worker per hardware thread besides the caller's
+    static ForkJoinPool& shared()
+    {
+        static ForkJoinPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    void run(size_t count, const std::function<void(size_t)>& body)
+    {
+        auto job = std::make_shared<Job>(count, body);
+        {
+            std::unique_lock<std::mutex> lock(guard);
+            jobs.push_back(job);
+            available.notify_all();
+        }
+        work(*job);
+
+        {
+            std::unique_lock<std::mutex> lock(job->guard);
+            job->finished.wait(lock, [&] { return job->done == count; });
+        }
+        {
+            std::unique_lock<std::mutex> lock(guard);
+            auto it = std::find(jobs.begin(), jobs.end(), job);
+            if (it != jobs.end())
+                jobs.erase(it);
+        }
+
+        if (job->error)
+            std::rethrow_exception(job->error);
+    }
+private:
+    struct Job
+    {
+        Job(size_t count, const std::function<void(size_t)>& body) : count(count), body(body) {}
+
+        size_t count;
+        const std::function<void(size_t)>& body;
+        std::atomic<size_t> next = 0, done = 0;
+        std::exception_ptr error; // The first one thrown by the body
+        std::mutex guard;
+        std::condition_variable finished;
+    };
+
+    static void work(Job& job)
+    {
+        size_t i;
+        while ((i = job.next++) < job.count) {
+            try {
+                job.body(i);
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(job.guard);
+                if (!job.error) job.error = std::current_exception();
+            }
+            if (++job.done == job.count) {
+                std::unique_lock<std::mutex> lock(job.guard);
+                job.finished.notify_all();
+            }
+        }
+    }
+
+    void threadLoop()
+    {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(guard);
+                available.wait(lock, [this] {
+                    // The jobs whose indexes are all taken only wait on their callers
+                    while (!jobs.empty() && jobs.front()->next >= jobs.front()->count)
+                        jobs.pop_front();
+                    return !jobs.empty() || stop;
+                });
+                if (stop) return;
+                job = jobs.front();
+            }
+            work(*job);
+        }
+    }
+
+    bool stop = false;
+    std::mutex guard;
+    std::condition_variable available;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::vector<std::thread> threads;
+};
+
+// Run body(i) for every i in [0, count) across the hardware threads, and
+// wait for all of them. It uses the shared fork-join workers rather than
+// the ThreadPool, since it gets called from tasks running on the pool. The
+// first exception thrown by the body is rethrown once every index is done
+inline void parallelFor(size_t count, std::function<void(size_t)> body)
+{
+    if (count == 0)
+        return;
+    ForkJoinPool::shared().run(count, body);
+}
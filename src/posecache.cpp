@@ -0,0 +1,28 @@
+#include "posecache.h"
+
+void PoseCache::beginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lastLookups = numLookups.exchange(0);
+    lastHits = numHits.exchange(0);
+}
+
+std::shared_ptr<const Pose> PoseCache::get(const PoseKey& key, std::function<void(Pose&)> compute)
+{
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<Entry>& slot = entries[key];
+        if (slot)
+            numHits++;
+        else
+            slot = std::make_shared<Entry>();
+        entry = slot;
+    }
+    numLookups++;
+
+    // Computed outside the lock so that different poses are still computed in parallel
+    std::call_once(entry->computed, [&]() { compute(*entry->pose); });
+    return entry->pose;
+}
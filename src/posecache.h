@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "animator.h"
+
+// What a pose depends on: the rig, the clip, the sample time quantized to
+// the cache's step and whether the clip is playing at all. Models only
+// switch their mesh LODs, never their skeleton's, so it isn't part of it
+struct PoseKey
+{
+    uint64_t rig; // See Animator::rigSignature
+    const Clip* clip;
+    long long step; // Quantized time, -1 when paused
+    bool operator<(const PoseKey& other) const
+    {
+        return std::tie(rig, clip, step) < std::tie(other.rig, other.clip, other.step);
+    }
+};
+
+// Poses computed this frame, so that models playing the same clip of the
+// same rig at the same time, like a synchronized troupe, compute it once
+// and share it. Safe to use from the threads animating the models
+class PoseCache
+{
+public:
+    // Forget the last frame's poses, the models still hold the ones they use
+    void beginFrame();
+
+    // Return the pose for the key, calling compute to fill it on a miss.
+    // Other threads asking for a pose that's being computed wait for it
+    std::shared_ptr<const Pose> get(const PoseKey& key, std::function<void(Pose&)> compute);
+
+    // Of the last frame. Written by the animation thread, read by the GUI
+    int lookups() { return lastLookups; }
+    float hitRate()
+    {
+        int total = lastLookups, hits = lastHits;
+        return total > 0 ? float(hits) / total : 0.0;
+    }
+
+    // Times closer than this, in seconds, share a pose
+    double step = 1.0 / 240.0;
+private:
+    struct Entry
+    {
+        std::once_flag computed;
+        std::shared_ptr<Pose> pose = std::make_shared<Pose>();
+    };
+
+    std::mutex mutex;
+    std::map<PoseKey, std::shared_ptr<Entry>> entries;
+    std::atomic<int> numLookups = 0, numHits = 0;
+    std::atomic<int> lastLookups = 0, lastHits = 0;
+};
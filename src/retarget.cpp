@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+
+#include "bounds.h"
+#include "retarget.h"
+
+// Names that mean the same bone, the first one is the role
+static const std::vector<std::vector<std::string>> synonyms = {
+    { "hips", "pelvis" },
+    { "shoulder", "clavicle" },
+    { "upperarm", "arm" },
+    { "lowerarm", "forearm" },
+    { "hand", "wrist" },
+    { "upperleg", "upleg", "thigh" },
+    { "lowerleg", "leg", "calf", "shin" },
+    { "foot", "ankle" },
+    { "toes", "toe", "toebase", "ball" },
+};
+
+static bool isSeparator(char c)
+{
+    return c == '_' || c == '.' || c == ' ' || c == '-';
+}
+
+char boneRole(const std::string& boneName, std::string& role)
+{
+    // Without the namespace some exporters add, like "mixamorig:"
+    std::string name = boneName.substr(boneName.find_last_of(':') + 1);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    char side = 0;
+    for (std::string word : { "left", "right" }) {
+        size_t at = name.find(word);
+        if (at != std::string::npos) {
+            side = word[0];
+            name.erase(at, word.size());
+            break;
+        }
+    }
+
+    // A single letter set apart by a separator, like upperarm_l or L_Thigh
+    size_t n = name.size();
+    if (side == 0 && n >= 2 && (name[n - 1] == 'l' || name[n - 1] == 'r') && isSeparator(name[n - 2])) {
+        side = name[n - 1];
+        name.erase(n - 2);
+    } else if (side == 0 && n >= 2 && (name[0] == 'l' || name[0] == 'r') && isSeparator(name[1])) {
+        side = name[0];
+        name.erase(0, 2);
+    }
+
+    role.clear();
+    for (char c : name) {
+        if (!isSeparator(c)) role += c;
+    }
+    for (const std::vector<std::string>& names : synonyms) {
+        if (std::find(names.begin(), names.end(), role) != names.end()) {
+            role = names[0];
+            break;
+        }
+    }
+    return side;
+}
+
+static std::vector<glm::mat4> restGlobals(const std::vector<Node>& nodes)
+{
+    std::vector<glm::mat4> globals(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& node = nodes[i];
+        globals[i] = node.parent == -1 ? node.transform : globals[node.parent] * node.transform;
+    }
+    return globals;
+}
+
+// The rotation of a transform, without its scale
+static glm::quat rotationOf(const glm::mat4& m)
+{
+    glm::mat3 r(m);
+    for (int c = 0; c < 3; c++)
+        r[c] = glm::normalize(r[c]);
+    return glm::normalize(glm::quat_cast(r));
+}
+
+RetargetMap::RetargetMap(
+    const std::vector<Node>& source, const std::vector<Node>& target,
+    const BoneAliases& aliases
+) {
+    // The first node wins when several have the same role
+    std::unordered_map<std::string, int> byName, byRole;
+    for (size_t i = 0; i < source.size(); i++) {
+        std::string role;
+        char side = boneRole(source[i].name, role);
+        byName.emplace(source[i].name, i);
+        byRole.emplace(std::string(1, side) + role, i);
+        sourceNames.push_back(source[i].name);
+    }
+
+    sources.assign(target.size(), -1);
+    for (size_t i = 0; i < target.size(); i++) {
+        const std::string& name = target[i].name;
+        for (auto& [from, to] : aliases) {
+            if (to == name && byName.count(from))
+                sources[i] = byName[from];
+        }
+        if (sources[i] == -1 && byName.count(name))
+            sources[i] = byName[name];
+        if (sources[i] == -1) {
+            std::string role;
+            char side = boneRole(name, role);
+            auto it = byRole.find(std::string(1, side) + role);
+            if (it != byRole.end())
+                sources[i] = it->second;
+        }
+        if (sources[i] != -1)
+            mapped++;
+    }
+
+    // Carry a source rotation over as its change from the rest pose in model
+    // space: target = inverse(targetParent) * sourceParent * source *
+    // inverse(sourceRest) * targetRest, with the parents' and rests' global
+    // rotations. At the source's rest pose, that's the target's rest pose
+    std::vector<glm::mat4> sourceGlobals = restGlobals(source);
+    std::vector<glm::mat4> targetGlobals = restGlobals(target);
+    BoundingBox sourceBox, targetBox;
+    corrections.resize(target.size());
+    for (size_t i = 0; i < target.size(); i++) {
+        int s = sources[i];
+        if (s == -1) continue;
+        glm::quat sourceParent = source[s].parent == -1
+            ? glm::quat(1.0, 0.0, 0.0, 0.0) : rotationOf(sourceGlobals[source[s].parent]);
+        glm::quat targetParent = target[i].parent == -1
+            ? glm::quat(1.0, 0.0, 0.0, 0.0) : rotationOf(targetGlobals[target[i].parent]);
+
+        Correction& c = corrections[i];
+        c.pre = glm::inverse(targetParent) * sourceParent;
+        c.post = glm::inverse(rotationOf(sourceGlobals[s])) * rotationOf(targetGlobals[i]);
+        c.sourceRest = glm::vec3(source[s].transform[3]);
+        c.rest = glm::vec3(target[i].transform[3]);
+        c.restTransform = target[i].transform;
+        for (int k = 0; k < 3; k++)
+            c.restScale[k] = glm::length(glm::vec3(target[i].transform[k]));
+
+        sourceBox.update(glm::vec3(sourceGlobals[s][3]));
+        targetBox.update(glm::vec3(targetGlobals[i][3]));
+    }
+
+    // The hips move as far relative to the target's size as to the source's
+    float sourceSize = sourceBox.valid() ? glm::length(sourceBox.max - sourceBox.min) : 0.0;
+    float targetSize = targetBox.valid() ? glm::length(targetBox.max - targetBox.min) : 0.0;
+    scale = sourceSize > 0.0 ? targetSize / sourceSize : 1.0;
+}
+
+glm::mat4 RetargetMap::apply(size_t node, const Keyframes& keys, double time) const
+{
+    // The target keeps its own bone lengths, only the changes carry over
+    const Correction& c = corrections[node];
+    glm::vec3 position, scaling;
+    glm::quat rotation;
+    if (!keys.sample(time, position, rotation, scaling))
+        return c.restTransform;
+
+    glm::mat4 result = glm::mat4_cast(glm::normalize(c.pre * rotation * c.post));
+    for (int k = 0; k < 3; k++)
+        result[k] *= c.restScale[k];
+    result[3] = glm::vec4(c.rest + c.pre * ((position - c.sourceRest) * scale), 1.0);
+    return result;
+}
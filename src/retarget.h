@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "animator.h"
+
+// The side ('l', 'r' or 0) and role of a bone from its name, so that the
+// bones of rigs named differently can be matched. LeftForeArm,
+// mixamorig:LeftForeArm, lowerarm_l and forearm.L are all 'l' "lowerarm"
+char boneRole(const std::string& name, std::string& role);
+
+// Maps a source bone name to a target bone name, when matching can't tell
+using BoneAliases = std::vector<std::pair<std::string, std::string>>;
+
+// How the clips authored for one rig drive the nodes of another, with
+// other names and proportions. Built once per pair of skeletons, so that
+// posing with it is an indexed transform with no string lookups.
+// The rotations are carried over as changes from the rest pose, in model
+// space, so it works across rigs whose rest poses or bone axes differ
+class RetargetMap
+{
+public:
+    // Match the nodes by alias first, then by name, then by role
+    RetargetMap(const std::vector<Node>& source, const std::vector<Node>& target,
+                const BoneAliases& aliases);
+
+    // The local transform of a target node, from its source node's keys
+    glm::mat4 apply(size_t node, const Keyframes& keys, double time) const;
+
+    // Index of the source node driving each target node, or -1
+    std::vector<int> sources;
+    std::vector<std::string> sourceNames; // Of every source node, to resolve the channels
+    int mapped = 0; // Number of target nodes with a source
+private:
+    struct Correction
+    {
+        glm::quat pre, post; // Target rotation = pre * source rotation * post
+        glm::vec3 sourceRest; // Rest translation of the source node
+        glm::vec3 rest, restScale; // Rest translation and scale of the target node
+        glm::mat4 restTransform; // Of the target node, for channels without keys
+    };
+
+    std::vector<Correction> corrections; // Per target node
+    float scale = 1.0; // Of the translations, from the source's size to the target's
+};
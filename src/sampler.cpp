@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <numeric>
+
+#include <glad.h>
+
+#include "animator.h"
+#include "sampler.h"
+
+static glm::vec4 keyValue(glm::vec3 v) { return glm::vec4(v, 0.0); }
+static glm::vec4 keyValue(glm::quat q) { return glm::vec4(q.x, q.y, q.z, q.w); }
+
+template <typename T>
+static void addKeys(AnimationTables& tables, const std::vector<std::pair<double, T>>& keys,
+                    int& first, int& count)
+{
+    first = tables.keyTimes.size();
+    count = keys.size();
+    for (auto& [time, value] : keys) {
+        tables.keyTimes.push_back(time);
+        tables.keyValues.push_back(keyValue(value));
+    }
+}
+
+void Animator::flatten(int numMeshes, AnimationTables& tables)
+{
+    tables = AnimationTables();
+    int numBones = bones.size();
+    tables.numSlots = numBones + numMeshes;
+
+    // Sort the nodes by depth. Parents come before their children in
+    // both orders, so within a level the order doesn't matter
+    std::vector<int> depth(nodes.size());
+    int numLevels = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        depth[i] = nodes[i].parent == -1 ? 0 : depth[nodes[i].parent] + 1;
+        numLevels = std::max(numLevels, depth[i] + 1);
+    }
+    std::vector<int> order(nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return depth[a] < depth[b];
+    });
+    std::vector<int> sortedIndex(nodes.size());
+    for (size_t i = 0; i < order.size(); i++)
+        sortedIndex[order[i]] = i;
+
+    tables.levelOffsets.assign(numLevels + 1, 0);
+    for (int d : depth)
+        tables.levelOffsets[d + 1]++;
+    std::partial_sum(tables.levelOffsets.begin(), tables.levelOffsets.end(),
+                     tables.levelOffsets.begin());
+
+    // The meshes are numbered like computePose numbers the mesh transforms
+    std::vector<int> firstMesh(nodes.size());
+    int meshIndex = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        firstMesh[i] = meshIndex;
+        if (nodes[i].boneId == -1)
+            meshIndex += nodes[i].meshCount;
+    }
+
+    for (int i : order) {
+        const Node& node = nodes[i];
+        bool bone = node.boneId != -1;
+        tables.nodes.push_back({
+            .rest = node.transform,
+            .inverseBind = bone ? inverseBindMatrices[node.boneId] : glm::mat4(1.0),
+            .parent = node.parent == -1 ? -1 : sortedIndex[node.parent],
+            .firstSlot = bone ? node.boneId : numBones + firstMesh[i],
+            .slotCount = bone ? 1 : std::clamp(numMeshes - firstMesh[i], 0, node.meshCount),
+            .padding = 0
+        });
+    }
+
+    // The keys of every channel. Streamed clips only have the chunks
+    // around the playhead resident, and the shader doesn't apply retarget
+    // maps, so the nodes of both keep the rest pose
+    for (const Animation& animation : animations) {
+        const Clip& clip = *animation.clip;
+        bool resident = !clip.stream && !animation.retarget;
+        tables.ticksPerSecond.push_back(resident ? clip.ticksPerSecond : 0.0);
+
+        int firstChannel = tables.channels.size();
+        for (size_t i = 0; resident && i < clip.channels.size(); i++) {
+            SampledChannel c = {};
+            addKeys(tables, clip.channels[i].getPositions(), c.positions, c.numPositions);
+            addKeys(tables, clip.channels[i].getRotations(), c.rotations, c.numRotations);
+            addKeys(tables, clip.channels[i].getScalings(), c.scalings, c.numScalings);
+            tables.channels.push_back(c);
+        }
+        for (int i : order) {
+            int channel = animation.nodeChannels[i];
+            tables.nodeChannels.push_back(resident && channel != -1 ? firstChannel + channel : -1);
+        }
+    }
+}
+
+// Upload an array to a new storage buffer. Empty ones still get
+// some storage, since they're bound all the same
+template <typename T>
+static unsigned int createStorage(const std::vector<T>& data)
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(data.size() * sizeof(T), 16),
+                 data.empty() ? nullptr : data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+void AnimationSampler::init(const AnimationTables& tables)
+{
+    if (tables.nodes.size() > maxNodes)
+        throw std::string("Too many nodes to sample the animations on the GPU");
+    if (tables.levelOffsets.size() > maxLevels + 1)
+        throw std::string("The hierarchy is too deep to sample the animations on the GPU");
+
+    nodesBuffer = createStorage(tables.nodes);
+    channelsBuffer = createStorage(tables.channels);
+    keyTimesBuffer = createStorage(tables.keyTimes);
+    keyValuesBuffer = createStorage(tables.keyValues);
+    nodeChannelsBuffer = createStorage(tables.nodeChannels);
+    levelOffsets = tables.levelOffsets;
+    numNodes = tables.nodes.size();
+    numSlots = tables.numSlots;
+}
+
+void AnimationSampler::cleanup()
+{
+    for (unsigned int* buffer : { &nodesBuffer, &channelsBuffer, &keyTimesBuffer,
+                                  &keyValuesBuffer, &nodeChannelsBuffer }) {
+        if (*buffer != 0)
+            glDeleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+}
+
+void AnimationSampler::run(Shader& program, unsigned int instancesBuffer, int numInstances,
+                           unsigned int posesBuffer, float timeInSeconds)
+{
+    program.use();
+    program.set<int>("numInstances", numInstances);
+    program.set<int>("numNodes", numNodes);
+    program.set<int>("numSlots", numSlots);
+    program.set<int>("numLevels", levelOffsets.size() - 1);
+    program.set<std::vector<int>>("levelOffsets", levelOffsets);
+    program.set<float>("time", timeInSeconds);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, instancesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, nodesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, channelsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, keyTimesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, keyValuesBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, nodeChannelsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, posesBuffer);
+
+    // A workgroup per instance, in rows of at most 65535
+    const int maxGroups = 65535;
+    glDispatchCompute(std::min(numInstances, maxGroups), (numInstances + maxGroups - 1) / maxGroups, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
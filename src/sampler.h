@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+// Mirrors SampledNode in animation/compute.glsl. Writes its global
+// transform times inverseBind to slotCount slots of the pose: a bone's
+// slot is its id, a mesh node's slots come after every bone
+struct SampledNode
+{
+    glm::mat4 rest;
+    glm::mat4 inverseBind;
+    int parent;
+    int firstSlot;
+    int slotCount;
+    int padding;
+};
+
+// Mirrors Channel in animation/compute.glsl, ranges of the key arrays
+struct SampledChannel
+{
+    int positions, numPositions;
+    int rotations, numRotations;
+    int scalings, numScalings;
+    int padding[2];
+};
+
+// A rig and the keyframes of every animation it plays, flattened into the
+// arrays the animation compute pass reads. The nodes are sorted by their
+// depth in the hierarchy, so that each level is a range of them
+struct AnimationTables
+{
+    std::vector<SampledNode> nodes;
+    std::vector<int> levelOffsets; // First node of each level, then the node count
+    std::vector<SampledChannel> channels;
+    std::vector<float> keyTimes; // In ticks
+    std::vector<glm::vec4> keyValues; // Positions and scalings, or rotations as x y z w
+    std::vector<int> nodeChannels; // Channel of each node per animation, or -1
+    std::vector<float> ticksPerSecond; // Per animation, 0 for streamed ones
+    int numSlots = 0;
+};
+
+// Samples the animations of many instances of a rig on the GPU. A compute
+// pass evaluates every channel and composes the hierarchy level by level,
+// writing the poses straight into a buffer that the vertex programs read,
+// so nothing is computed or uploaded on the CPU from frame to frame
+class AnimationSampler
+{
+public:
+    // Upload the tables, once. Throws when the rig doesn't fit the pass
+    void init(const AnimationTables& tables);
+    void cleanup();
+
+    // Pose numInstances CrowdInstances into posesBuffer, numSlots
+    // affine matrices per instance stored as 3 rows each
+    void run(Shader& program, unsigned int instancesBuffer, int numInstances,
+             unsigned int posesBuffer, float timeInSeconds);
+
+    static const int maxNodes = 256;
+    static const int maxLevels = 64;
+private:
+    unsigned int nodesBuffer = 0, channelsBuffer = 0, nodeChannelsBuffer = 0;
+    unsigned int keyTimesBuffer = 0, keyValuesBuffer = 0;
+    std::vector<int> levelOffsets;
+    int numNodes = 0, numSlots = 0;
+};
@@ -48,6 +48,17 @@ void Shader::load(int type, const char* path)
 {
     std::string base = std::filesystem::path(path).parent_path() / "";
     std::string source = preprocess(path, base);
+    // Let the shaders know which vertex layout and bone palette are used
+    std::string header = defines;
+#ifdef PACKED_VERTICES
+    header += "#define PACKED_VERTICES\n";
+#endif
+#if defined(DUAL_QUATERNION_PALETTE)
+    header += "#define DUAL_QUATERNION_PALETTE\n";
+#elif defined(AFFINE_PALETTE)
+    header += "#define AFFINE_PALETTE\n";
+#endif
+    source.insert(source.find('\n', source.find("#version")) + 1, header);
     const char *c_str = source.c_str();
 
     int shader = glCreateShader(type);
@@ -70,13 +81,19 @@ void Shader::load(int type, const char* path)
         computeShader = shader;
 }
 
+void Shader::define(std::string name, std::string value)
+{
+    defines += "#define " + name + " " + value + "\n";
+}
+
 void Shader::use() { glUseProgram(program); }
 
 void Shader::cleanup()
 {
-    for (auto& pair : buffers)
-        deleteBuffer(pair.first);
-    glDeleteProgram(program);
+    while (!buffers.empty())
+        deleteBuffer(buffers.begin()->first);
+    if (program != -1)
+        glDeleteProgram(program); // Some only hold buffers
 }
 
 void Shader::assemble()
@@ -109,10 +126,30 @@ void Shader::assemble()
     }
 }
 
+void ShaderVariants::load(const char* vertexPath, const char* fragmentPath, bool specialize)
+{
+    first = specialize ? 0 : numInfluenceBuckets - 1;
+    for (int b = first; b < numInfluenceBuckets; b++) {
+        if (b < numInfluenceBuckets - 1)
+            variants[b].define("BONE_INFLUENCES", std::to_string(bucketInfluences[b]));
+        variants[b].load(GL_VERTEX_SHADER, vertexPath);
+        variants[b].load(GL_FRAGMENT_SHADER, fragmentPath);
+        variants[b].assemble();
+    }
+}
+
+void ShaderVariants::cleanup()
+{
+    for (int b = first; b < numInfluenceBuckets; b++)
+        variants[b].cleanup();
+}
+
 template void Shader::set<int>(std::string name, int value);
 template void Shader::set<float>(std::string name, float value);
 template void Shader::set<glm::mat4>(std::string name, glm::mat4 value);
 template void Shader::set<glm::vec3>(std::string name, glm::vec3 value);
+template void Shader::set<std::vector<float>>(std::string name, std::vector<float> value);
+template void Shader::set<std::vector<int>>(std::string name, std::vector<int> value);
 
 template <typename T>
 void Shader::set(std::string name, T value)
@@ -126,6 +163,10 @@ void Shader::set(std::string name, T value)
         glUniform1i(address, value);
     if constexpr (std::is_same<T, float>::value)
         glUniform1f(address, value);
+    if constexpr (std::is_same<T, std::vector<float>>::value)
+        glUniform1fv(address, value.size(), value.data());
+    if constexpr (std::is_same<T, std::vector<int>>::value)
+        glUniform1iv(address, value.size(), value.data());
 }
 
 void Shader::createBuffer(std::string name, int binding, int allocationSize)
@@ -168,6 +209,7 @@ void Shader::deleteBuffer(std::string name)
         throw name + " not found";
     StorageBuffer& b = buffers[name];
     glDeleteBuffers(1, &b.id);
+    buffers.erase(name);
 }
 
 void Shader::writeBuffer(std::string name, void* data, int offset, int size)
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <glm/glm.hpp>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 // Shader storage buffer object
 struct StorageBuffer
@@ -20,6 +23,8 @@ public:
     // Load a type (GL_FRAGMENT_SHADER, GL_VERTEX_SHADER, etc)
     // of shader and link it to the shader program
     void load(int type, const char *path);
+    // Add a #define to the shaders loaded after this
+    void define(std::string name, std::string value);
 
     // Set a uniform value
     template <typename T> void set(std::string name, T value);
@@ -36,7 +41,38 @@ private:
     int fragmentShader = -1;
     int computeShader = -1;
     int program = -1;
+    std::string defines;
 
     // Map shader storage objects to their given names
     std::unordered_map<std::string, StorageBuffer> buffers;
 };
+
+// Triangles are bucketed by the number of bones that move their vertices,
+// see MeshLod. The last bucket is drawn with the unspecialized program
+const int numInfluenceBuckets = 4;
+const int bucketInfluences[numInfluenceBuckets] = { 0, 1, 2, 4 };
+
+// A program compiled once per influence bucket, with BONE_INFLUENCES
+// defined to the bucket's count so that skinMatrix never branches
+class ShaderVariants
+{
+public:
+    // When specialize isn't set, every bucket uses the unspecialized program
+    void load(const char* vertexPath, const char* fragmentPath, bool specialize);
+    void cleanup();
+
+    // Set a uniform on every variant
+    template <typename T> void set(std::string name, T value)
+    {
+        for (int b = first; b < numInfluenceBuckets; b++) {
+            variants[b].use();
+            variants[b].set<T>(name, value);
+        }
+    }
+
+    Shader& operator[](int bucket) { return variants[std::max(bucket, first)]; }
+    Shader& unspecialized() { return variants[numInfluenceBuckets - 1]; }
+private:
+    Shader variants[numInfluenceBuckets];
+    int first = 0; // The first bucket with a program of its own
+};
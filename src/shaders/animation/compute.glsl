@@ -0,0 +1,161 @@
+// Samples the animation of every crowd instance and composes its hierarchy,
+// writing the poses the crowd's vertex program reads. A workgroup poses
+// an instance, its invocations sharing out the nodes of each level
+#version 460 core
+#include "../crowd/instances.glsl"
+
+layout(local_size_x = 64) in;
+
+#define MAX_NODES 256
+#define MAX_LEVELS 64
+
+// See SampledNode and SampledChannel in sampler.h
+struct SampledNode
+{
+    mat4 rest;
+    mat4 inverseBind;
+    int parent;
+    int firstSlot;
+    int slotCount;
+    int padding;
+};
+
+struct Channel
+{
+    int positions, numPositions;
+    int rotations, numRotations;
+    int scalings, numScalings;
+    int padding0, padding1;
+};
+
+layout(std430, binding = 11) readonly buffer SampledNodes
+{
+    SampledNode nodes[]; // Sorted by level
+};
+
+layout(std430, binding = 12) readonly buffer Channels
+{
+    Channel channels[];
+};
+
+layout(std430, binding = 13) readonly buffer KeyTimes
+{
+    float keyTimes[];
+};
+
+layout(std430, binding = 14) readonly buffer KeyValues
+{
+    vec4 keyValues[];
+};
+
+layout(std430, binding = 15) readonly buffer NodeChannels
+{
+    int nodeChannels[]; // numNodes per animation
+};
+
+layout(std430, binding = 16) writeonly buffer CrowdPoses
+{
+    vec4 poses[];
+};
+
+uniform int numInstances;
+uniform int numNodes;
+uniform int numSlots;
+uniform int numLevels;
+uniform int levelOffsets[MAX_LEVELS + 1];
+uniform float time;
+
+// The global transforms of the levels composed so far
+shared mat4 globals[MAX_NODES];
+
+// Blend the keys around the time, like interpolate in keyframes.cpp
+vec4 sampleKeys(int first, int count, float ticks, bool rotation)
+{
+    // The last key at or before the time
+    int low = 0, high = count - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (keyTimes[first + middle] <= ticks)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    int current = first + low;
+    int next = first + min(low + 1, count - 1);
+    float span = keyTimes[next] - keyTimes[current];
+    float factor = span > 0.0 ? clamp((ticks - keyTimes[current]) / span, 0.0, 1.0) : 0.0;
+
+    vec4 a = keyValues[current];
+    vec4 b = keyValues[next];
+    if (!rotation)
+        return mix(a, b, factor);
+
+    // Spherical interpolation along the shortest path
+    float cosine = dot(a, b);
+    if (cosine < 0.0) {
+        b = -b;
+        cosine = -cosine;
+    }
+    if (cosine > 0.9995)
+        return normalize(mix(a, b, factor));
+    float angle = acos(cosine);
+    return (sin((1.0 - factor) * angle) * a + sin(factor * angle) * b) / sin(angle);
+}
+
+// Translation times rotation times scaling, like getInterpolatedTransform
+mat4 sampleChannel(Channel channel, float ticks)
+{
+    if (channel.numPositions == 0)
+        return mat4(1.0);
+
+    vec3 t = sampleKeys(channel.positions, channel.numPositions, ticks, false).xyz;
+    vec3 s = channel.numScalings > 0
+        ? sampleKeys(channel.scalings, channel.numScalings, ticks, false).xyz
+        : vec3(1.0);
+    vec4 q = channel.numRotations > 0
+        ? normalize(sampleKeys(channel.rotations, channel.numRotations, ticks, true))
+        : vec4(0.0, 0.0, 0.0, 1.0);
+
+    vec3 r = q.xyz;
+    return mat4(
+        s.x * vec4(1.0 - 2.0 * (r.y * r.y + r.z * r.z), 2.0 * (r.x * r.y + q.w * r.z), 2.0 * (r.x * r.z - q.w * r.y), 0.0),
+        s.y * vec4(2.0 * (r.x * r.y - q.w * r.z), 1.0 - 2.0 * (r.x * r.x + r.z * r.z), 2.0 * (r.y * r.z + q.w * r.x), 0.0),
+        s.z * vec4(2.0 * (r.x * r.z + q.w * r.y), 2.0 * (r.y * r.z - q.w * r.x), 1.0 - 2.0 * (r.x * r.x + r.y * r.y), 0.0),
+        vec4(t, 1.0)
+    );
+}
+
+void main()
+{
+    // The instances can outnumber the workgroups of one dimension
+    int index = int(gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x);
+    if (index >= numInstances)
+        return; // The whole workgroup leaves, so the barriers stay uniform
+
+    CrowdInstance instance = instances[index];
+    float ticks = clipTime(instance, time) * instance.ticksPerSecond;
+    int animationChannels = instance.animation * numNodes;
+
+    for (int level = 0; level < numLevels; level++) {
+        for (int i = levelOffsets[level] + int(gl_LocalInvocationID.x);
+             i < levelOffsets[level + 1]; i += int(gl_WorkGroupSize.x)) {
+            SampledNode node = nodes[i];
+            int channel = nodeChannels[animationChannels + i];
+            mat4 local = channel == -1 ? node.rest : sampleChannel(channels[channel], ticks);
+            mat4 global = node.parent == -1 ? local : globals[node.parent] * local;
+            globals[i] = global;
+
+            // Bones and the meshes attached to the node, as the rows of their matrices
+            mat4 m = transpose(global * node.inverseBind);
+            for (int s = 0; s < node.slotCount; s++) {
+                int first = (index * numSlots + node.firstSlot + s) * 3;
+                poses[first] = m[0];
+                poses[first + 1] = m[1];
+                poses[first + 2] = m[2];
+            }
+        }
+        // The next level reads this one's transforms
+        memoryBarrierShared();
+        barrier();
+    }
+}
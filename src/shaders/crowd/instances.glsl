@@ -0,0 +1,22 @@
+// See CrowdInstance in crowd.h
+struct CrowdInstance
+{
+    mat4 transform;
+    int firstRow; // Of the instance's clip in the baked texture
+    int frames;
+    float seconds; // Length of the clip
+    float timeOffset;
+    int animation; // Index of the clip in the sampled tables
+    float ticksPerSecond;
+};
+
+layout(std430, binding = 10) readonly buffer CrowdInstances
+{
+    CrowdInstance instances[];
+};
+
+// Time into the instance's clip, in seconds
+float clipTime(CrowdInstance instance, float time)
+{
+    return instance.seconds > 0.0 ? mod(time + instance.timeOffset, instance.seconds) : 0.0;
+}
@@ -0,0 +1,100 @@
+// Vertex shader for crowds: every instance reads its pose from the baked
+// animations, or from the poses the animation pass sampled this frame,
+// instead of a bone palette
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../default/skinning.glsl"
+#include "../default/octahedral.glsl"
+#include "../crowd/instances.glsl"
+
+// The shading stream
+#ifdef PACKED_VERTICES
+layout(location = 1) in vec4 frame; // Octahedral encoded normal and tangent
+#else
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 tangent;
+#endif
+layout(location = 3) in vec2 coord;
+
+uniform int meshSlot; // Where this mesh's transform is in a pose
+uniform float time;
+
+#ifdef SAMPLED_POSES
+// Written by the animation pass, see AnimationSampler
+layout(std430, binding = 16) readonly buffer CrowdPoses
+{
+    vec4 poses[]; // The first 3 rows of each slot's matrix
+};
+
+uniform int numSlots;
+
+mat4 poseTransform(CrowdInstance instance, int slot)
+{
+    int first = (gl_InstanceID * numSlots + slot) * 3;
+    return transpose(mat4(poses[first], poses[first + 1], poses[first + 2], vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#else
+// A row per frame, each holding the bone transforms then the
+// mesh transforms as the 3 rows of their affine matrices
+uniform sampler2D bakedPoses;
+
+// The texture filters linearly, so sampling between the rows of
+// two frames interpolates them. The columns are sampled at their centers
+mat4 poseTransform(CrowdInstance instance, int slot)
+{
+    float t = clipTime(instance, time);
+    float row = instance.firstRow + t / max(instance.seconds, 1e-6) * instance.frames;
+    vec2 size = vec2(textureSize(bakedPoses, 0));
+    vec4 rows[3];
+    for (int i = 0; i < 3; i++)
+        rows[i] = textureLod(bakedPoses, vec2(slot * 3 + i + 0.5, row + 0.5) / size, 0.0);
+    return transpose(mat4(rows[0], rows[1], rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#endif
+
+out FragmentInfo
+{
+    vec3 worldPos;
+    vec3 vertexNormal;
+    vec2 textureCoord;
+    mat3 TBN;
+} fragOut;
+
+void main()
+{
+    CrowdInstance instance = instances[gl_InstanceID];
+
+#ifdef PACKED_VERTICES
+    vec3 normal = octahedralDecode(frame.xy);
+    vec3 tangent = octahedralDecode(frame.zw);
+#endif
+
+    // Blend the bone transforms of the pose, like skinMatrix
+    ivec4 ids = vertexBoneIds();
+    mat4 skin = ids[0] == -1 ? mat4(1.0) : mat4(0.0);
+    for (int i = 0; i < 4; i++) {
+        if (ids[i] == -1 || ids[i] >= meshSlot)
+            break;
+        skin += poseTransform(instance, ids[i]) * boneWeights[i];
+    }
+    mat4 mesh = poseTransform(instance, meshSlot);
+    vec3 updatedNormal = mat3(skin) * (mat3(mesh) * normal);
+
+    // Calculate the tangent-bitangent-normal matrix
+    mat3 normalMatrix = mat3(transpose(inverse(instance.transform)));
+    vec3 T = normalize(normalMatrix * tangent);
+    vec3 N = normalize(normalMatrix * updatedNormal);
+    // Make sure the tangent is perpendicular to the normal
+    T = normalize(T - dot(T, N) * N);
+    vec3 B = cross(N, T); // Derive the bitangent
+    mat3 TBN = mat3(T, B, N);
+
+    // Output
+    vec4 worldPos = instance.transform * (skin * (mesh * vec4(vertexPosition(), 1.0)));
+    fragOut.textureCoord = coord;
+    fragOut.worldPos = vec3(worldPos);
+    fragOut.vertexNormal = N;
+    fragOut.TBN = TBN;
+
+    gl_Position = projection * view * worldPos;
+}
@@ -4,6 +4,7 @@ struct Light
     vec3 color;
     vec3 position; // In world space
     float c, l, q; // Constant, linear, quadratic (attenuation value)
+    float radius; // Distance past which the light has no visible effect
 };
 
 layout (std430, binding = 0) readonly buffer Lights
@@ -11,11 +12,23 @@ layout (std430, binding = 0) readonly buffer Lights
     Light lights[];
 };
 
+// The bone palette, see PaletteBone in vertex.h
+#if defined(DUAL_QUATERNION_PALETTE)
+struct PaletteBone
+{
+    vec4 real; // Rotation
+    vec4 dual; // Translation
+};
+#elif defined(AFFINE_PALETTE)
+#define PaletteBone mat3x4 // The first 3 rows of the transform, as columns
+#else
+#define PaletteBone mat4
+#endif
+
 layout(std430, binding = 1) readonly buffer ModelTransforms
 {
     mat4 model;
-    mat4 meshTransform;
-    mat4 boneTransforms[];
+    PaletteBone boneTransforms[];
 };
 
 layout(std430, binding = 2) readonly buffer MVPTransforms
@@ -0,0 +1,115 @@
+// Everything that moves a vertex from its bind pose into model space,
+// shared by the vertex programs and the compute skinning pass
+
+// Transform of the node the mesh is attached to
+uniform mat4 meshTransform;
+
+// Sparse morph targets, see MorphDelta in vertex.h. The deltas
+// of vertex v are morphDeltas[morphOffsets[v]] up to morphOffsets[v + 1]
+#define MAX_MORPH_TARGETS 64
+
+layout(std430, binding = 5) readonly buffer MorphOffsets
+{
+    uint morphOffsets[];
+};
+
+layout(std430, binding = 6) readonly buffer MorphDeltas
+{
+    uvec4 morphDeltas[]; // Target, then half float position and normal
+};
+
+uniform bool hasMorphTargets;
+uniform float morphWeights[MAX_MORPH_TARGETS];
+
+// Blend the weighted targets into the vertex, before it's skinned
+void applyMorphTargets(uint vertex, inout vec3 position, inout vec3 normal)
+{
+    if (!hasMorphTargets)
+        return;
+
+    for (uint i = morphOffsets[vertex]; i < morphOffsets[vertex + 1]; i++) {
+        uvec4 delta = morphDeltas[i];
+        float weight = morphWeights[min(delta.x, uint(MAX_MORPH_TARGETS - 1))];
+        vec2 a = unpackHalf2x16(delta.y);
+        vec2 b = unpackHalf2x16(delta.z);
+        vec2 c = unpackHalf2x16(delta.w);
+        position += weight * vec3(a, b.x);
+        normal += weight * vec3(b.y, c);
+    }
+}
+
+// Programs drawing an influence bucket (see MeshLod) define BONE_INFLUENCES
+// to the number of bones of its vertices, 0, 1 or at most 2, and blend
+// exactly that many without branching. The unused influences have no weight
+#ifdef BONE_INFLUENCES
+#define INFLUENCES BONE_INFLUENCES
+#else
+#define INFLUENCES 4
+#endif
+
+// Blend the transforms of the bones that influence the vertex
+mat4 skinMatrix(ivec4 ids, vec4 weights)
+{
+#if !defined(BONE_INFLUENCES)
+    if (ids[0] == -1)
+        return mat4(1.0); // Has no bone influence
+#elif BONE_INFLUENCES == 0
+    return mat4(1.0); // Only moved by the mesh transform
+#else
+    ids = max(ids, ivec4(0));
+#endif
+
+#if defined(DUAL_QUATERNION_PALETTE)
+    // Blend the dual quaternions along the shortest path, which keeps
+    // the volume around twisting joints, then turn the result into a matrix
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    vec4 first = boneTransforms[ids[0]].real;
+    for (int i = 0; i < INFLUENCES; i++) {
+#if !defined(BONE_INFLUENCES)
+        if (ids[i] == -1 || ids[i] >= boneTransforms.length())
+            break;
+#endif
+        PaletteBone bone = boneTransforms[ids[i]];
+        float weight = dot(bone.real, first) < 0.0 ? -weights[i] : weights[i];
+        real += bone.real * weight;
+        dual += bone.dual * weight;
+    }
+    float norm = length(real);
+    real /= norm;
+    dual /= norm;
+
+    vec3 r = real.xyz;
+    vec3 d = dual.xyz;
+    vec3 translation = 2.0 * (real.w * d - dual.w * r + cross(r, d));
+    return mat4(
+        1.0 - 2.0 * (r.y * r.y + r.z * r.z), 2.0 * (r.x * r.y + real.w * r.z), 2.0 * (r.x * r.z - real.w * r.y), 0.0,
+        2.0 * (r.x * r.y - real.w * r.z), 1.0 - 2.0 * (r.x * r.x + r.z * r.z), 2.0 * (r.y * r.z + real.w * r.x), 0.0,
+        2.0 * (r.x * r.z + real.w * r.y), 2.0 * (r.y * r.z - real.w * r.x), 1.0 - 2.0 * (r.x * r.x + r.y * r.y), 0.0,
+        translation, 1.0
+    );
+#else
+    PaletteBone m = PaletteBone(0.0);
+    for (int i = 0; i < INFLUENCES; i++) {
+#if !defined(BONE_INFLUENCES)
+        // Bone has no influence
+        if (ids[i] == -1 || ids[i] >= boneTransforms.length())
+            break;
+#endif
+        m += boneTransforms[ids[i]] * weights[i];
+    }
+#if defined(AFFINE_PALETTE)
+    // Back from rows, the last one is always 0 0 0 1
+    return transpose(mat4(m[0], m[1], m[2], vec4(0.0, 0.0, 0.0, 1.0)));
+#else
+    return m;
+#endif
+#endif
+}
+
+// Every pass must compute the position exactly like this,
+// so that the depth pre-pass and GL_EQUAL testing line up
+vec4 worldPosition(vec3 localPosition, mat4 skin)
+{
+    return model * (skin * (meshTransform * vec4(localPosition, 1.0)));
+}
@@ -0,0 +1,31 @@
+
+uniform struct PhongMaps
+{
+    sampler2D ambient;
+    sampler2D diffuse;
+    sampler2D specular;
+    sampler2D emission;
+    sampler2D normal;
+    bool hasNormal;
+} material;
+
+// Sample the material once rather than once per light
+Surface sampleSurface(vec3 worldPos, vec3 vertexNormal, vec2 coord, mat3 TBN)
+{
+    Surface s;
+    s.position = worldPos;
+    s.ambient = texture(material.ambient, coord).rgb;
+    s.diffuse = texture(material.diffuse, coord).rgb;
+    s.specular = texture(material.specular, coord).rgb;
+    s.emission = texture(material.emission, coord).rgb;
+
+    // Sample the normal. Make it go from a range of 0 to 1
+    // to a range of -1 to 1, then from tangent to world space
+    s.normal = vertexNormal;
+    if (material.hasNormal) {
+        vec3 normal = texture(material.normal, coord).rgb;
+        s.normal = normalize(TBN * normalize(normal * 2.0 - 1.0));
+    }
+
+    return s;
+}
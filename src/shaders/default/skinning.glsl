@@ -0,0 +1,28 @@
+
+// The skin stream, see SkinVertex and PackedSkinVertex in vertex.h
+#ifdef PACKED_VERTICES
+layout(location = 0) in vec3 quantizedPosition;
+layout(location = 4) in uvec4 packedBoneIds;
+layout(location = 5) in vec4 boneWeights;
+
+// Bounds of the mesh the positions were quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 vertexPosition() { return positionOffset + quantizedPosition * positionScale; }
+
+// The unused influences have no weight
+ivec4 vertexBoneIds()
+{
+    return mix(ivec4(-1), ivec4(packedBoneIds), greaterThan(boneWeights, vec4(0.0)));
+}
+#else
+layout(location = 0) in vec3 position;
+layout(location = 4) in ivec4 boneIds;
+layout(location = 5) in vec4 boneWeights;
+
+vec3 vertexPosition() { return position; }
+ivec4 vertexBoneIds() { return boneIds; }
+#endif
+
+#include "../default/deform.glsl"
@@ -1,46 +1,40 @@
 #version 460 core
 #include "buffers.glsl"
+#include "skinning.glsl"
+#include "octahedral.glsl"
 
-layout(location = 0) in vec3 position;
+// The shading stream
+#ifdef PACKED_VERTICES
+layout(location = 1) in vec4 frame; // Octahedral encoded normal and tangent
+#else
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec3 tangent;
+#endif
 layout(location = 3) in vec2 coord;
-layout(location = 4) in ivec4 boneIds;
-layout(location = 5) in vec4 boneWeights;
 
 out FragmentInfo
 {
-    vec3 vertexPos;
+    vec3 worldPos;
     vec3 vertexNormal;
     vec2 textureCoord;
     mat3 TBN;
 } fragOut;
 
+invariant gl_Position;
+
 void main()
 {
-    vec4 basePosition = meshTransform * vec4(position, 1.0);
-    vec3 baseNormal = mat3(meshTransform) * normal;
-
-    vec4 updatedPosition = vec4(0.0);
-    vec3 updatedNormal = vec3(0.0);
+#ifdef PACKED_VERTICES
+    vec3 normal = octahedralDecode(frame.xy);
+    vec3 tangent = octahedralDecode(frame.zw);
+#endif
+    vec3 localPosition = vertexPosition();
+    vec3 localNormal = normal;
+    applyMorphTargets(gl_VertexID, localPosition, localNormal);
 
     // Transform the vertex with the given bone transformations
-    for (int i = 0; i < 4; i++) {
-        // Bone has no influence
-        if (boneIds[i] == -1 || boneIds[i] > boneTransforms.length())
-            break;
-
-        vec4 p = boneTransforms[boneIds[i]] * basePosition;
-        updatedPosition += p * boneWeights[i];
-
-        vec3 n = mat3(boneTransforms[boneIds[i]]) * baseNormal;
-        updatedNormal += n * boneWeights[i];
-    }
-
-    if (boneIds == vec4(-1)) { // Has no bone influence
-        updatedPosition = basePosition;
-        updatedNormal = baseNormal;
-    }
+    mat4 skin = skinMatrix(vertexBoneIds(), boneWeights);
+    vec3 updatedNormal = mat3(skin) * (mat3(meshTransform) * localNormal);
 
     // Calculate the tangent-bitangent-normal matrix
     mat3 normalMatrix = mat3(transpose(inverse(model)));
@@ -52,10 +46,11 @@ void main()
     mat3 TBN = mat3(T, B, N);
 
     // Output
+    vec4 worldPos = worldPosition(localPosition, skin);
     fragOut.textureCoord = coord;
-    fragOut.vertexPos = vec3(updatedPosition);
+    fragOut.worldPos = vec3(worldPos);
     fragOut.vertexNormal = N;
     fragOut.TBN = TBN;
 
-    gl_Position = projection * view * model * updatedPosition;
+    gl_Position = projection * view * worldPos;
 }
@@ -0,0 +1,110 @@
+// Compute shader that lights the G-buffer one 16x16 screen tile at a time.
+// Each tile culls the lights against its depth bounds before shading
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../lighting/phong.glsl"
+#include "packing.glsl"
+
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+const uint maxLightsPerTile = 512;
+
+layout(binding = 0) uniform sampler2D normals;
+layout(binding = 1) uniform sampler2D albedo;
+layout(binding = 2) uniform sampler2D emission;
+layout(binding = 3) uniform sampler2D depth;
+layout(binding = 0, rgba16f) uniform writeonly image2D litImage;
+
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+shared uint minDepthBits;
+shared uint maxDepthBits;
+shared uint tileLightCount;
+shared uint tileLights[maxLightsPerTile];
+
+// Unproject a point on the near plane and slide it along
+// the ray from the eye until it reaches the given depth
+vec3 viewSpacePoint(vec2 ndc, float depth)
+{
+    vec4 p = inverseProjection * vec4(ndc, -1.0, 1.0);
+    p /= p.w;
+    return p.xyz * (depth / -p.z);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = textureSize(depth, 0);
+    bool inside = pixel.x < size.x && pixel.y < size.y;
+
+    if (gl_LocalInvocationIndex == 0) {
+        minDepthBits = floatBitsToUint(3.402823e+38);
+        maxDepthBits = 0;
+        tileLightCount = 0;
+    }
+    barrier();
+
+    // Reconstruct the view space position. Pixels at the far
+    // plane are empty, that's where the skybox gets drawn
+    float d = inside ? texelFetch(depth, pixel, 0).r : 1.0;
+    bool empty = d == 1.0;
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4 viewPos = inverseProjection * vec4(ndc, d * 2.0 - 1.0, 1.0);
+    viewPos /= viewPos.w;
+
+    // Positive floats keep their order when compared as uints
+    if (!empty) {
+        atomicMin(minDepthBits, floatBitsToUint(-viewPos.z));
+        atomicMax(maxDepthBits, floatBitsToUint(-viewPos.z));
+    }
+    barrier();
+
+    // Cull the lights against the view space bounds of the tile
+    if (minDepthBits <= maxDepthBits) {
+        uvec2 tile = gl_WorkGroupID.xy * gl_WorkGroupSize.xy;
+        vec2 minNdc = vec2(tile) / vec2(size) * 2.0 - 1.0;
+        vec2 maxNdc = vec2(tile + gl_WorkGroupSize.xy) / vec2(size) * 2.0 - 1.0;
+        float tileNear = uintBitsToFloat(minDepthBits);
+        float tileFar = uintBitsToFloat(maxDepthBits);
+        vec3 a = viewSpacePoint(minNdc, tileNear);
+        vec3 b = viewSpacePoint(maxNdc, tileNear);
+        vec3 c = viewSpacePoint(minNdc, tileFar);
+        vec3 e = viewSpacePoint(maxNdc, tileFar);
+        vec3 boxMin = min(min(a, b), min(c, e));
+        vec3 boxMax = max(max(a, b), max(c, e));
+
+        uint numThreads = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+        uint numLights = uint(lights.length());
+        for (uint i = gl_LocalInvocationIndex; i < numLights; i += numThreads) {
+            vec3 center = vec3(view * vec4(lights[i].position, 1.0));
+            vec3 delta = clamp(center, boxMin, boxMax) - center;
+            if (dot(delta, delta) > lights[i].radius * lights[i].radius)
+                continue;
+
+            uint slot = atomicAdd(tileLightCount, 1);
+            if (slot < maxLightsPerTile)
+                tileLights[slot] = i;
+        }
+    }
+    barrier();
+
+    if (!inside || empty)
+        return;
+
+    vec3 worldPos = vec3(inverseView * viewPos);
+    Surface s = unpackSurface(
+        texelFetch(normals, pixel, 0),
+        texelFetch(albedo, pixel, 0),
+        texelFetch(emission, pixel, 0),
+        worldPos
+    );
+    vec3 viewDirection = normalize(viewPosition - worldPos);
+
+    vec3 result = s.emission;
+    uint count = min(tileLightCount, maxLightsPerTile);
+    for (uint i = 0; i < count; i++) {
+        result += computePhongLighting(lights[tileLights[i]], s, viewDirection);
+    }
+    imageStore(litImage, pixel, vec4(result, 1.0));
+}
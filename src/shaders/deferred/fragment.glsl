@@ -0,0 +1,19 @@
+#version 460 core
+
+in vec2 textureCoord;
+out vec4 color;
+
+layout(binding = 0) uniform sampler2D litImage;
+layout(binding = 1) uniform sampler2D depth;
+
+// Composite the lit G-buffer into the window, keeping its depth
+// so the skybox only gets drawn where nothing else was
+void main()
+{
+    float d = texture(depth, textureCoord).r;
+    if (d == 1.0)
+        discard;
+
+    color = texture(litImage, textureCoord);
+    gl_FragDepth = d;
+}
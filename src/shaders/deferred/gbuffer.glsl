@@ -0,0 +1,25 @@
+// Fragment shader for the geometry pass, writes the surface into the G-buffer
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../lighting/phong.glsl"
+#include "../default/material.glsl"
+#include "packing.glsl"
+
+in FragmentInfo
+{
+    vec3 worldPos;
+    vec3 vertexNormal;
+    vec2 textureCoord;
+    mat3 TBN;
+} fragIn;
+
+layout(location = 0) out vec4 normalOut;
+layout(location = 1) out vec4 albedoOut;
+layout(location = 2) out vec4 emissionOut;
+
+void main()
+{
+    Surface s = sampleSurface(
+        fragIn.worldPos, fragIn.vertexNormal, fragIn.textureCoord, fragIn.TBN);
+    packSurface(s, normalOut, albedoOut, emissionOut);
+}
@@ -0,0 +1,29 @@
+
+// The G-buffer layout:
+// normals:  RG16F  octahedral encoded world space normal
+// albedo:   RGBA8  diffuse color and specular intensity
+// emission: RGBA8  emissive color and ambient intensity
+// depth:    32 bit float depth
+
+#include "../default/octahedral.glsl"
+
+float luminance(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+void packSurface(Surface s, out vec4 normal, out vec4 albedo, out vec4 emission)
+{
+    normal = vec4(octahedralEncode(s.normal), 0.0, 0.0);
+    albedo = vec4(s.diffuse, luminance(s.specular));
+    emission = vec4(s.emission, luminance(s.ambient));
+}
+
+Surface unpackSurface(vec4 normal, vec4 albedo, vec4 emission, vec3 worldPos)
+{
+    Surface s;
+    s.position = worldPos;
+    s.normal = octahedralDecode(normal.xy);
+    s.diffuse = albedo.rgb;
+    s.specular = vec3(albedo.a);
+    s.emission = emission.rgb;
+    s.ambient = vec3(emission.a);
+    return s;
+}
@@ -0,0 +1,11 @@
+#version 460 core
+
+out vec2 textureCoord;
+
+// Full screen triangle generated from the vertex id, no vertex buffer needed
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    textureCoord = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
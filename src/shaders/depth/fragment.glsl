@@ -0,0 +1,4 @@
+#version 460 core
+
+// Only the depth gets written
+void main() {}
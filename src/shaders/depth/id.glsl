@@ -0,0 +1,12 @@
+#version 460 core
+
+uniform float modelId;
+
+out vec4 color;
+
+// Output the normalized model id
+void main()
+{
+    float n = 1.0 / modelId;
+    color = vec4(n, n, n, 1.0);
+}
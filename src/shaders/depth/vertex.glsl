@@ -0,0 +1,16 @@
+// Minimal vertex shader for depth only passes, only reads the position and skin
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../default/skinning.glsl"
+
+invariant gl_Position;
+
+void main()
+{
+    vec3 localPosition = vertexPosition();
+    vec3 unusedNormal = vec3(0.0);
+    applyMorphTargets(gl_VertexID, localPosition, unusedNormal);
+
+    mat4 skin = skinMatrix(vertexBoneIds(), boneWeights);
+    gl_Position = projection * view * worldPosition(localPosition, skin);
+}
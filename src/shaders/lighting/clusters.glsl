@@ -0,0 +1,41 @@
+
+// The view frustum is split into a grid of froxels (clusters): tiles
+// across the screen, and exponentially spaced slices along the depth
+const uvec3 clusterGrid = uvec3(16, 9, 24);
+const uint maxLightsPerCluster = 256;
+
+#ifndef CLUSTER_ACCESS
+#define CLUSTER_ACCESS readonly
+#endif
+
+layout(std430, binding = 3) CLUSTER_ACCESS buffer LightClusters
+{
+    mat4 inverseProjection;
+    vec4 viewportRect; // Origin and size in window coordinates
+    float zNear, zFar;
+    uint indexCount; // Number of entries used in the light index list
+    uint padding;
+    uvec2 clusters[]; // Offset into the light index list and light count
+};
+
+layout(std430, binding = 4) CLUSTER_ACCESS buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// View space depth at which a slice starts
+float sliceDepth(uint slice)
+{
+    return zNear * pow(zFar / zNear, float(slice) / float(clusterGrid.z));
+}
+
+uint clusterIndex(vec2 fragCoord, float depth)
+{
+    vec2 uv = clamp((fragCoord - viewportRect.xy) / viewportRect.zw, 0.0, 0.999);
+    uvec2 tile = uvec2(uv * vec2(clusterGrid.xy));
+
+    float s = log(depth / zNear) / log(zFar / zNear) * float(clusterGrid.z);
+    uint slice = uint(clamp(s, 0.0, float(clusterGrid.z - 1)));
+
+    return tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice);
+}
@@ -0,0 +1,72 @@
+// Compute shader that bins the lights into the clusters their volume overlaps
+#version 460 core
+
+#define CLUSTER_ACCESS
+#include "../default/buffers.glsl"
+#include "clusters.glsl"
+
+// One work group per cluster
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+shared uint count;
+shared uint offset;
+shared uint indices[maxLightsPerCluster];
+
+// Unproject a point on the near plane and slide it along
+// the ray from the eye until it reaches the given depth
+vec3 viewSpacePoint(vec2 ndc, float depth)
+{
+    vec4 p = inverseProjection * vec4(ndc, -1.0, 1.0);
+    p /= p.w;
+    return p.xyz * (depth / -p.z);
+}
+
+void main()
+{
+    uvec3 id = gl_WorkGroupID;
+    uint cluster = id.x + clusterGrid.x * (id.y + clusterGrid.y * id.z);
+
+    // Get the view space bounding box of the cluster
+    vec2 minNdc = vec2(id.xy) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+    vec2 maxNdc = vec2(id.xy + 1) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+    float sliceNear = sliceDepth(id.z);
+    float sliceFar = sliceDepth(id.z + 1);
+    vec3 a = viewSpacePoint(minNdc, sliceNear);
+    vec3 b = viewSpacePoint(maxNdc, sliceNear);
+    vec3 c = viewSpacePoint(minNdc, sliceFar);
+    vec3 d = viewSpacePoint(maxNdc, sliceFar);
+    vec3 boxMin = min(min(a, b), min(c, d));
+    vec3 boxMax = max(max(a, b), max(c, d));
+
+    if (gl_LocalInvocationIndex == 0)
+        count = 0;
+    barrier();
+
+    // Test the light spheres against the box, the lights are split between the threads
+    uint numLights = uint(lights.length());
+    for (uint i = gl_LocalInvocationIndex; i < numLights; i += gl_WorkGroupSize.x) {
+        vec3 center = vec3(view * vec4(lights[i].position, 1.0));
+        vec3 delta = clamp(center, boxMin, boxMax) - center;
+        if (dot(delta, delta) > lights[i].radius * lights[i].radius)
+            continue;
+
+        uint slot = atomicAdd(count, 1);
+        if (slot < maxLightsPerCluster)
+            indices[slot] = i;
+    }
+    barrier();
+
+    // Reserve space in the global light index list
+    if (gl_LocalInvocationIndex == 0) {
+        uint capacity = uint(lightIndices.length());
+        uint n = min(count, maxLightsPerCluster);
+        offset = atomicAdd(indexCount, n);
+        n = offset >= capacity ? 0 : min(n, capacity - offset);
+        clusters[cluster] = uvec2(offset, n);
+        count = n;
+    }
+    barrier();
+
+    for (uint i = gl_LocalInvocationIndex; i < count; i += gl_WorkGroupSize.x)
+        lightIndices[offset + i] = indices[i];
+}
@@ -0,0 +1,31 @@
+
+// A sampled material at a fragment, in world space
+struct Surface
+{
+    vec3 position;
+    vec3 normal;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 emission;
+};
+
+// Calculate phong lighting given a light source
+vec3 computePhongLighting(Light light, Surface s, vec3 viewDirection)
+{
+    vec3 lightDirection = normalize(light.position - s.position);
+    vec3 halfwayDirection = normalize(lightDirection + viewDirection);
+
+    float d = length(light.position - s.position);
+    float attenuation = 1.0 / (light.c + light.l * d + light.q * (d * d));
+
+    vec3 ambient = s.ambient * light.color;
+
+    float diff = max(dot(lightDirection, s.normal), 0.0);
+    vec3 diffuse = diff * s.diffuse * light.color;
+
+    float spec = pow(max(dot(s.normal, halfwayDirection), 0.0), 128);
+    vec3 specular = spec * s.specular * light.color;
+
+    return attenuation * (ambient + diffuse + specular);
+}
@@ -0,0 +1,12 @@
+// Depth only vertex shader for the models the compute pass already skinned
+#version 460 core
+#include "../default/buffers.glsl"
+
+layout(location = 0) in vec3 position; // SkinnedVertex, in model space
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * (model * vec4(position, 1.0));
+}
@@ -0,0 +1,42 @@
+// Vertex shader for the models the compute pass already skinned
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../default/octahedral.glsl"
+
+// SkinnedVertex, in model space
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 normal; // Octahedral encoded
+layout(location = 2) in vec2 tangent;
+// From the shading stream
+layout(location = 3) in vec2 coord;
+
+out FragmentInfo
+{
+    vec3 worldPos;
+    vec3 vertexNormal;
+    vec2 textureCoord;
+    mat3 TBN;
+} fragOut;
+
+invariant gl_Position;
+
+void main()
+{
+    // Calculate the tangent-bitangent-normal matrix
+    mat3 normalMatrix = mat3(transpose(inverse(model)));
+    vec3 T = normalize(normalMatrix * octahedralDecode(tangent));
+    vec3 N = normalize(normalMatrix * octahedralDecode(normal));
+    // Make sure the tangent is perpendicular to the normal
+    T = normalize(T - dot(T, N) * N);
+    vec3 B = cross(N, T); // Derive the bitangent
+    mat3 TBN = mat3(T, B, N);
+
+    // Output, computed exactly like depth.glsl
+    vec4 worldPos = model * vec4(position, 1.0);
+    fragOut.textureCoord = coord;
+    fragOut.worldPos = vec3(worldPos);
+    fragOut.vertexNormal = N;
+    fragOut.TBN = TBN;
+
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,91 @@
+// Compute shader that skins every vertex of a mesh once per frame, so that
+// the following passes only have to transform the result, see SkinnedVertex
+#version 460 core
+#include "../default/buffers.glsl"
+#include "../default/deform.glsl"
+#include "../default/octahedral.glsl"
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// The mesh's vertex buffers, read as plain words
+layout(std430, binding = 7) readonly buffer SkinStream
+{
+    uint skinStream[];
+};
+
+layout(std430, binding = 8) readonly buffer ShadingStream
+{
+    uint shadingStream[];
+};
+
+layout(std430, binding = 9) writeonly buffer SkinnedVertices
+{
+    uint skinnedVertices[]; // 5 words per vertex
+};
+
+uniform int numVertices;
+
+#ifdef PACKED_VERTICES
+// Bounds of the mesh the positions were quantized to
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// PackedSkinVertex is 4 words, PackedShadingVertex 3
+void readVertex(uint v, out vec3 position, out vec3 normal, out vec3 tangent,
+                out ivec4 boneIds, out vec4 boneWeights)
+{
+    uint s = v * 4;
+    vec2 xy = unpackUnorm2x16(skinStream[s]);
+    vec2 z = unpackUnorm2x16(skinStream[s + 1]);
+    position = positionOffset + vec3(xy, z.x) * positionScale;
+
+    uvec4 ids = (uvec4(skinStream[s + 2]) >> uvec4(0, 8, 16, 24)) & 0xffu;
+    boneWeights = unpackUnorm4x8(skinStream[s + 3]);
+    // The unused influences have no weight
+    boneIds = mix(ivec4(-1), ivec4(ids), greaterThan(boneWeights, vec4(0.0)));
+
+    uint f = v * 3;
+    normal = octahedralDecode(unpackSnorm2x16(shadingStream[f]));
+    tangent = octahedralDecode(unpackSnorm2x16(shadingStream[f + 1]));
+}
+#else
+// SkinVertex is 11 words, ShadingVertex 8
+void readVertex(uint v, out vec3 position, out vec3 normal, out vec3 tangent,
+                out ivec4 boneIds, out vec4 boneWeights)
+{
+    uint s = v * 11;
+    position = uintBitsToFloat(uvec3(skinStream[s], skinStream[s + 1], skinStream[s + 2]));
+    boneIds = ivec4(skinStream[s + 3], skinStream[s + 4], skinStream[s + 5], skinStream[s + 6]);
+    boneWeights = uintBitsToFloat(uvec4(
+        skinStream[s + 7], skinStream[s + 8], skinStream[s + 9], skinStream[s + 10]));
+
+    uint f = v * 8;
+    normal = uintBitsToFloat(uvec3(shadingStream[f], shadingStream[f + 1], shadingStream[f + 2]));
+    tangent = uintBitsToFloat(uvec3(shadingStream[f + 3], shadingStream[f + 4], shadingStream[f + 5]));
+}
+#endif
+
+void main()
+{
+    uint v = gl_GlobalInvocationID.x;
+    if (v >= uint(numVertices))
+        return;
+
+    vec3 position, normal, tangent;
+    ivec4 boneIds;
+    vec4 boneWeights;
+    readVertex(v, position, normal, tangent, boneIds, boneWeights);
+    applyMorphTargets(v, position, normal);
+
+    // Model space, the vertex programs only apply the model matrix
+    mat4 skin = skinMatrix(boneIds, boneWeights);
+    mat3 frame = mat3(skin) * mat3(meshTransform);
+    vec3 skinned = vec3(skin * (meshTransform * vec4(position, 1.0)));
+
+    uint o = v * 5;
+    skinnedVertices[o] = floatBitsToUint(skinned.x);
+    skinnedVertices[o + 1] = floatBitsToUint(skinned.y);
+    skinnedVertices[o + 2] = floatBitsToUint(skinned.z);
+    skinnedVertices[o + 3] = packSnorm2x16(octahedralEncode(normalize(frame * normal)));
+    skinnedVertices[o + 4] = packSnorm2x16(octahedralEncode(normalize(frame * tangent)));
+}
@@ -0,0 +1,160 @@
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "skinning.h"
+
+// A bone transform premultiplied by the mesh transform, as
+// the 3 rows of an affine matrix. The last row is always 0 0 0 1
+struct AffineBone
+{
+    float rows[3][4];
+};
+
+// The influences of a vertex, ready to be blended. The unused ones have no
+// weight, and a vertex without any uses the unskinned slot at full weight
+struct Influences
+{
+    int ids[4];
+    float weights[4];
+};
+
+static Influences resolveInfluences(const SkinVertex& v, int numBones)
+{
+    Influences in = { { numBones, 0, 0, 0 }, { 1.0, 0.0, 0.0, 0.0 } };
+    if (v.boneIds[0] < 0 || v.boneIds[0] >= numBones)
+        return in;
+
+    // Like the shader, stop at the first missing bone
+    bool done = false;
+    for (int j = 0; j < 4; j++) {
+        done = done || v.boneIds[j] < 0 || v.boneIds[j] >= numBones;
+        in.ids[j] = done ? 0 : v.boneIds[j];
+        in.weights[j] = done ? 0.0 : v.boneWeights[j];
+    }
+    return in;
+}
+
+static void skinScalar(
+    const SkinVertex* vertices, const glm::vec3* positions, size_t first, size_t count,
+    const AffineBone* palette, int numBones, glm::vec3* result
+) {
+    for (size_t i = first; i < count; i++) {
+        Influences in = resolveInfluences(vertices[i], numBones);
+        glm::vec4 p = glm::vec4(positions ? positions[i] : vertices[i].position, 1.0);
+
+#if defined(__SSE2__)
+        // Blend the rows, then take their dot products with the position at once
+        __m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps(), r2 = _mm_setzero_ps();
+        for (int j = 0; j < 4; j++) {
+            const AffineBone& bone = palette[in.ids[j]];
+            __m128 w = _mm_set1_ps(in.weights[j]);
+            r0 = _mm_add_ps(r0, _mm_mul_ps(w, _mm_loadu_ps(bone.rows[0])));
+            r1 = _mm_add_ps(r1, _mm_mul_ps(w, _mm_loadu_ps(bone.rows[1])));
+            r2 = _mm_add_ps(r2, _mm_mul_ps(w, _mm_loadu_ps(bone.rows[2])));
+        }
+        __m128 position = _mm_setr_ps(p.x, p.y, p.z, 1.0);
+        __m128 x = _mm_mul_ps(r0, position);
+        __m128 y = _mm_mul_ps(r1, position);
+        __m128 z = _mm_mul_ps(r2, position);
+        __m128 w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 sum = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
+
+        float out[4];
+        _mm_storeu_ps(out, sum);
+        result[i] = glm::vec3(out[0], out[1], out[2]);
+#else
+        glm::vec3 skinned(0.0);
+        for (int j = 0; j < 4; j++) {
+            const AffineBone& bone = palette[in.ids[j]];
+            for (int r = 0; r < 3; r++) {
+                const float* row = bone.rows[r];
+                skinned[r] += in.weights[j] * (row[0] * p.x + row[1] * p.y + row[2] * p.z + row[3]);
+            }
+        }
+        result[i] = skinned;
+#endif
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// 8 vertices per iteration, one per lane. The influences are resolved and
+// transposed on the stack first, then the bone rows are gathered per lane
+__attribute__((target("avx2,fma")))
+static size_t skinAvx2(
+    const SkinVertex* vertices, const glm::vec3* positions, size_t count,
+    const AffineBone* palette, int numBones, glm::vec3* result
+) {
+    const float* base = &palette[0].rows[0][0];
+    const int floatsPerBone = sizeof(AffineBone) / sizeof(float);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        alignas(32) int ids[4][8];
+        alignas(32) float weights[4][8];
+        alignas(32) float px[8], py[8], pz[8];
+        for (int lane = 0; lane < 8; lane++) {
+            Influences in = resolveInfluences(vertices[i + lane], numBones);
+            for (int j = 0; j < 4; j++) {
+                ids[j][lane] = in.ids[j] * floatsPerBone;
+                weights[j][lane] = in.weights[j];
+            }
+            glm::vec3 p = positions ? positions[i + lane] : vertices[i + lane].position;
+            px[lane] = p.x;
+            py[lane] = p.y;
+            pz[lane] = p.z;
+        }
+
+        __m256 x = _mm256_load_ps(px);
+        __m256 y = _mm256_load_ps(py);
+        __m256 z = _mm256_load_ps(pz);
+        __m256 out[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+
+        for (int j = 0; j < 4; j++) {
+            __m256i offsets = _mm256_load_si256((const __m256i*)ids[j]);
+            __m256 w = _mm256_load_ps(weights[j]);
+            for (int r = 0; r < 3; r++) {
+                const float* row = base + r * 4;
+                __m256 v = _mm256_i32gather_ps(row + 3, offsets, 4);
+                v = _mm256_fmadd_ps(_mm256_i32gather_ps(row, offsets, 4), x, v);
+                v = _mm256_fmadd_ps(_mm256_i32gather_ps(row + 1, offsets, 4), y, v);
+                v = _mm256_fmadd_ps(_mm256_i32gather_ps(row + 2, offsets, 4), z, v);
+                out[r] = _mm256_fmadd_ps(w, v, out[r]);
+            }
+        }
+
+        alignas(32) float skinned[3][8];
+        for (int r = 0; r < 3; r++)
+            _mm256_store_ps(skinned[r], out[r]);
+        for (int lane = 0; lane < 8; lane++)
+            result[i + lane] = glm::vec3(skinned[0][lane], skinned[1][lane], skinned[2][lane]);
+    }
+    return i;
+}
+#endif
+
+void skinMeshPositions(
+    const SkinVertex* vertices, const glm::vec3* positions, size_t count,
+    const std::vector<glm::mat4>& boneTransforms, const glm::mat4& meshTransform,
+    glm::vec3* result
+) {
+    // Fold the mesh transform into every bone. The unskinned slot comes last
+    int numBones = boneTransforms.size();
+    std::vector<AffineBone> palette(numBones + 1);
+    for (int b = 0; b <= numBones; b++) {
+        glm::mat4 m = b < numBones ? boneTransforms[b] * meshTransform : meshTransform;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++)
+                palette[b].rows[r][c] = m[c][r];
+        }
+    }
+
+    size_t done = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (avx2)
+        done = skinAvx2(vertices, positions, count, palette.data(), numBones, result);
+#endif
+    skinScalar(vertices, positions, done, count, palette.data(), numBones, result);
+}
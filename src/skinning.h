@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+// Skin vertex positions on the CPU, for picking, export and machines without
+// a GPU. Matches the vertex programs: each position is moved by the mesh
+// transform, then by the weighted bone transforms. positions replaces the
+// vertices' own positions when it's set, for the morphed positions.
+// Runs 8 vertices at a time with AVX2 when the CPU has it
+void skinMeshPositions(
+    const SkinVertex* vertices, const glm::vec3* positions, size_t count,
+    const std::vector<glm::mat4>& boneTransforms, const glm::mat4& meshTransform,
+    glm::vec3* result
+);
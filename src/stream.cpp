@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "animator.h"
+#include "log.h"
+#include "stream.h"
+
+// Chunks kept resident before and after the one under the playhead
+const size_t chunksBehind = 1;
+const size_t chunksAhead = 2;
+
+ClipStream::ClipStream(std::shared_ptr<MappedFile> file, const StreamedClip& clip, ThreadPool* pool)
+    : reader(file), clip(clip), pool(pool) {}
+
+std::shared_ptr<const ClipChunk> ClipStream::decode(size_t index) const
+{
+    const CookedRange* chunks = reader.get<CookedRange>(clip.chunks);
+    const CookedChannel* channels = reader.get<CookedChannel>(chunks[index]);
+    if (chunks[index].count != clip.channelNodes.count)
+        throw std::string("Chunk doesn't match the clip's channels");
+
+    auto chunk = std::make_shared<ClipChunk>();
+    chunk->start = index * clip.chunkDuration;
+    chunk->end = std::min((index + 1) * clip.chunkDuration, clip.duration);
+    for (size_t i = 0; i < chunks[index].count; i++) {
+        chunk->channels.push_back(Keyframes(
+            reader.array<Keyframes::VectorKey>(channels[i].positions),
+            reader.array<Keyframes::VectorKey>(channels[i].scalings),
+            reader.array<Keyframes::QuatKey>(channels[i].rotations)
+        ));
+    }
+    return chunk;
+}
+
+void ClipStream::prefetch(size_t index)
+{
+    // The task keeps the stream alive until it's done
+    std::shared_ptr<ClipStream> self = shared_from_this();
+    auto task = [self, index] {
+        std::shared_ptr<const ClipChunk> chunk;
+        try {
+            chunk = self->decode(index);
+        } catch (std::string msg) {
+            log(WARN, "Couldn't stream a clip chunk: " + msg);
+        }
+        std::unique_lock<std::mutex> lock(self->guard);
+        if (chunk) self->resident[index] = chunk;
+        self->pending.erase(index);
+        self->evict(); // Every window may have moved on while it decoded
+    };
+
+    if (pool != nullptr)
+        pool->dispatch(task);
+    else
+        task();
+}
+
+void ClipStream::evict()
+{
+    for (auto it = resident.begin(); it != resident.end();) {
+        bool used = std::any_of(windows.begin(), windows.end(), [&](auto& w) {
+            return it->first >= w.second.first && it->first <= w.second.second;
+        });
+        if (used)
+            it++;
+        else
+            it = resident.erase(it);
+    }
+}
+
+void ClipStream::release(const void* consumer)
+{
+    std::unique_lock<std::mutex> lock(guard);
+    if (windows.erase(consumer))
+        evict();
+}
+
+bool ClipStream::isResident(size_t index)
+{
+    std::unique_lock<std::mutex> lock(guard);
+    return resident.count(index) > 0;
+}
+
+std::shared_ptr<const ClipChunk> ClipStream::chunk(double time, const void* consumer)
+{
+    size_t count = numChunks();
+    size_t index = std::min<size_t>(std::max(time, 0.0) / clip.chunkDuration, count - 1);
+    size_t first = index > chunksBehind ? index - chunksBehind : 0;
+    size_t last = std::min(index + chunksAhead, count - 1);
+
+    std::vector<size_t> missing;
+    {
+        std::unique_lock<std::mutex> lock(guard);
+        // Looping back to the start evicts the end of the clip, unless
+        // another model is still playing it
+        std::pair<size_t, size_t>& window = windows[consumer];
+        if (window != std::make_pair(first, last)) {
+            window = { first, last };
+            evict();
+        }
+
+        // The chunk under the playhead first
+        missing.push_back(index);
+        for (size_t i = first; i <= last; i++) {
+            if (i != index) missing.push_back(i);
+        }
+        std::erase_if(missing, [&](size_t i) {
+            return resident.count(i) || !pending.insert(i).second;
+        });
+    }
+    for (size_t i : missing)
+        prefetch(i);
+
+    std::unique_lock<std::mutex> lock(guard);
+    auto it = resident.find(index);
+    return it == resident.end() ? nullptr : it->second;
+}
+
+// The keys of a chunk, with one key past either end when there is one
+template <typename T>
+CookedRange writeChunkKeys(
+    CookWriter& writer, const std::vector<std::pair<double, T>>& keys,
+    double start, double end
+) {
+    if (keys.empty())
+        return writer.write(keys.data(), 0);
+
+    size_t first = 0;
+    while (first + 1 < keys.size() && keys[first + 1].first <= start)
+        first++;
+    size_t last = first;
+    while (last + 1 < keys.size() && keys[last].first < end)
+        last++;
+    return writer.write(keys.data() + first, last - first + 1);
+}
+
+void writeStreamedClips(
+    std::string path, const MappedFile& source,
+    const std::vector<Node>& nodes,
+    const std::vector<std::shared_ptr<const Clip>>& clips,
+    double chunkSeconds
+) {
+    CookWriter writer;
+    StreamedHeader header = {};
+    memcpy(header.magic, "MOST", 4);
+    header.version = streamedVersion;
+    header.sourceHash = hashBytes(source.data(), source.size());
+    header.sourceSize = source.size();
+    header.sourceTime = source.modifiedTime();
+
+    std::vector<CookedNode> cookedNodes;
+    for (const Node& node : nodes) {
+        CookedNode n = {};
+        n.name = writer.write(node.name);
+        n.parent = node.parent;
+        n.meshCount = node.meshCount;
+        n.boneId = -1; // Only the hierarchy matters
+        n.transform = node.transform;
+        cookedNodes.push_back(n);
+    }
+    header.nodes = writer.write(cookedNodes);
+
+    std::vector<StreamedClip> streamedClips;
+    for (const std::shared_ptr<const Clip>& clip : clips) {
+        StreamedClip c = {};
+        c.name = writer.write(clip->name);
+        c.ticksPerSecond = clip->ticksPerSecond;
+        c.duration = clip->duration;
+        c.chunkDuration = chunkSeconds * clip->ticksPerSecond;
+
+        std::vector<CookedRange> channelNodes;
+        for (const std::string& name : clip->channelNodes)
+            channelNodes.push_back(writer.write(name));
+        c.channelNodes = writer.write(channelNodes);
+
+        size_t numChunks = std::max(1.0, std::ceil(clip->duration / c.chunkDuration));
+        std::vector<CookedRange> chunks;
+        for (size_t i = 0; i < numChunks; i++) {
+            double start = i * c.chunkDuration;
+            double end = std::min((i + 1) * c.chunkDuration, clip->duration);
+            std::vector<CookedChannel> channels;
+            for (const Keyframes& k : clip->channels) {
+                channels.push_back({
+                    {},
+                    writeChunkKeys(writer, k.getPositions(), start, end),
+                    writeChunkKeys(writer, k.getScalings(), start, end),
+                    writeChunkKeys(writer, k.getRotations(), start, end)
+                });
+            }
+            chunks.push_back(writer.write(channels));
+        }
+        c.chunks = writer.write(chunks);
+        c.morphChannels = writer.write(
+            writeMorphChannels(writer, clip->morphChannels, clip->morphNodes));
+        streamedClips.push_back(c);
+    }
+    header.clips = writer.write(streamedClips);
+
+    memcpy(writer.bytes.data(), &header, sizeof(header));
+    writer.save(path);
+}
+
+bool loadStreamedClips(
+    std::string path, const MappedFile& source, ThreadPool* pool,
+    std::vector<Node>& nodes, std::vector<std::shared_ptr<const Clip>>& clips
+) {
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(path);
+    } catch (std::string) {
+        return false; // Hasn't been written yet
+    }
+
+    try {
+        CookReader reader(file);
+        const StreamedHeader& header = *reader.get<StreamedHeader>({ 0, 1 });
+        if (memcmp(header.magic, "MOST", 4) != 0 ||
+            header.version != streamedVersion)
+            return false; // Stale
+
+        bool touched;
+        if (!sameSource(source, header.sourceSize, header.sourceTime, header.sourceHash, touched))
+            return false;
+        if (touched) {
+            // Written but unchanged, so the next imports don't hash it again
+            int64_t time = source.modifiedTime();
+            writeAt(path, offsetof(StreamedHeader, sourceTime), &time, sizeof(time));
+        }
+
+        nodes.clear();
+        const CookedNode* cookedNodes = reader.get<CookedNode>(header.nodes);
+        for (size_t i = 0; i < header.nodes.count; i++) {
+            const CookedNode& n = cookedNodes[i];
+            nodes.push_back({
+                reader.string(n.name), n.parent, n.meshCount, n.boneId, n.transform
+            });
+        }
+
+        clips.clear();
+        const StreamedClip* streamedClips = reader.get<StreamedClip>(header.clips);
+        for (size_t i = 0; i < header.clips.count; i++) {
+            const StreamedClip& c = streamedClips[i];
+            if (c.chunks.count == 0 || c.chunkDuration <= 0.0)
+                throw std::string("Streamed clip has no chunks");
+
+            auto clip = std::make_shared<Clip>();
+            clip->name = reader.string(c.name);
+            clip->ticksPerSecond = c.ticksPerSecond;
+            clip->duration = c.duration;
+            const CookedRange* channelNodes = reader.get<CookedRange>(c.channelNodes);
+            for (size_t j = 0; j < c.channelNodes.count; j++)
+                clip->channelNodes.push_back(reader.string(channelNodes[j]));
+            readMorphChannels(reader, c.morphChannels, clip->morphChannels, clip->morphNodes);
+
+            auto stream = std::make_shared<ClipStream>(file, c, pool);
+            if (c.chunks.count == 1)
+                clip->channels = stream->decode(0)->channels;
+            else
+                clip->stream = stream;
+            clips.push_back(clip);
+        }
+    } catch (std::string msg) {
+        log(WARN, path + ": " + msg);
+        return false;
+    }
+    return true;
+}
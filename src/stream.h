@@ -0,0 +1,71 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+#include "cook.h"
+#include "keyframes.h"
+#include "pool.h"
+
+struct Clip;
+struct Node;
+
+// A decoded chunk of a streamed clip. Its keys reach one key past either
+// end, so that every time in [start, end] can be interpolated
+struct ClipChunk
+{
+    double start, end; // In ticks
+    std::vector<Keyframes> channels;
+};
+
+// Plays a long clip straight from its memory mapped streamed file. Only a
+// window of chunks around each playhead is decoded, on the thread pool. The
+// stream is shared by every model playing the clip, so every consumer has
+// its own window and a chunk stays resident while any window has it
+class ClipStream : public std::enable_shared_from_this<ClipStream>
+{
+public:
+    ClipStream(std::shared_ptr<MappedFile> file, const StreamedClip& clip, ThreadPool* pool);
+
+    // The chunk under the time if it's resident, nullptr otherwise. Never
+    // waits on the decoding, the consumer's window around the time is
+    // prefetched instead
+    std::shared_ptr<const ClipChunk> chunk(double time, const void* consumer);
+    // Drop the consumer's window, when it stops playing the clip
+    void release(const void* consumer);
+
+    size_t numChunks() const { return clip.chunks.count; }
+    // Whether the chunk is decoded and kept by some window
+    bool isResident(size_t index);
+    std::shared_ptr<const ClipChunk> decode(size_t index) const;
+private:
+    // Decode a chunk on the pool, it must already be marked pending
+    void prefetch(size_t index);
+
+    CookReader reader;
+    StreamedClip clip;
+    ThreadPool* pool; // Decodes on the calling thread when there's none
+
+    // Keep the chunks inside some window, with the guard held
+    void evict();
+
+    std::mutex guard;
+    std::map<size_t, std::shared_ptr<const ClipChunk>> resident;
+    std::set<size_t> pending;
+    std::map<const void*, std::pair<size_t, size_t>> windows; // First and last chunk
+};
+
+// Write the skeleton and the clips in a streamed file, cut in chunks of chunkSeconds
+void writeStreamedClips(
+    std::string path, const MappedFile& source,
+    const std::vector<Node>& nodes,
+    const std::vector<std::shared_ptr<const Clip>>& clips,
+    double chunkSeconds);
+
+// Read the skeleton and the clips of a streamed file, false when it's missing
+// or stale. The clips that fit in a single chunk are decoded whole
+bool loadStreamedClips(
+    std::string path, const MappedFile& source, ThreadPool* pool,
+    std::vector<Node>& nodes, std::vector<std::shared_ptr<const Clip>>& clips);
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include <glad.h>
 
 #include <glm/gtc/type_ptr.hpp>
@@ -9,21 +11,28 @@
 
 // Load the texture pixels and metadata
 Texture::Texture(const aiTexture* data)
+    : Texture((const unsigned char*)data->pcData, data->mWidth, data->mHeight) {}
+
+// A height of 0 means the data is a compressed image of width bytes,
+// otherwise it's width * height texels
+Texture::Texture(const unsigned char* data, int w, int h)
 {
     id = new unsigned int;
     *id = UINT_MAX;
 
-    width = data->mWidth;
-    height = data->mHeight;
-    pixels = (unsigned char *)data->pcData;
+    width = w;
+    height = h;
 
     int channels = 4;
     if (height == 0) {
         // The texture was compressed
-        pixels = stbi_load_from_memory(pixels, sizeof(aiTexel) * width, &width,
-                                       &height, &channels, 0);
+        pixels = stbi_load_from_memory(data, width, &width, &height, &channels, 0);
         if (pixels == nullptr)
             throw "Invalid texture data\n";
+    } else {
+        // Copied since init frees the pixels
+        pixels = (unsigned char*)malloc(width * height * sizeof(aiTexel));
+        memcpy(pixels, data, width * height * sizeof(aiTexel));
     }
 
     format = channels == 1 ? GL_RED : channels == 4 ? GL_RGBA : GL_RGB;
@@ -134,33 +143,57 @@ TextureMap TextureLoader::get(
     const aiMaterial* material,
     std::string basePath
 ) {
-    TextureMap textures;
+    return get(references(scene, material), basePath);
+}
+
+std::vector<TextureRef> TextureLoader::references(
+    const aiScene* scene,
+    const aiMaterial* material
+) {
+    std::vector<TextureRef> result;
     for (auto& [type, samplerName]: samplerNames) {
         if (material->GetTextureCount(type) == 0)
             continue;
 
         aiString aiName;
         material->GetTexture(type, 0, &aiName);
-        std::string path = std::string(aiName.C_Str());
-        size_t lastBackslash = path.find_last_of("/\\");
+
+        TextureRef ref;
+        ref.sampler = samplerName;
+        ref.path = std::string(aiName.C_Str());
+        const aiTexture *data = scene->GetEmbeddedTexture(ref.path.c_str());
+        if (data != nullptr) {
+            ref.embedded = (const unsigned char*)data->pcData;
+            ref.width = data->mWidth;
+            ref.height = data->mHeight;
+        }
+        result.push_back(ref);
+    }
+    return result;
+}
+
+TextureMap TextureLoader::get(const std::vector<TextureRef>& references, std::string basePath)
+{
+    TextureMap textures;
+    for (const TextureRef& ref : references) {
+        size_t lastBackslash = ref.path.find_last_of("/\\");
 
         // Texture has been loaded before
-        if (cache.count(path)) {
-            textures[samplerName] = cache[path];
+        if (cache.count(ref.path)) {
+            textures[ref.sampler] = cache[ref.path];
             continue;
         }
 
-        const aiTexture *data = scene->GetEmbeddedTexture(path.c_str());
-        if (data == nullptr && lastBackslash != std::string::npos) {
+        if (ref.embedded == nullptr && lastBackslash != std::string::npos) {
             // Load the texture from a file
-            Texture t(basePath + path.substr(lastBackslash + 1));
-            textures[samplerName] = t;
-            cache[path] = t;
-        } else if (data != nullptr) {
+            Texture t(basePath + ref.path.substr(lastBackslash + 1));
+            textures[ref.sampler] = t;
+            cache[ref.path] = t;
+        } else if (ref.embedded != nullptr) {
             // Load the embedded texture
-            Texture t(data);
-            textures[samplerName] = t;
-            cache[path] = t;
+            Texture t(ref.embedded, ref.width, ref.height);
+            textures[ref.sampler] = t;
+            cache[ref.path] = t;
         }
     }
 
@@ -10,6 +10,7 @@ class Texture
 public:
     // Load the pixel data
     Texture(const aiTexture* data);
+    Texture(const unsigned char* data, int width, int height);
     Texture(unsigned char color);
     Texture(std::string path);
     Texture(int w, int h);
@@ -28,6 +29,18 @@ private:
 
 using TextureMap = std::unordered_map<std::string, Texture>;
 
+// Where a material's texture comes from, so that it can
+// be loaded again without the scene it was imported from
+struct TextureRef
+{
+    std::string sampler;
+    std::string path;
+
+    // Embedded texture, laid out like an aiTexture
+    const unsigned char* embedded = nullptr;
+    int width = 0, height = 0;
+};
+
 class TextureLoader
 {
 public:
@@ -36,6 +49,8 @@ public:
         const aiScene* scene,
         const aiMaterial* material,
         std::string basePath);
+    TextureMap get(const std::vector<TextureRef>& references, std::string basePath);
+    std::vector<TextureRef> references(const aiScene* scene, const aiMaterial* material);
     void cleanup();
 private:
     TextureMap cache;
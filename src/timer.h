@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad.h>
+
+// Measures the GPU time spent between begin and end using timestamps,
+// so timers can be nested. Results are read a few frames late, so
+// that reading them never stalls the pipeline
+class GpuTimer
+{
+public:
+    void init()
+    {
+        glGenQueries(numQueries, starts);
+        glGenQueries(numQueries, stops);
+    }
+
+    void cleanup()
+    {
+        glDeleteQueries(numQueries, starts);
+        glDeleteQueries(numQueries, stops);
+    }
+
+    void begin() { glQueryCounter(starts[current], GL_TIMESTAMP); }
+
+    void end()
+    {
+        glQueryCounter(stops[current], GL_TIMESTAMP);
+        current = (current + 1) % numQueries;
+        if (pending < numQueries) pending++;
+        if (pending < numQueries) return;
+
+        // The next queries to be reused are the oldest ones
+        int available = 0;
+        glGetQueryObjectiv(stops[current], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 start = 0, stop = 0;
+            glGetQueryObjectui64v(starts[current], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(stops[current], GL_QUERY_RESULT, &stop);
+            milliseconds = double(stop - start) / 1e6;
+        }
+    }
+
+    // The latest available measurement
+    double elapsed() { return milliseconds; }
+private:
+    static const int numQueries = 4;
+    unsigned int starts[numQueries];
+    unsigned int stops[numQueries];
+    int current = 0;
+    int pending = 0;
+    double milliseconds = 0;
+};
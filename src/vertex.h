@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 
 struct Bone
 {
@@ -9,12 +10,79 @@ struct Bone
     glm::mat4 inverseBindMatrix;
 };
 
-struct Vertex
+// One bone of the palette the shaders skin with, see BONE_PALETTE in
+// CMakeLists.txt. Converted from the bone transforms by toPaletteBone
+#if defined(DUAL_QUATERNION_PALETTE)
+// 32 bytes, a unit dual quaternion. Drops any scale of the bone
+struct PaletteBone
+{
+    glm::vec4 real; // Rotation, as x, y, z, w
+    glm::vec4 dual; // Translation
+};
+#elif defined(AFFINE_PALETTE)
+// 48 bytes, the first 3 rows of the transform
+struct PaletteBone
+{
+    glm::vec4 rows[3];
+};
+#else
+using PaletteBone = glm::mat4;
+#endif
+
+// The vertices are uploaded as two streams, so that the passes which only
+// need the skinned position (depth, picking) don't fetch the rest
+
+// First stream, everything needed to compute the position
+struct SkinVertex
 {
     glm::vec3 position;
+    glm::ivec4 boneIds;
+    glm::vec4 boneWeights;
+};
+
+// Second stream, only needed for shading
+struct ShadingVertex
+{
     glm::vec3 normal;
     glm::vec3 tangent;
     glm::vec2 coord;
-    glm::ivec4 boneIds;
-    glm::vec4 boneWeights;
+};
+
+// Quantized streams used when built with PACKED_VERTICES, see packing.h
+
+// 16 bytes, the position is relative to the mesh's bounds
+struct PackedSkinVertex
+{
+    glm::u16vec4 position; // The last component is padding
+    glm::u8vec4 boneIds;
+    glm::u8vec4 boneWeights;
+};
+
+// 12 bytes
+struct PackedShadingVertex
+{
+    glm::i16vec4 frame; // Octahedral encoded normal and tangent
+    glm::u16vec2 coord; // Half floats
+};
+
+// 20 bytes, written by the compute skinning pass in model space, see
+// skinning/compute.glsl. Read by the passes instead of the skin stream
+struct SkinnedVertex
+{
+    glm::vec3 position;
+    glm::i16vec2 normal; // Octahedral encoded
+    glm::i16vec2 tangent;
+};
+
+// Matches MAX_MORPH_TARGETS in deform.glsl, the other targets are dropped
+const int maxMorphTargets = 64;
+
+// A vertex's offset in one morph target. Only the vertices a target moves
+// have one, see Mesh::morphDeltas. Unpacked in deform.glsl
+struct MorphDelta
+{
+    uint32_t target;
+    uint32_t position; // Half floats x and y
+    uint32_t positionNormal; // Half floats, position z and normal x
+    uint32_t normal; // Half floats y and z
 };
@@ -0,0 +1,115 @@
+#include <cstring>
+#include <filesystem>
+
+#include "cook.h"
+#include "rig.h"
+#include "test.h"
+
+TEST(sameSourceHashesOnlyWhenTheTimeChanged)
+{
+    std::string path = temporaryPath("source.fbx");
+    writeFile(path, "the source model");
+    uint64_t hash, size;
+    int64_t time;
+    {
+        MappedFile source(path);
+        hash = hashBytes(source.data(), source.size());
+        size = source.size();
+        time = source.modifiedTime();
+
+        bool touched = true;
+        CHECK(sameSource(source, size, time, hash, touched));
+        CHECK(!touched);
+        // A different size is enough, whatever the hash
+        CHECK(!sameSource(source, size + 1, time, hash, touched));
+        CHECK(!touched);
+    }
+
+    // Touched but unchanged, like after a checkout
+    std::filesystem::last_write_time(
+        path, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+    {
+        MappedFile source(path);
+        CHECK(source.modifiedTime() != time);
+        bool touched = false;
+        CHECK(sameSource(source, size, time, hash, touched));
+        CHECK(touched);
+    }
+
+    // Changed in place, with the same size
+    writeFile(path, "the other model!");
+    {
+        MappedFile source(path);
+        bool touched = true;
+        CHECK(!sameSource(source, size, time, hash, touched));
+        CHECK(!touched);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(writeAtPatchesInPlace)
+{
+    std::string path = temporaryPath("patched");
+    writeFile(path, "0123456789");
+    CHECK(writeAt(path, 3, "xy", 2));
+    {
+        MappedFile file(path);
+        CHECK(file.size() == 10);
+        CHECK(memcmp(file.data(), "012xy56789", 10) == 0);
+    }
+    std::filesystem::remove(path);
+    CHECK(!writeAt(path, 0, "x", 1));
+}
+
+TEST(cookedAnimatorRoundTrip)
+{
+    Animator original;
+    std::vector<Clip> clips;
+    clips.push_back(armClip("Wave", 4.0, 30.0));
+    clips[0].morphChannels.push_back(MorphKeyframes(2, { 0.0, 4.0 }, { 0.0, 1.0, 0.5, 0.25 }));
+    clips[0].morphNodes.push_back("Body");
+    original.load(armNodes(), armBones(), clips);
+
+    CookWriter writer;
+    CookedHeader header = {};
+    original.cook(writer, header);
+    memcpy(writer.bytes.data(), &header, sizeof(header));
+    std::string path = temporaryPath("arm.cooked");
+    writer.save(path);
+
+    Animator cooked;
+    cooked.loadCooked(CookReader(std::make_shared<MappedFile>(path)));
+
+    const std::vector<Node>& nodes = cooked.getNodes();
+    std::vector<Node> expected = armNodes();
+    CHECK(nodes.size() == expected.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        CHECK(nodes[i].name == expected[i].name);
+        CHECK(nodes[i].parent == expected[i].parent);
+        CHECK(nodes[i].meshCount == expected[i].meshCount);
+        CHECK(nodes[i].boneId == expected[i].boneId);
+        CHECK(nodes[i].transform == expected[i].transform);
+    }
+    CHECK(cooked.getBoneId("UpperArm") == 0);
+    CHECK(cooked.getBoneId("LowerArm") == 1);
+
+    CHECK(cooked.getClips().size() == 1);
+    const Clip& clip = *cooked.getClips()[0];
+    CHECK(clip.name == "Wave");
+    CHECK(clip.ticksPerSecond == 30.0 && clip.duration == 4.0);
+    CHECK(clip.channelNodes.size() == 1 && clip.channelNodes[0] == "LowerArm");
+    const std::vector<Keyframes::QuatKey>& rotations = clip.channels[0].getRotations();
+    CHECK(rotations.size() == 5);
+    for (size_t i = 0; i < rotations.size(); i++) {
+        glm::quat q = armBend(i);
+        CHECK(rotations[i].first == i);
+        CHECK(rotations[i].second.w == q.w && rotations[i].second.z == q.z);
+    }
+
+    CHECK(clip.morphNodes.size() == 1 && clip.morphNodes[0] == "Body");
+    std::vector<float> weights;
+    clip.morphChannels[0].getInterpolatedWeights(2.0, weights);
+    CHECK(weights.size() == 2);
+    CHECK(near(weights[0], 0.25) && near(weights[1], 0.625));
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,28 @@
+#include <filesystem>
+#include <iostream>
+
+#include <unistd.h>
+
+#include "test.h"
+
+std::string temporaryPath(std::string name)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    return (directory / ("mocha-" + std::to_string(getpid()) + "-" + name)).string();
+}
+
+int main()
+{
+    int failed = 0;
+    for (TestCase& test : testCases()) {
+        try {
+            test.run();
+            std::cout << "PASS " << test.name << "\n";
+        } catch (std::string msg) {
+            std::cout << "FAIL " << test.name << ": " << msg << "\n";
+            failed++;
+        }
+    }
+    std::cout << testCases().size() - failed << " of " << testCases().size() << " passed\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include "packing.h"
+#include "test.h"
+
+// Like octahedralDecode in octahedral.glsl
+static glm::vec3 octahedralDecode(glm::vec2 f)
+{
+    glm::vec3 n(f, 1.0 - std::abs(f.x) - std::abs(f.y));
+    float t = std::clamp(-n.z, 0.0f, 1.0f);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return glm::normalize(n);
+}
+
+// Spread over the sphere, including the poles and the seams of the octahedron
+static std::vector<glm::vec3> sphereDirections()
+{
+    std::vector<glm::vec3> result = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+        { 1, 1, -1 }, { -1, 1, -1 }, { 1, -1, -1 }, { -1, -1, -1 },
+    };
+    for (int i = 0; i < 500; i++) {
+        float z = 1.0 - 2.0 * (i + 0.5) / 500;
+        float angle = i * 2.399963;
+        float r = std::sqrt(1.0 - z * z);
+        result.push_back({ r * std::cos(angle), r * std::sin(angle), z });
+    }
+    for (glm::vec3& d : result)
+        d = glm::normalize(d);
+    return result;
+}
+
+TEST(octahedralRoundTrip)
+{
+    for (glm::vec3 n : sphereDirections()) {
+        glm::vec2 f = octahedralEncode(n);
+        CHECK(std::abs(f.x) <= 1.0 && std::abs(f.y) <= 1.0);
+        CHECK(glm::dot(octahedralDecode(f), n) > 0.99999);
+
+        // Quantized to snorm16 like the shading stream
+        glm::vec2 q(packSnorm16(f.x) / 32767.0f, packSnorm16(f.y) / 32767.0f);
+        CHECK(glm::dot(octahedralDecode(q), n) > 0.9999);
+    }
+}
+
+TEST(fallbackTangentIsPerpendicular)
+{
+    for (glm::vec3 n : sphereDirections()) {
+        glm::vec3 t = fallbackTangent(n);
+        CHECK(near(glm::length(t), 1.0));
+        CHECK(std::abs(glm::dot(t, n)) < 1e-5);
+    }
+    CHECK(near(glm::length(fallbackTangent(glm::vec3(0.0))), 1.0));
+}
+
+TEST(packedPositionsStayInTheirCell)
+{
+    BoundingBox box;
+    box.update(glm::vec3(-2.0, 0.0, 5.0));
+    box.update(glm::vec3(3.0, 7.0, 5.0)); // Flat along z
+    glm::vec3 size = box.max - box.min;
+
+    for (int i = 0; i <= 100; i++) {
+        float f = i / 100.0;
+        SkinVertex v = { box.min + size * f, glm::ivec4(-1), glm::vec4(0.0) };
+        PackedSkinVertex p = packSkinVertex(v, box);
+        for (int c = 0; c < 3; c++) {
+            float decoded = box.min[c] + p.position[c] / 65535.0f * size[c];
+            CHECK(near(decoded, v.position[c], size[c] / 65535.0f + 1e-5f));
+        }
+    }
+}
+
+// Every influence with weight comes before those without, the shaders stop at the first
+static void checkInfluences(const PackedSkinVertex& p)
+{
+    int sum = 0;
+    for (int i = 0; i < 4; i++) {
+        sum += p.boneWeights[i];
+        if (i > 0 && p.boneWeights[i] > 0)
+            CHECK(p.boneWeights[i - 1] >= p.boneWeights[i]);
+    }
+    CHECK(sum == 255 || sum == 0);
+}
+
+TEST(packedInfluencesAreContiguous)
+{
+    BoundingBox box;
+    box.update(glm::vec3(0.0));
+    box.update(glm::vec3(1.0));
+
+    // The middle influence rounds to 0, it used to end the list early
+    SkinVertex v = { glm::vec3(0.5), glm::ivec4(3, 5, 7, 9), glm::vec4(0.5, 0.001, 0.299, 0.2) };
+    PackedSkinVertex p = packSkinVertex(v, box);
+    checkInfluences(p);
+    CHECK(p.boneIds[0] == 3 && p.boneIds[1] == 7 && p.boneIds[2] == 9);
+    CHECK(p.boneWeights[3] == 0);
+
+    // Sorted by weight whatever order they came in
+    v = { glm::vec3(0.5), glm::ivec4(1, 2, -1, -1), glm::vec4(0.2, 0.8, 0.0, 0.0) };
+    p = packSkinVertex(v, box);
+    checkInfluences(p);
+    CHECK(p.boneIds[0] == 2 && p.boneIds[1] == 1);
+    CHECK(p.boneWeights[2] == 0 && p.boneWeights[3] == 0);
+
+    // No influence at all stays that way
+    v = { glm::vec3(0.5), glm::ivec4(-1), glm::vec4(0.0) };
+    p = packSkinVertex(v, box);
+    CHECK(p.boneWeights[0] == 0);
+
+    for (int i = 0; i < 1000; i++) {
+        glm::vec4 w(i % 7, i % 3, (i * 13) % 5, i % 2 ? 0.0 : 0.01);
+        float total = w.x + w.y + w.z + w.w;
+        if (total == 0.0) continue;
+        v = { glm::vec3(0.5), glm::ivec4(0, 1, 2, 3), w / total };
+        checkInfluences(packSkinVertex(v, box));
+    }
+}
@@ -0,0 +1,93 @@
+#include "library.h"
+#include "posecache.h"
+#include "rig.h"
+#include "test.h"
+
+TEST(poseCacheComputesEachKeyOnce)
+{
+    PoseCache cache;
+    int computed = 0;
+    auto compute = [&](Pose&) { computed++; };
+
+    PoseKey key = { 1, nullptr, 10 };
+    std::shared_ptr<const Pose> pose = cache.get(key, compute);
+    CHECK(cache.get(key, compute) == pose);
+    CHECK(computed == 1);
+    CHECK(cache.get({ 1, nullptr, 11 }, compute) != pose);
+    CHECK(computed == 2);
+
+    // The counts are of the last frame
+    CHECK(cache.lookups() == 0);
+    cache.beginFrame();
+    CHECK(cache.lookups() == 3);
+    CHECK(near(cache.hitRate(), 1.0 / 3.0));
+
+    // And the poses only last a frame
+    CHECK(cache.get(key, compute) != pose);
+    CHECK(computed == 3);
+}
+
+// An arm playing the library's copy of the 4 tick clip
+static void loadArm(Animator& animator, AnimationLibrary& library)
+{
+    animator.load(armNodes(), armBones(), { armClip("Wave", 4.0) });
+    animator.share(library);
+    animator.playing = true;
+}
+
+TEST(copiesShareTheirPoses)
+{
+    AnimationLibrary library;
+    PoseCache cache;
+    Animator first, second;
+    loadArm(first, library);
+    loadArm(second, library);
+    CHECK(first.getClips()[0] == second.getClips()[0]);
+
+    const Pose* pose = first.run(1.5, &cache);
+    CHECK(pose != nullptr);
+    CHECK(second.run(1.5, &cache) == pose);
+    CHECK(second.run(1.5 + cache.step * 0.25, &cache) == pose);
+    CHECK(second.run(2.5, &cache) != pose);
+
+    // The same as without the cache
+    Animator alone;
+    loadArm(alone, library);
+    const Pose* computed = alone.run(1.5);
+    CHECK(computed->nodeTransforms == pose->nodeTransforms);
+
+    // Paused clips hold the rest pose whatever the time
+    first.playing = second.playing = false;
+    CHECK(first.run(0.5, &cache) == second.run(3.0, &cache));
+}
+
+TEST(theClipEndSharesTheStartPose)
+{
+    AnimationLibrary library;
+    PoseCache cache;
+    Animator start, end;
+    loadArm(start, library);
+    loadArm(end, library);
+
+    // Rounds up to the step on the clip's duration, which is the start
+    const Pose* pose = start.run(0.0, &cache);
+    CHECK(end.run(4.0 - cache.step * 0.25, &cache) == pose);
+
+    Animator alone;
+    loadArm(alone, library);
+    CHECK(alone.run(0.0)->nodeTransforms == pose->nodeTransforms);
+}
+
+TEST(keyframesHoldPastTheirEnds)
+{
+    Keyframes keys = armClip("Wave", 4.0).channels[0];
+    CHECK(keys.getInterpolatedTransform(5.0) == keys.getInterpolatedTransform(4.0));
+    CHECK(keys.getInterpolatedTransform(-1.0) == keys.getInterpolatedTransform(0.0));
+
+    glm::vec3 position, scaling;
+    glm::quat rotation;
+    CHECK(keys.sample(2.5, position, rotation, scaling));
+    glm::quat expected = glm::slerp(armBend(2), armBend(3), 0.5f);
+    CHECK(near(rotation.w, expected.w) && near(rotation.z, expected.z));
+    CHECK(!Keyframes().sample(0.0, position, rotation, scaling));
+}
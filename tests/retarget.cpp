@@ -0,0 +1,86 @@
+#include "retarget.h"
+#include "rig.h"
+#include "test.h"
+
+TEST(boneRolesIgnoreTheNamingScheme)
+{
+    std::string role;
+    CHECK(boneRole("mixamorig:LeftForeArm", role) == 'l' && role == "lowerarm");
+    CHECK(boneRole("lowerarm_l", role) == 'l' && role == "lowerarm");
+    CHECK(boneRole("forearm.L", role) == 'l' && role == "lowerarm");
+    CHECK(boneRole("R_Thigh", role) == 'r' && role == "upperleg");
+    CHECK(boneRole("RightUpLeg", role) == 'r' && role == "upperleg");
+    CHECK(boneRole("Hips", role) == 0 && role == "hips");
+    CHECK(boneRole("Spine_01", role) == 0 && role == "spine01");
+}
+
+static glm::mat4 localTransform(glm::vec3 translation, glm::quat rotation)
+{
+    return glm::translate(glm::mat4(1.0), translation) * glm::mat4_cast(rotation);
+}
+
+// The same arm, named and posed at rest differently by two exporters
+static std::vector<Node> sourceArm()
+{
+    glm::vec3 z(0.0, 0.0, 1.0);
+    return {
+        { "mixamorig:Hips", -1, 0, 0, localTransform({ 0.0, 1.0, 0.0 }, glm::angleAxis(0.2f, z)) },
+        { "mixamorig:LeftArm", 0, 0, 1, localTransform({ 0.2, 0.5, 0.0 }, glm::angleAxis(0.3f, z)) },
+        { "mixamorig:LeftForeArm", 1, 0, 2, localTransform({ 0.0, 0.3, 0.0 }, glm::angleAxis(-0.4f, z)) },
+        { "Extra", 0, 0, 3, localTransform({ 0.0, -0.2, 0.0 }, glm::quat(1.0, 0.0, 0.0, 0.0)) },
+    };
+}
+
+static std::vector<Node> targetArm()
+{
+    glm::vec3 x(1.0, 0.0, 0.0);
+    return {
+        { "pelvis", -1, 0, 0, localTransform({ 0.0, 2.0, 0.0 }, glm::quat(1.0, 0.0, 0.0, 0.0)) },
+        { "upperarm_l", 0, 0, 1, localTransform({ 0.4, 1.0, 0.0 }, glm::angleAxis(-0.5f, x)) },
+        { "lowerarm_l", 1, 0, 2, localTransform({ 0.0, 0.6, 0.0 }, glm::angleAxis(0.7f, x)) },
+        { "Tail", 0, 0, 3, localTransform({ 0.0, -0.4, 0.0 }, glm::quat(1.0, 0.0, 0.0, 0.0)) },
+        { "Hat", 0, 0, 4, glm::mat4(1.0) },
+    };
+}
+
+TEST(retargetMapsByAliasNameThenRole)
+{
+    RetargetMap map(sourceArm(), targetArm(), { { "Extra", "Tail" } });
+    CHECK(map.sources == std::vector<int>({ 0, 1, 2, 3, -1 }));
+    CHECK(map.mapped == 4);
+
+    // An alias wins over a name match, and over a role match
+    std::vector<Node> target = targetArm();
+    target[3].name = "Extra";
+    RetargetMap aliased(sourceArm(), target, {
+        { "mixamorig:Hips", "Extra" }, { "mixamorig:LeftArm", "lowerarm_l" }
+    });
+    CHECK(aliased.sources == std::vector<int>({ 0, 1, 1, 0, -1 }));
+}
+
+TEST(theSourceRestPoseIsTheTargetRestPose)
+{
+    std::vector<Node> source = sourceArm();
+    std::vector<Node> target = targetArm();
+    RetargetMap map(source, target, { { "Extra", "Tail" } });
+
+    for (size_t i = 0; i < target.size(); i++) {
+        int s = map.sources[i];
+        if (s == -1) continue;
+
+        // A single key holding the source's rest transform
+        glm::mat4 rest = source[s].transform;
+        Keyframes keys(
+            { { 0.0, glm::vec3(rest[3]) } },
+            { { 0.0, glm::vec3(1.0) } },
+            { { 0.0, glm::quat_cast(glm::mat3(rest)) } });
+        glm::mat4 result = map.apply(i, keys, 0.0);
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++)
+                CHECK(near(result[c][r], target[i].transform[c][r]));
+        }
+
+        // Without keys the node stays at its own rest
+        CHECK(map.apply(i, Keyframes(), 0.0) == target[i].transform);
+    }
+}
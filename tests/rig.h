@@ -0,0 +1,61 @@
+#pragma once
+
+#include <fstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "animator.h"
+
+// A two bone arm and clips that bend it, for the tests that need a model
+
+inline std::vector<Node> armNodes()
+{
+    glm::mat4 up = glm::translate(glm::mat4(1.0), glm::vec3(0.0, 1.0, 0.0));
+    return {
+        { "Armature", -1, 0, -1, glm::mat4(1.0) },
+        { "UpperArm", 0, 0, 0, up },
+        { "LowerArm", 1, 0, 1, up },
+        { "Body", 0, 1, -1, glm::mat4(1.0) },
+    };
+}
+
+inline BoneMap armBones()
+{
+    return {
+        { "UpperArm", { 0, glm::mat4(1.0) } },
+        { "LowerArm", { 1, glm::mat4(1.0) } },
+    };
+}
+
+// The rotation of the lower arm at a key of armClip
+inline glm::quat armBend(double tick)
+{
+    return glm::angleAxis(float(tick * 0.1), glm::vec3(0.0, 0.0, 1.0));
+}
+
+// Bends the lower arm a little more at every tick, with a key per tick
+inline Clip armClip(std::string name, double duration, double ticksPerSecond = 1.0)
+{
+    std::vector<Keyframes::VectorKey> positions, scalings;
+    std::vector<Keyframes::QuatKey> rotations;
+    for (int tick = 0; tick <= duration; tick++) {
+        positions.push_back({ tick, glm::vec3(0.0, 1.0, 0.0) });
+        scalings.push_back({ tick, glm::vec3(1.0) });
+        rotations.push_back({ tick, armBend(tick) });
+    }
+
+    Clip clip;
+    clip.name = name;
+    clip.ticksPerSecond = ticksPerSecond;
+    clip.duration = duration;
+    clip.channels.push_back(Keyframes(positions, scalings, rotations));
+    clip.channelNodes.push_back("LowerArm");
+    return clip;
+}
+
+// Stands in for the source file that cooked and streamed files are built from
+inline void writeFile(std::string path, std::string contents)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+}
@@ -0,0 +1,111 @@
+#include <cstring>
+#include <filesystem>
+
+#include "rig.h"
+#include "stream.h"
+#include "test.h"
+
+// Stream a 20 tick clip in 2 tick chunks, decoded on the calling thread
+static std::shared_ptr<const Clip> streamArmClip(std::string name)
+{
+    std::string sourcePath = temporaryPath(name + ".fbx");
+    std::string streamedPath = temporaryPath(name + ".streamed");
+    writeFile(sourcePath, "the source animation");
+    MappedFile source(sourcePath);
+    writeStreamedClips(streamedPath, source, armNodes(),
+                       { std::make_shared<const Clip>(armClip("Walk", 20.0)) }, 2.0);
+
+    std::vector<Node> nodes;
+    std::vector<std::shared_ptr<const Clip>> clips;
+    CHECK(loadStreamedClips(streamedPath, source, nullptr, nodes, clips));
+    std::filesystem::remove(sourcePath);
+    std::filesystem::remove(streamedPath); // The mapping stays valid
+    CHECK(nodes.size() == armNodes().size());
+    CHECK(clips.size() == 1 && clips[0]->stream);
+    return clips[0];
+}
+
+TEST(streamedChunksReachPastTheirEnds)
+{
+    std::shared_ptr<const Clip> clip = streamArmClip("chunks");
+    Keyframes whole = armClip("Walk", 20.0).channels[0];
+    CHECK(clip->stream->numChunks() == 10);
+
+    for (size_t i = 0; i < clip->stream->numChunks(); i++) {
+        std::shared_ptr<const ClipChunk> chunk = clip->stream->decode(i);
+        CHECK(chunk->start == i * 2.0 && chunk->end == i * 2.0 + 2.0);
+        CHECK(chunk->channels.size() == 1);
+        const std::vector<Keyframes::QuatKey>& keys = chunk->channels[0].getRotations();
+        CHECK(keys.front().first <= chunk->start && keys.back().first >= chunk->end);
+
+        // Every time in the chunk samples like the whole clip
+        for (double t = chunk->start; t <= chunk->end; t += 0.25) {
+            glm::vec3 position, scaling, expectedPosition, expectedScaling;
+            glm::quat rotation, expected;
+            CHECK(chunk->channels[0].sample(t, position, rotation, scaling));
+            whole.sample(t, expectedPosition, expected, expectedScaling);
+            CHECK(near(rotation.w, expected.w) && near(rotation.z, expected.z));
+        }
+    }
+}
+
+TEST(consumersKeepTheirWindows)
+{
+    std::shared_ptr<const Clip> clip = streamArmClip("windows");
+    ClipStream& stream = *clip->stream;
+    int first, second; // Stand in for two models playing the clip
+
+    CHECK(stream.chunk(0.5, &first) != nullptr);
+    CHECK(stream.chunk(19.5, &second) != nullptr);
+    CHECK(stream.isResident(0) && stream.isResident(9));
+
+    // The first one moving on doesn't evict the second one's chunks
+    CHECK(stream.chunk(10.5, &first) != nullptr);
+    CHECK(!stream.isResident(0));
+    CHECK(stream.isResident(4) && stream.isResident(7));
+    CHECK(stream.isResident(8) && stream.isResident(9));
+
+    // Looping back to the start
+    CHECK(stream.chunk(0.5, &first) != nullptr);
+    CHECK(!stream.isResident(5) && stream.isResident(9));
+
+    stream.release(&second);
+    CHECK(!stream.isResident(9) && stream.isResident(0));
+    stream.release(&first);
+    for (size_t i = 0; i < stream.numChunks(); i++)
+        CHECK(!stream.isResident(i));
+}
+
+TEST(staleStreamedFilesAreRejected)
+{
+    std::string sourcePath = temporaryPath("stale.fbx");
+    std::string streamedPath = temporaryPath("stale.streamed");
+    writeFile(sourcePath, "the source animation");
+    {
+        MappedFile source(sourcePath);
+        writeStreamedClips(streamedPath, source, armNodes(),
+                           { std::make_shared<const Clip>(armClip("Walk", 20.0)) }, 2.0);
+    }
+
+    // Touched, so the new time is written over the old one
+    std::filesystem::last_write_time(
+        sourcePath, std::filesystem::last_write_time(sourcePath) + std::chrono::seconds(10));
+    std::vector<Node> nodes;
+    std::vector<std::shared_ptr<const Clip>> clips;
+    {
+        MappedFile source(sourcePath);
+        CHECK(loadStreamedClips(streamedPath, source, nullptr, nodes, clips));
+        MappedFile streamed(streamedPath);
+        StreamedHeader header;
+        memcpy(&header, streamed.data(), sizeof(header));
+        CHECK(header.sourceTime == source.modifiedTime());
+    }
+
+    writeFile(sourcePath, "the other animation!");
+    {
+        MappedFile source(sourcePath);
+        CHECK(!loadStreamedClips(streamedPath, source, nullptr, nodes, clips));
+    }
+    std::filesystem::remove(sourcePath);
+    std::filesystem::remove(streamedPath);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The CPU side checks, run by ctest. They don't need a GL context, so they
+// only cover the code that turns data into other data
+
+struct TestCase
+{
+    const char* name;
+    std::function<void()> run;
+};
+
+inline std::vector<TestCase>& testCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct RegisterTest
+{
+    RegisterTest(const char* name, std::function<void()> run) { testCases().push_back({ name, run }); }
+};
+
+// Define a test, registered before main runs them
+#define TEST(name) \
+    static void name(); \
+    static RegisterTest name##Registered(#name, name); \
+    static void name()
+
+// Fail the test with where and what, thrown like the rest of the code's errors
+#define CHECK(condition) \
+    if (!(condition)) \
+        throw std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " + #condition
+
+inline bool near(float a, float b, float tolerance = 1e-4) { return std::abs(a - b) <= tolerance; }
+
+// A path in the temporary directory, unique to the test run
+std::string temporaryPath(std::string name);